@@ -22,6 +22,7 @@
 #define _LIBRIL_RECORD_STREAM_H
 
 #include <stdlib.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,10 @@ extern void record_stream_free(RecordStream* p_rs);
 extern int record_stream_get_next(RecordStream* p_rs, void** p_outRecord,
     size_t* p_outRecordLen);
 
+/* Every complete record of one read, see record_stream.c */
+extern int record_stream_get_batch(RecordStream* p_rs, struct iovec* p_records,
+    size_t maxRecords);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5384,6 +5384,104 @@ RIL_REQUEST_IMS_REG_STATE_CHANGE
 
 #define RIL_REQUEST_SET_EMERGENCY_NUMBER (RIL_CUS_REQUEST_BASE + 1)
 
+/**
+ * RIL_REQUEST_SET_UNSOL_SUBSCRIPTIONS
+ *
+ * Selects the unsolicited responses sent to the requesting client.
+ * Handled by libril itself, it is never passed to the vendor RIL.
+ *
+ * Bit n of the bitmap stands for unsolicited response
+ * RIL_UNSOL_RESPONSE_BASE + n. Clients that never send this request
+ * get every unsolicited response. Unsolicited responses no connected
+ * client subscribed to are not encoded at all.
+ *
+ * "data" is int *
+ * ((int *)data)[i] is bits 32 * i to 32 * i + 31 of the bitmap,
+ *  missing words are taken as 0
+ *
+ * "response" is NULL
+ *
+ * Valid errors:
+ *  SUCCESS
+ *  INVALID_ARGUMENTS
+ */
+#define RIL_REQUEST_SET_UNSOL_SUBSCRIPTIONS (RIL_CUS_REQUEST_BASE + 2)
+
+/**
+ * RIL_REQUEST_WITH_DEADLINE
+ *
+ * Sends another request with a deadline of its own instead of the
+ * default one of that request. Handled by libril itself.
+ *
+ * The request block is the deadline, then the wrapped request number
+ * and the wrapped request's own data:
+ * int32 deadline in milliseconds, 0 for no deadline
+ * int32 RIL_REQUEST_*
+ * data of that request
+ *
+ * "response" is the response of the wrapped request, sent with the
+ * serial of this one. If the deadline expires first, the response is
+ * CANCELLED and the vendor RIL gets onCancel for the wrapped request.
+ *
+ * Valid errors:
+ *  those of the wrapped request
+ *  CANCELLED
+ */
+#define RIL_REQUEST_WITH_DEADLINE (RIL_CUS_REQUEST_BASE + 3)
+
+/**
+ * RIL_REQUEST_CANCEL_REQUEST
+ *
+ * Cancels a request this client sent earlier and has no response for
+ * yet. Handled by libril itself.
+ *
+ * The cancelled request gets a CANCELLED response right away. If the
+ * vendor RIL already has it, it gets onCancel for it and its late
+ * completion is dropped.
+ *
+ * "data" is int *
+ * ((int *)data)[0] is the serial of the request to cancel
+ *
+ * "response" is NULL
+ *
+ * Valid errors:
+ *  SUCCESS
+ *  INVALID_ARGUMENTS
+ *  INVALID_STATE (no such request is pending, it may have completed)
+ */
+#define RIL_REQUEST_CANCEL_REQUEST (RIL_CUS_REQUEST_BASE + 4)
+
+/**
+ * RIL_REQUEST_SETUP_SHARED_RING
+ *
+ * Moves the responses and unsolicited responses of this client to a
+ * shared memory ring, for clients on the same device with heavy
+ * unsolicited traffic. Handled by libril itself, see
+ * telephony/ril_shm.h for the layout.
+ *
+ * The response comes on the socket, with three fds passed as
+ * SCM_RIGHTS on it or on an earlier part of the stream: the memfd, the
+ * eventfd rild signals the toClient ring on and the eventfd the client
+ * signals the toRil ring on. Every later response comes on the ring.
+ * Solicited responses fall back to the socket while the ring is full,
+ * unsolicited ones are dropped. Requests may be sent on either.
+ *
+ * "data" is int *
+ * ((int *)data)[0] is the wanted size of each ring in bytes, 0 for the
+ * smallest
+ *
+ * "response" is int *
+ * ((int *)response)[0] is the size of each ring
+ *
+ * Valid errors:
+ *  SUCCESS
+ *  INVALID_ARGUMENTS
+ *  INVALID_STATE (the rings are already set up)
+ *  NO_RESOURCES
+ *  REQUEST_NOT_SUPPORTED
+ */
+#define RIL_REQUEST_SETUP_SHARED_RING (RIL_CUS_REQUEST_BASE + 5)
+
 /* Backward compatible */
 
 /**
@@ -5442,6 +5540,12 @@ typedef void (*RIL_Cancel)(RIL_Token t);
 
 typedef void (*RIL_TimedCallback)(void* param);
 
+/**
+ * Handle of a callback scheduled with RIL_Env.RequestTimedCallbackEx.
+ * 0 is never a valid handle.
+ */
+typedef uint32_t RIL_TimedCallbackHandle;
+
 /**
  * Return a version string for your RIL implementation
  */
@@ -5501,6 +5605,20 @@ struct RIL_Env {
      * RIL_onRequestAck will be called by vendor when an Async RIL request was received
      * by them and an ack needs to be sent back to java ril. */
     void (*OnRequestAck)(RIL_Token t);
+
+    /**
+     * Same as RequestTimedCallback, but returns a handle that can later be
+     * passed to CancelTimedCallback, or 0 if the callback could not be
+     * scheduled. */
+    RIL_TimedCallbackHandle (*RequestTimedCallbackEx)(RIL_TimedCallback callback,
+        void* param, const struct timeval* relativeTime);
+
+    /**
+     * Cancel a callback scheduled with RequestTimedCallbackEx.
+     *
+     * Returns 0 if the callback was cancelled before it ran, -1 if the
+     * handle is stale or the callback is already running or has run. */
+    int (*CancelTimedCallback)(RIL_TimedCallbackHandle handle);
 };
 
 /**
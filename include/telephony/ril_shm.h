@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Shared memory transport between rild and a client on the same device,
+ * set up with RIL_REQUEST_SETUP_SHARED_RING.
+ *
+ * The memfd holds a RIL_ShmHeader followed by two single producer, single
+ * consumer rings: toClient carries responses and unsolicited responses,
+ * toRil carries requests. Records are the same Parcels as on the socket,
+ * each prefixed by its length in host byte order and padded to 4 bytes.
+ * A record never wraps, RIL_SHM_PAD marks the unused end of the ring.
+ *
+ * The consumer of each ring sleeps on an eventfd, the producer only
+ * writes it when the consumer said it is about to sleep.
+ */
+
+#ifndef _LIBRIL_RIL_SHM_H
+#define _LIBRIL_RIL_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RIL_SHM_MAGIC 0x4d485352 /* "RSHM" in little endian memory */
+#define RIL_SHM_VERSION 1
+#define RIL_SHM_PAD 0xffffffff
+
+/* Bounds of the data bytes of each ring, always a power of two */
+#define RIL_SHM_MIN_RING_SIZE (4 * 1024)
+#define RIL_SHM_MAX_RING_SIZE (256 * 1024)
+
+/* Producer and consumer fields sit on cache lines of their own */
+typedef struct {
+    uint32_t tail; /* bytes ever written, by the producer */
+    uint32_t reserved1[15];
+    uint32_t head; /* bytes ever consumed, by the consumer */
+    uint32_t waiting; /* set by the consumer before it sleeps */
+    uint32_t reserved2[14];
+} RIL_ShmRingControl;
+
+/* Followed by the data of toClient, then the data of toRil */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t ringSize;
+    uint32_t reserved1[13];
+    RIL_ShmRingControl toClient;
+    RIL_ShmRingControl toRil;
+} RIL_ShmHeader;
+
+/* One end of a ring, local to the process */
+typedef struct {
+    RIL_ShmRingControl* control;
+    uint8_t* data;
+    uint32_t size;
+    int eventFd;
+} RIL_ShmRing;
+
+/**
+ * Creates the memfd and maps it, ringSize is rounded up to a power of two
+ * within the RIL_SHM_*_RING_SIZE bounds.
+ *
+ * Returns the memfd, or -1 with errno set
+ */
+int ril_shm_create(uint32_t ringSize, RIL_ShmHeader** p_header, size_t* p_length);
+
+/* Maps a memfd received from rild, returns 0 or -1 with errno set */
+int ril_shm_map(int memfd, RIL_ShmHeader** p_header, size_t* p_length);
+
+/* Sets up the local ends of the rings of a mapped header */
+void ril_shm_rings(RIL_ShmHeader* header, RIL_ShmRing* toClient, RIL_ShmRing* toRil);
+
+/**
+ * Copies one record into the ring, it is visible to the consumer right
+ * away but the consumer is only woken by ril_shm_ring_notify().
+ *
+ * Returns 0, or -1 if the ring has no room for it
+ */
+int ril_shm_ring_write(RIL_ShmRing* ring, const void* data, size_t len);
+
+/* Wakes the consumer if it is waiting */
+void ril_shm_ring_notify(RIL_ShmRing* ring);
+
+/**
+ * Gets the next record in place, it stays valid until
+ * ril_shm_ring_consume().
+ *
+ * Returns 1 with p_record set, 0 if the ring is empty, or -1 with errno
+ * set to EBADMSG if the producer corrupted the ring, which is then
+ * unusable
+ */
+int ril_shm_ring_peek(RIL_ShmRing* ring, void** p_record, size_t* p_len);
+
+/* Releases the record returned by ril_shm_ring_peek() */
+void ril_shm_ring_consume(RIL_ShmRing* ring, size_t len);
+
+/**
+ * Tells the producer to notify the eventfd from now on.
+ *
+ * Returns 1 if the ring is still empty so the consumer can sleep on the
+ * eventfd, 0 if records came in meanwhile
+ */
+int ril_shm_ring_prepare_wait(RIL_ShmRing* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_LIBRIL_RIL_SHM_H*/
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A binary trace of requests, responses and unsolicited responses, cheap
+ * enough to stay enabled. Each thread writes fixed size records into a
+ * ring of its own, ril_trace_dump() writes them all out for an offline
+ * decoder (tools/ril_trace_decode.c).
+ */
+
+#ifndef _LIBRIL_RIL_TRACE_H
+#define _LIBRIL_RIL_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Records kept per thread, 0 compiles the trace out */
+#ifndef RIL_TRACE_RING_SIZE
+#define RIL_TRACE_RING_SIZE 256
+#endif
+
+/* Threads that hold a ring at once, the ring of a thread that exits is
+ * reused. Records of any further thread are dropped */
+#ifndef RIL_TRACE_MAX_THREADS
+#define RIL_TRACE_MAX_THREADS 16
+#endif
+
+#define RIL_TRACE_MAGIC 0x544c4952 /* "RILT" in a little endian dump */
+#define RIL_TRACE_VERSION 1
+
+typedef enum {
+    RIL_TRACE_REQUEST = 1, /* read from a client, length of the request data */
+    RIL_TRACE_RESPONSE, /* RIL_onRequestComplete, length of the response */
+    RIL_TRACE_UNSOL, /* RIL_onUnsolicitedResponse, token is 0 */
+} RIL_TraceType;
+
+/* Dumps are in host byte order */
+typedef struct {
+    uint64_t timeNs; /* ril_nano_time() */
+    uint32_t seq; /* odd while the record is being written */
+    uint16_t type; /* RIL_TraceType */
+    uint16_t thread; /* ring the record came from */
+    int32_t token;
+    int32_t id; /* RIL_REQUEST_* or RIL_UNSOL_* */
+    int32_t error; /* RIL_Errno of responses */
+    uint32_t length;
+} RIL_TraceRecord;
+
+/* Followed by count records, oldest first per thread */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t count;
+    uint32_t dropped; /* records of threads that got no ring */
+} RIL_TraceHeader;
+
+#if RIL_TRACE_RING_SIZE > 0
+void ril_trace(RIL_TraceType type, int32_t token, int32_t id, int32_t error,
+    uint32_t length);
+
+/* Writes a RIL_TraceHeader and the records to fd, returns 0 or -1 */
+int ril_trace_dump(int fd);
+#else
+#define ril_trace(type, token, id, error, length)
+#define ril_trace_dump(fd) (-1)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_LIBRIL_RIL_TRACE_H*/
@@ -18,8 +18,11 @@
 #define LOG_TAG "RIL_CPP"
 #define NDEBUG 1
 
+#include <telephony/librilutils.h>
 #include <telephony/record_stream.h>
 #include <telephony/ril.h>
+#include <telephony/ril_shm.h>
+#include <telephony/ril_trace.h>
 
 #include <assert.h>
 #include <binder/Parcel.h>
@@ -30,18 +33,27 @@
 #include <limits.h>
 #include <log/log_radio.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
 #include <local_socket.h>
 #include <ril_event.h>
+
+#if RIL_EVENT_USE_EVENTFD || RIL_SHM_TRANSPORT
+#include <sys/eventfd.h>
+#endif
 #define INVALID_HEX_CHAR 16
 using namespace android;
 
@@ -56,6 +68,40 @@ extern "C" void RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void* response,
 // match with constant in RIL.java
 #define MAX_COMMAND_BYTES (8 * 1024)
 
+// Requests taken out of the command stream per read
+#define MAX_COMMAND_BATCH 16
+
+// Responses the socket does not take right away are buffered, up to this
+// many bytes per client. Past that, unsolicited responses are dropped and
+// a client that stops reading its solicited responses is disconnected.
+#ifndef MAX_OUTPUT_BUFFER_BYTES
+#define MAX_OUTPUT_BUFFER_BYTES (64 * 1024)
+#endif
+#define OUTPUT_BUFFER_INIT_BYTES 4096
+// Most responses handed to a single writev()
+#define MAX_RESPONSE_BATCH 16
+
+// Number of clients connected to the command socket at the same time.
+// Solicited responses go back to the requesting client, unsolicited
+// ones go to every client.
+#ifndef MAX_COMMAND_CLIENTS
+#define MAX_COMMAND_CLIENTS 4
+#endif
+
+// Number of requests whose response can be cached, see CACHE_STATIC
+#define MAX_CACHED_RESPONSES 8
+
+// Number of different requests that can be shared in flight, see CACHE_IN_FLIGHT
+#define MAX_SHARED_REQUESTS 16
+
+// Words in a client's unsolicited subscription bitmap, one bit per
+// s_unsolResponses entry
+#define UNSOL_FILTER_WORDS 2
+
+// Requests of a client are hashed by serial, so RIL_REQUEST_CANCEL_REQUEST
+// finds its target directly, a power of two
+#define CLIENT_REQUEST_BUCKETS 16
+
 // Basically: memset buffers that the client library
 // shouldn't be using anymore in an attempt to find
 // memory usage issues sooner.
@@ -72,38 +118,69 @@ extern "C" void RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void* response,
 /* Negative values for private RIL errno's */
 #define RIL_ERRNO_INVALID_RESPONSE -1
 
-// request, response, and unsolicited msg print macro
-#define PRINTBUF_SIZE 8096
-
 // Enable verbose logging
 #define VDBG 0
 
-// Enable RILC log
-#define RILC_LOG 0
+// Number of preallocated timed callbacks. Each one can be cancelled
+// through the handle returned by RIL_requestTimedCallbackEx.
+#ifndef MAX_TIMED_CALLBACKS
+#define MAX_TIMED_CALLBACKS 64
+#endif
 
-#if RILC_LOG
-#define startRequest sprintf(printBuf, "(")
-#define closeRequest sprintf(printBuf, "%s)", printBuf)
-#define printRequest(token, req) \
-    RLOGD("[%04d]> %s %s", token, requestToString(req), printBuf)
+// Timed callbacks requested without a handle leave this many slots to the
+// ones with a handle, which have no heap fallback
+#ifndef RESERVED_TIMED_CALLBACKS
+#define RESERVED_TIMED_CALLBACKS 16
+#endif
 
-#define startResponse sprintf(printBuf, "%s {", printBuf)
-#define closeResponse sprintf(printBuf, "%s}", printBuf)
-#define printResponse RLOGD("%s", printBuf)
+// Pending requests are allocated from a slab that grows by
+// PENDING_REQUESTS_CHUNK entries, up to MAX_PENDING_REQUESTS in flight.
+// Past that, up to MAX_OVERFLOW_REQUESTS more fall back to the heap.
+// The RIL_Token of a request is its slot in both, with a generation.
+#define PENDING_REQUESTS_CHUNK 32
+#ifndef MAX_PENDING_REQUESTS
+#define MAX_PENDING_REQUESTS 1024
+#endif
+#ifndef MAX_OVERFLOW_REQUESTS
+#define MAX_OVERFLOW_REQUESTS 256
+#endif
 
-#define clearPrintBuf printBuf[0] = 0
-#define removeLastChar printBuf[strlen(printBuf) - 1] = 0
-#define appendPrintBuf(x...) snprintf(printBuf, PRINTBUF_SIZE, x)
-#else
-#define startRequest
-#define closeRequest
-#define printRequest(token, req)
-#define startResponse
-#define closeResponse
-#define printResponse
-#define clearPrintBuf
-#define removeLastChar
-#define appendPrintBuf(x...)
+// Strings and arrays decoded from a request are carved out of an arena of
+// this many bytes; larger requests spill into heap chunks.
+#ifndef REQUEST_ARENA_SIZE
+#define REQUEST_ARENA_SIZE 1024
+#endif
+
+// Requests handed to the dispatch workers keep a copy of their data in one
+// of these preallocated blocks; larger ones, or ones past the last block,
+// fall back to the heap.
+#ifndef REQUEST_PAYLOAD_SIZE
+#define REQUEST_PAYLOAD_SIZE 512
+#endif
+#ifndef MAX_REQUEST_PAYLOADS
+#define MAX_REQUEST_PAYLOADS 32
+#endif
+
+// Clients may move their responses and requests to shared memory rings,
+// see RIL_REQUEST_SETUP_SHARED_RING. Needs memfd and eventfd.
+#ifndef RIL_SHM_TRANSPORT
+#define RIL_SHM_TRANSPORT RIL_EVENT_USE_EVENTFD
+#endif
+
+// Timestamps of this many completed requests are kept for the latency
+// summary on the debug socket. 0 disables the tracing.
+#ifndef RIL_LATENCY_TRACE_SIZE
+#define RIL_LATENCY_TRACE_SIZE 512
+#endif
+
+// How long a debug socket client gets to send a command before it is
+// given the default text dump
+#define DEBUG_COMMAND_TIMEOUT_MS 100
+
+// Number of threads running request dispatch off the event loop.
+// 0 dispatches inline on the event loop thread, as before.
+#ifndef RIL_DISPATCH_WORKERS
+#define RIL_DISPATCH_WORKERS 3
 #endif
 
 enum WakeType {
@@ -111,34 +188,233 @@ enum WakeType {
     WAKE_PARTIAL
 };
 
+/* Requests in the same queue are dispatched one at a time, in order.
+ * The categories follow request2eventtype() in reference-ril. */
+typedef enum {
+    QUEUE_DEFAULT = 0,
+    QUEUE_MODEM,
+    QUEUE_CALL,
+    QUEUE_SMS,
+    QUEUE_SIM,
+    QUEUE_DATA,
+    QUEUE_NETWORK,
+    QUEUE_COUNT
+} RequestQueue;
+
+typedef enum {
+    CACHE_NONE = 0,
+    CACHE_IN_FLIGHT, // identical requests not dispatched yet share one response
+    CACHE_STATIC // never changes while the radio stays available
+} ResponseCaching;
+
 typedef struct {
     int requestNumber;
     void (*dispatchFunction)(Parcel& p, struct RequestInfo* pRI);
     int (*responseFunction)(Parcel& p, void* response, size_t responselen);
+    RequestQueue queue;
+    ResponseCaching caching;
+    int deadline; // seconds before the request fails if not completed, 0 for never
+    const char* name; // without the RIL_REQUEST_ prefix, NULL for unused numbers
 } CommandInfo;
 
+/* Encoded successful response of a CACHE_STATIC request, after the token */
+typedef struct {
+    int requestNumber; // 0 if unused
+    uint8_t* data;
+    size_t size;
+} CachedResponse;
+
 typedef struct {
     int requestNumber;
     int (*responseFunction)(Parcel& p, void* response, size_t responselen);
     WakeType wakeType;
+    const char* name; // NULL for unused numbers
 } UnsolResponseInfo;
 
+typedef enum {
+    STICKY_NONE,
+    STICKY_LAST, // the last one is replayed to clients as they connect
+    STICKY_UNDELIVERED, // replayed once, to the next client, if no client got it
+} StickyMode;
+
+/* Throttling of a high-rate unsolicited response, see ril_unsol_policies.h */
+typedef struct {
+    int requestNumber;
+    int coalesceMs; // hold the first one this long, later ones replace it
+    int minIntervalMs; // between two sends
+    int hysteresis; // int payloads only: drop unless a value moves this much, 0 = off
+    StickyMode sticky;
+} UnsolPolicyInfo;
+
+typedef struct {
+    const UnsolPolicyInfo* policy; // NULL if sent unthrottled
+    int index; // in s_unsolResponses
+    int64_t lastSent; // monotonic ms
+    void* pending; // encoded response waiting for the flush
+    size_t pendingSize;
+    bool scheduled; // flush timer armed
+    int* baseline; // last accepted payload, for the hysteresis
+    size_t baselineSize;
+    unsigned int coalesced;
+    unsigned int suppressed;
+} UnsolThrottle;
+
+/* Encoded copy of the last response of a sticky unsolicited ID */
+typedef struct {
+    StickyMode sticky;
+    uint8_t* data; // NULL until the first one
+    size_t size; // 0 when there is nothing to replay
+    size_t capacity;
+} StickyResponse;
+
+/* Ring of response bytes waiting for the socket to become writable */
+typedef struct {
+    uint8_t* data;
+    size_t capacity;
+    size_t head; // offset of the oldest queued byte
+    size_t count; // bytes queued
+    unsigned int dropped; // unsolicited responses dropped on overflow
+} OutputBuffer;
+
+/* One connection on the command socket */
+typedef struct {
+    int id;
+    int fd; // -1 while the slot is unused, guarded by s_writeMutex
+    uint32_t epoch; // bumped when the connection closes
+    RecordStream* p_rs; // NULL on a SOCK_SEQPACKET socket
+    struct ril_event event;
+    OutputBuffer output; // guarded by s_writeMutex
+    uint32_t unsolFilter[UNSOL_FILTER_WORDS]; // guarded by s_writeMutex
+    // its requests by serial, of all epochs, guarded by s_pendingRequestsMutex
+    struct RequestInfo* requests[CLIENT_REQUEST_BUCKETS];
+#if RIL_SHM_TRANSPORT
+    // shared memory rings, all guarded by s_writeMutex
+    RIL_ShmHeader* shm; // NULL unless set up
+    size_t shmLength;
+    bool shmActive; // responses go to toClient
+    RIL_ShmRing toClient;
+    RIL_ShmRing toRil;
+    struct ril_event shmEvent; // toRil.eventFd, event loop only
+    int passFds[3]; // go along with the next write on the socket
+    int numPassFds;
+    unsigned int shmDropped; // unsolicited responses dropped on a full ring
+#endif
+} RilClient;
+
+typedef struct RequestArenaChunk {
+    struct RequestArenaChunk* p_next;
+    size_t size;
+} RequestArenaChunk;
+
+/* Bump allocator backing one request dispatch at a time. */
+typedef struct {
+    char* p_cur;
+    size_t left; // bytes available at p_cur
+    size_t baseUsed;
+    RequestArenaChunk* p_chunks; // heap spill, released on reset
+    uint64_t base[REQUEST_ARENA_SIZE / sizeof(uint64_t)];
+} RequestArena;
+
+typedef enum {
+    REQUEST_FREE,
+    REQUEST_QUEUED, // registered, waiting for a dispatch worker
+    REQUEST_DISPATCHED, // handed to the vendor RIL
+    REQUEST_COMPLETING, // RIL_onRequestComplete in progress
+    REQUEST_ATTACHED, // answered along with an identical request in flight
+    REQUEST_EXPIRED, // failed on its deadline, waiting for the vendor RIL to let go
+    REQUEST_STATE_COUNT
+} RequestState;
+
 typedef struct RequestInfo {
     int32_t token; // this is not RIL_Token
-    CommandInfo* pCI;
-    struct RequestInfo* p_next;
+    const CommandInfo* pCI;
+    struct RequestInfo* p_next; // free list link
+    int slot; // in the slab, MAX_PENDING_REQUESTS and up if heap allocated
+    uint16_t generation; // bumped on free, stale tokens stop matching
+    RequestState state;
+    RilClient* client; // where the response goes, NULL for local requests
+    uint32_t epoch; // client->epoch when the request was received
     char cancelled;
     char local; // responses to local commands do not go back to command process
+    RequestArena* arena; // set while the request is being dispatched
+    struct RequestInfo* p_followers; // identical requests attached to this one
+    struct RequestInfo* p_nextFollower;
+    struct RequestInfo* p_leader; // the request it is attached to
+    struct RequestInfo* p_nextOfClient; // in client->requests
+    int64_t deadline; // monotonic ms, 0 for none
+    int deadlineIndex; // in s_deadlineHeap, -1 if not in it
+    char expiring; // failed by checkRequestDeadlines, which frees it if completed
+    struct RequestInfo* p_nextExpired;
+#if RIL_LATENCY_TRACE_SIZE > 0
+    uint32_t traceId; // tells a reused slot apart once onRequest returns
+    uint64_t enqueueNs; // ril_nano_time() when the request was read
+    uint64_t dispatchNs; // when it was handed to the vendor RIL
+    uint64_t returnNs; // when onRequest returned, 0 if it completed first
+#endif
+#if RIL_DISPATCH_WORKERS > 0
+    void* buffer; // copy of the request record until it is dispatched
+    size_t buflen;
+    struct RequestInfo* p_nextQueued;
+#endif
 } RequestInfo;
 
+/* Registry entry of a heap allocated request, it outlives the request */
+typedef struct {
+    RequestInfo* pRI; // NULL while free
+    uint16_t generation;
+    int nextFree;
+} OverflowRequest;
+
+static_assert(MAX_PENDING_REQUESTS + MAX_OVERFLOW_REQUESTS < 0xffff,
+    "request tokens carry the slot in 16 bits");
+
+#if RIL_LATENCY_TRACE_SIZE > 0
+/* One completed request, written without locks, see traceRequestComplete */
+typedef struct {
+    uint32_t seq; // odd while the record is being written
+    int32_t requestNumber;
+    int32_t token;
+    int32_t error;
+    uint64_t enqueueNs;
+    uint64_t dispatchNs;
+    uint64_t returnNs;
+    uint64_t completeNs;
+} LatencyRecord;
+#endif
+
+#if RIL_DISPATCH_WORKERS > 0
+typedef struct {
+    RequestInfo* p_head;
+    RequestInfo* p_tail;
+    bool busy; // a worker is dispatching from this queue
+} DispatchQueue;
+#endif
+
+typedef struct {
+    unsigned int hits; // allocations served from the pool
+    unsigned int misses; // allocations that fell back to the heap
+    int inUse;
+    int peak;
+} PoolStats;
+
+typedef enum {
+    TIMED_CALLBACK_ARMED,
+    TIMED_CALLBACK_CANCELLED, // expired, but must not run
+    TIMED_CALLBACK_RUNNING
+} TimedCallbackState;
+
 typedef struct UserCallbackInfo {
     RIL_TimedCallback p_callback;
     void* userParam;
     struct ril_event event;
     struct UserCallbackInfo* p_next;
+    int slot; // index in s_timedCallbacks, -1 if heap allocated
+    uint16_t generation;
+    TimedCallbackState state;
 } UserCallbackInfo;
 
 extern "C" const char* requestToString(int request);
+extern "C" int requestFromString(const char* name);
 extern "C" const char* failCauseToString(RIL_Errno);
 extern "C" const char* callStateToString(RIL_CallState);
 extern "C" const char* radioStateToString(RIL_RadioState);
@@ -189,32 +465,88 @@ static pthread_t s_tid_dispatch;
 static int s_started = 0;
 
 static int s_fdListen = -1;
-static int s_fdCommand = -1;
+static int s_fdDebug = -1;
+// the command socket keeps message boundaries, no length headers on it
+static bool s_seqPacket = false;
+static uint8_t s_packetBuffer[MAX_COMMAND_BYTES]; // event loop only
+static RilClient s_clients[MAX_COMMAND_CLIENTS];
+static int s_numClients = 0; // event loop only
+// union of the unsolFilter of connected clients, written under s_writeMutex
+static uint32_t s_unsolWanted[UNSOL_FILTER_WORDS];
 
 static int s_fdWakeupRead;
 static int s_fdWakeupWrite;
+// set while a wakeup is in flight, so concurrent triggers coalesce
+static bool s_wakeupPending = false;
 
-static struct ril_event s_commands_event;
 static struct ril_event s_wakeupfd_event;
 static struct ril_event s_listen_event;
+static struct ril_event s_debug_event;
+static bool s_debugSessionBusy = false; // a thread serves a debug client
+static struct ril_event s_deadline_event;
 
 static pthread_mutex_t s_pendingRequestsMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t s_writeMutex = PTHREAD_MUTEX_INITIALIZER;
-static RequestInfo* s_pendingRequests = NULL;
+static RequestInfo* s_pendingRequestChunks[MAX_PENDING_REQUESTS / PENDING_REQUESTS_CHUNK];
+static RequestInfo* s_freeRequests = NULL;
+static OverflowRequest s_overflowRequests[MAX_OVERFLOW_REQUESTS];
+static int s_freeOverflowRequest = -1;
+static int s_usedOverflowRequests = 0; // entries handed out at least once
+static PoolStats s_requestPoolStats;
+static int s_pendingRequestSlots = 0; // slab capacity
+static int s_requestStateCounts[REQUEST_STATE_COUNT];
+// last request of each shareable kind, guarded by s_pendingRequestsMutex
+static RequestInfo* s_inFlightRequests[MAX_SHARED_REQUESTS];
+// earliest request deadline the timer is armed for, guarded by s_pendingRequestsMutex
+static int64_t s_nextDeadline = 0;
+// requests with a deadline, earliest first, guarded by s_pendingRequestsMutex
+static RequestInfo** s_deadlineHeap = NULL;
+static int s_deadlineCount = 0;
+static int s_deadlineCapacity = 0;
 
 static const struct timeval TIMEVAL_WAKE_TIMEOUT = { 1, 0 };
 
-static UserCallbackInfo* s_last_wake_timeout_info = NULL;
+static RIL_TimedCallbackHandle s_last_wake_timeout_handle = 0;
+
+static pthread_mutex_t s_timedCallbackMutex = PTHREAD_MUTEX_INITIALIZER;
+static UserCallbackInfo s_timedCallbacks[MAX_TIMED_CALLBACKS];
+static UserCallbackInfo* s_freeTimedCallbacks = NULL;
+static int s_usedTimedCallbacks = 0; // slots handed out at least once
+static int s_availableTimedCallbacks = MAX_TIMED_CALLBACKS; // free slots
+static PoolStats s_timedCallbackPoolStats;
+
+#if RIL_DISPATCH_WORKERS > 0
+static pthread_mutex_t s_dispatchMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_dispatchCond = PTHREAD_COND_INITIALIZER;
+static DispatchQueue s_dispatchQueues[QUEUE_COUNT];
+static pthread_t s_dispatchWorkers[RIL_DISPATCH_WORKERS];
+static int s_dispatchWorkersStarted = 0;
+static int s_nextDispatchQueue = 0;
+
+typedef union RequestPayload {
+    union RequestPayload* p_next; // while free
+    uint8_t data[REQUEST_PAYLOAD_SIZE];
+} RequestPayload;
+
+static pthread_mutex_t s_requestPayloadMutex = PTHREAD_MUTEX_INITIALIZER;
+static RequestPayload s_requestPayloads[MAX_REQUEST_PAYLOADS];
+static RequestPayload* s_freeRequestPayloads = NULL;
+static int s_usedRequestPayloads = 0; // blocks handed out at least once
+static PoolStats s_requestPayloadPoolStats;
+#endif
 
-static void* s_lastNITZTimeData = NULL;
-static size_t s_lastNITZTimeDataSize;
+static RequestArena s_loopArena; // inline dispatch on the event loop
 
-#if RILC_LOG
-static char printBuf[PRINTBUF_SIZE];
+#if RIL_LATENCY_TRACE_SIZE > 0
+static LatencyRecord s_latencyRing[RIL_LATENCY_TRACE_SIZE];
+static uint32_t s_latencyHead = 0; // records ever written
+static uint32_t s_nextTraceId = 0;
 #endif
 
 /*******************************************************************/
-static int sendResponse(Parcel& p);
+static int sendResponse(RilClient* client, uint32_t epoch, Parcel& p);
+static int broadcastResponse(int unsolResponseIndex, Parcel& p);
+static void updateUnsolWanted(void);
 
 static void dispatchVoid(Parcel& p, RequestInfo* pRI);
 static void dispatchString(Parcel& p, RequestInfo* pRI);
@@ -236,6 +568,9 @@ static void dispatchGsmBrSmsCnf(Parcel& p, RequestInfo* pRI);
 static void dispatchDataProfile(Parcel& p, RequestInfo* pRI);
 static void dispatchManualSelection(Parcel& p, RequestInfo* pRI);
 static void dispatchConferenceInvite(Parcel& p, RequestInfo* pRI);
+static void dispatchSetUnsolSubscriptions(Parcel& p, RequestInfo* pRI);
+static void dispatchCancelRequest(Parcel& p, RequestInfo* pRI);
+static void dispatchSetupSharedRing(Parcel& p, RequestInfo* pRI);
 static int responseInts(Parcel& p, void* response, size_t responselen);
 static int responseStrings(Parcel& p, void* response, size_t responselen);
 static int responseString(Parcel& p, void* response, size_t responselen);
@@ -262,36 +597,232 @@ static RIL_RadioState processRadioState(RIL_RadioState newRadioState);
 
 extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
     size_t datalen);
+static void sendUnsolicitedResponse(RilClient* client, int unsolResponse,
+    const void* data, size_t datalen);
+
+static int internalRequestTimedCallback(RIL_TimedCallback callback, void* param,
+    const struct timeval* relativeTime, RIL_TimedCallbackHandle* p_handle);
+
+static RequestInfo* checkAndDequeueRequestInfo(RIL_Token t);
+static RIL_Token requestToken(RequestInfo* pRI);
+static RequestInfo* allocRequestInfo(RilClient* client, int32_t token);
+static void freeRequestInfo(RequestInfo* pRI);
+static void setRequestDispatched(RequestInfo* pRI);
+static bool attachToInFlightRequest(RequestInfo* pRI);
+static void setRequestDeadline(RequestInfo* pRI, int timeoutMs);
+static void removeRequestDeadline(RequestInfo* pRI);
+static void checkRequestDeadlines(int fd, short flags, void* param);
+static int64_t monotonicMs(void);
+#if RIL_LATENCY_TRACE_SIZE > 0
+static void traceRequestReceived(RequestInfo* pRI);
+static uint32_t traceRequestDispatch(RequestInfo* pRI);
+static void traceRequestReturn(RIL_Token t, uint32_t traceId);
+static void traceRequestComplete(RequestInfo* pRI, RIL_Errno e);
+#else
+#define traceRequestReceived(pRI)
+#define traceRequestDispatch(pRI) 0
+#define traceRequestReturn(t, traceId) ((void)(t), (void)(traceId))
+#define traceRequestComplete(pRI, e)
+#endif
+#if RIL_DISPATCH_WORKERS > 0
+static void enqueueRequest(RequestInfo* pRI);
+static void startDispatchWorkers(void);
+#endif
 
-static UserCallbackInfo* internalRequestTimedCallback(RIL_TimedCallback callback, void* param,
-    const struct timeval* relativeTime);
+extern "C" int RIL_cancelTimedCallback(RIL_TimedCallbackHandle handle);
 
 static void wakeTimeoutCallback(void* param);
+static void triggerEvLoop(void);
+static void rilEventAddWakeup(struct ril_event* ev);
+#if RIL_SHM_TRANSPORT
+static void processSharedRingCallback(int fd, short flags, void* param);
+#endif
+
+/* Rows of the command tables, every field is set so -Wextra stays quiet */
+#define COMMAND(name, dispatch, response, queue, caching, deadline) \
+    { RIL_REQUEST_##name, dispatch, response, queue, caching, deadline, #name }
+#define UNNAMED_COMMAND(number, dispatch, response) \
+    { number, dispatch, response, QUEUE_DEFAULT, CACHE_NONE, 0, NULL }
+#define UNUSED_COMMAND(number) UNNAMED_COMMAND(number, NULL, NULL)
+#define UNSOL(name, response, wakeType) \
+    { RIL_UNSOL_##name, response, wakeType, "UNSOL_" #name }
+#define UNUSED_UNSOL(number) { number, responseVoid, WAKE_PARTIAL, NULL }
 
 /* Index == requestNumber */
-static CommandInfo s_commands[] = {
+static constexpr CommandInfo s_commands[] = {
 #include "ril_commands.h"
 };
 
 /* Index == requestNumber */
-static CommandInfo s_second_commands[] = {
+static constexpr CommandInfo s_second_commands[] = {
 #include "ril_second_commands.h"
 };
 
 /* Index == requestNumber */
-static CommandInfo s_ims_commands[] = {
+static constexpr CommandInfo s_ims_commands[] = {
 #include "ril_ims_commands.h"
 };
 
-static UnsolResponseInfo s_unsolResponses[] = {
+static constexpr UnsolResponseInfo s_unsolResponses[] = {
 #include "ril_unsol_commands.h"
 };
 
+static constexpr UnsolPolicyInfo s_unsolPolicies[] = {
+#include "ril_unsol_policies.h"
+};
+
+static pthread_mutex_t s_unsolThrottleMutex = PTHREAD_MUTEX_INITIALIZER;
+static UnsolThrottle s_unsolThrottles[NUM_ELEMS(s_unsolResponses)];
+
+static pthread_mutex_t s_responseCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static CachedResponse s_responseCache[MAX_CACHED_RESPONSES];
+static StickyResponse s_stickyResponses[NUM_ELEMS(s_unsolResponses)]; // guarded by s_writeMutex
+
 /* Index == requestNumber */
-static CommandInfo s_cus_commands[] = {
+static constexpr CommandInfo s_cus_commands[] = {
 #include "ril_cus_commands.h"
 };
 
+#undef COMMAND
+#undef UNNAMED_COMMAND
+#undef UNUSED_COMMAND
+#undef UNSOL
+#undef UNUSED_UNSOL
+
+/* The request numbers of one command table, its first entry is unused */
+typedef struct {
+    const CommandInfo* commands; // the entry of first
+    int32_t first;
+    int32_t count;
+} CommandRange;
+
+static constexpr CommandRange s_commandRanges[] = {
+    { &s_commands[1], 1, NUM_ELEMS(s_commands) - 1 },
+    { &s_second_commands[1], RIL_SECOND_REQUEST_BASE + 1, NUM_ELEMS(s_second_commands) - 1 },
+    { &s_ims_commands[1], RIL_IMS_REQUEST_BASE + 1, NUM_ELEMS(s_ims_commands) - 1 },
+    { &s_cus_commands[1], RIL_CUS_REQUEST_BASE + 1, NUM_ELEMS(s_cus_commands) - 1 },
+};
+
+/**
+ * Request numbers are split in pages, each one covered by at most one
+ * command table, so finding the CommandInfo of a request is a page load
+ * and a bounds check.
+ */
+#define COMMAND_PAGE_SIZE 100
+
+static constexpr int NUM_COMMAND_PAGES
+    = (RIL_CUS_REQUEST_BASE + NUM_ELEMS(s_cus_commands) - 1) / COMMAND_PAGE_SIZE + 1;
+
+typedef struct {
+    CommandRange pages[NUM_COMMAND_PAGES];
+} CommandPages;
+
+static constexpr bool isIndexedByRequest(const CommandInfo* table, size_t count, int base)
+{
+    for (size_t i = 1; i < count; i++) {
+        if (table[i].requestNumber != base + (int)i) {
+            return false;
+        }
+    }
+
+    return table[0].requestNumber == 0;
+}
+
+static constexpr bool isCachingKeyedByRequest(void)
+{
+    // cached and shared responses are keyed by request number alone
+    for (const CommandRange& range : s_commandRanges) {
+        for (int i = 0; i < range.count; i++) {
+            if (range.commands[i].caching != CACHE_NONE
+                && range.commands[i].dispatchFunction != dispatchVoid) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static constexpr bool arePoliciesOfUnsolResponses(void)
+{
+    for (const UnsolPolicyInfo& policy : s_unsolPolicies) {
+        int index = policy.requestNumber - RIL_UNSOL_RESPONSE_BASE;
+
+        if (index < 0 || index >= (int)NUM_ELEMS(s_unsolResponses)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static constexpr bool commandRangesShareNoPage(void)
+{
+    for (size_t i = 1; i < NUM_ELEMS(s_commandRanges); i++) {
+        const CommandRange& prev = s_commandRanges[i - 1];
+
+        if ((prev.first + prev.count - 1) / COMMAND_PAGE_SIZE
+            >= s_commandRanges[i].first / COMMAND_PAGE_SIZE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static constexpr CommandPages buildCommandPages(void)
+{
+    CommandPages table = {};
+
+    for (const CommandRange& range : s_commandRanges) {
+        for (int page = range.first / COMMAND_PAGE_SIZE;
+             page <= (range.first + range.count - 1) / COMMAND_PAGE_SIZE; page++) {
+            table.pages[page] = range;
+        }
+    }
+
+    return table;
+}
+
+static_assert(isIndexedByRequest(s_commands, NUM_ELEMS(s_commands), 0),
+    "ril_commands.h is out of order");
+static_assert(isIndexedByRequest(s_second_commands, NUM_ELEMS(s_second_commands),
+                  RIL_SECOND_REQUEST_BASE),
+    "ril_second_commands.h is out of order");
+static_assert(isIndexedByRequest(s_ims_commands, NUM_ELEMS(s_ims_commands),
+                  RIL_IMS_REQUEST_BASE),
+    "ril_ims_commands.h is out of order");
+static_assert(isIndexedByRequest(s_cus_commands, NUM_ELEMS(s_cus_commands),
+                  RIL_CUS_REQUEST_BASE),
+    "ril_cus_commands.h is out of order");
+static_assert(isCachingKeyedByRequest(),
+    "only requests without arguments can be cached");
+static_assert(commandRangesShareNoPage(),
+    "command tables overlap, raise the request bases or lower COMMAND_PAGE_SIZE");
+
+static_assert(arePoliciesOfUnsolResponses(),
+    "ril_unsol_policies.h has a row for an unknown unsolicited response");
+static_assert(NUM_ELEMS(s_unsolResponses) <= UNSOL_FILTER_WORDS * 32,
+    "ril_unsol_commands.h outgrew the client filters, raise UNSOL_FILTER_WORDS");
+
+static constexpr CommandPages s_commandPages = buildCommandPages();
+
+/* Returns NULL for request numbers without a command */
+static inline const CommandInfo* findCommandInfo(int32_t request)
+{
+    const CommandRange* range;
+    uint32_t index;
+
+    if ((uint32_t)request >= NUM_COMMAND_PAGES * COMMAND_PAGE_SIZE) {
+        return NULL;
+    }
+
+    range = &s_commandPages.pages[request / COMMAND_PAGE_SIZE];
+    index = (uint32_t)(request - range->first);
+
+    return index < (uint32_t)range->count ? &range->commands[index] : NULL;
+}
+
 /* For older RILs that do not support new commands RIL_REQUEST_VOICE_RADIO_TECH and
  * RIL_UNSOL_VOICE_RADIO_TECH_CHANGED messages, decode the voice radio tech from
  * radio state message and store it. Every time there is a change in Radio State
@@ -303,39 +834,303 @@ int voiceRadioTech = -1;
  * check to see if SIM/RUIM status changed and notify telephony */
 int simRuimStatus = -1;
 
-static char* strdupReadString(Parcel& p)
+static void requestArenaInit(RequestArena* arena)
+{
+    arena->p_cur = (char*)arena->base;
+    arena->left = sizeof(arena->base);
+    arena->baseUsed = 0;
+    arena->p_chunks = NULL;
+}
+
+/**
+ * Returns zeroed memory that stays valid until the dispatch function of
+ * pRI returns, or NULL if out of memory. Nothing is freed individually.
+ */
+static void* requestArenaAlloc(RequestInfo* pRI, size_t size)
+{
+    RequestArena* arena = pRI->arena;
+    size_t aligned = (size + 7) & ~(size_t)7;
+    void* ret;
+
+    if (size == 0) {
+        // callers rely on getting a non-null pointer
+        aligned = 8;
+    } else if (aligned < size) {
+        return NULL;
+    }
+
+    if (aligned > arena->left) {
+        size_t chunkSize = aligned > REQUEST_ARENA_SIZE ? aligned : REQUEST_ARENA_SIZE;
+        RequestArenaChunk* chunk;
+
+        if (chunkSize > SIZE_MAX - sizeof(RequestArenaChunk)) {
+            return NULL;
+        }
+
+        chunk = (RequestArenaChunk*)malloc(sizeof(RequestArenaChunk) + chunkSize);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        chunk->size = chunkSize;
+        chunk->p_next = arena->p_chunks;
+        arena->p_chunks = chunk;
+        arena->p_cur = (char*)(chunk + 1);
+        arena->left = chunkSize;
+    } else if (arena->p_chunks == NULL) {
+        arena->baseUsed += aligned;
+    }
+
+    ret = arena->p_cur;
+    arena->p_cur += aligned;
+    arena->left -= aligned;
+
+    memset(ret, 0, size);
+    return ret;
+}
+
+/* Releases everything handed out since the last reset in one step */
+static void requestArenaReset(RequestArena* arena)
+{
+    RequestArenaChunk* chunk;
+
+#ifdef MEMSET_FREED
+    memset(arena->base, 0, arena->baseUsed);
+#endif
+
+    while ((chunk = arena->p_chunks) != NULL) {
+        arena->p_chunks = chunk->p_next;
+#ifdef MEMSET_FREED
+        memset(chunk + 1, 0, chunk->size);
+#endif
+        free(chunk);
+    }
+
+    requestArenaInit(arena);
+}
+
+/* The returned string lives in the request arena, see requestArenaAlloc() */
+static char* strdupReadString(Parcel& p, RequestInfo* pRI)
 {
     size_t stringlen;
+    size_t len;
     const char16_t* s16;
+    char* ret;
 
     s16 = p.readString16Inplace(&stringlen);
+    if (s16 == NULL) {
+        return NULL;
+    }
+
+    len = strnlen16to8(s16, stringlen);
+    if (len >= SIZE_MAX - 1) {
+        return NULL;
+    }
 
-    return strndup16to8(s16, stringlen);
+    ret = (char*)requestArenaAlloc(pRI, len + 1);
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    return strncpy16to8(ret, s16, stringlen);
 }
 
 static void writeStringToParcel(Parcel& p, const char* s)
 {
+    char16_t buf[128];
     char16_t* s16;
     size_t s16_len;
+    ssize_t len;
+
+    // most response strings fit on the stack, no heap copy for those
+    if (s != NULL && (len = strcpy8to16_buf(buf, NUM_ELEMS(buf), s)) >= 0) {
+        p.writeString16(buf, len);
+        return;
+    }
+
     s16 = strdup8to16(s, &s16_len);
     p.writeString16(s16, s16_len);
     free(s16);
 }
 
-static void memsetString(char* s)
+/* must be called with s_responseCacheMutex held */
+static CachedResponse* findCachedResponse(int requestNumber)
+{
+    for (int i = 0; i < MAX_CACHED_RESPONSES; i++) {
+        if (s_responseCache[i].requestNumber == requestNumber) {
+            return &s_responseCache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Answers a CACHE_STATIC request from the cache.
+ *
+ * Returns 0 if the response was cached, -1 if the request has to go to
+ * the vendor RIL
+ */
+static int sendCachedResponse(RilClient* client, int32_t token, const CommandInfo* pCI)
+{
+    CachedResponse* cached;
+    Parcel p;
+
+    pthread_mutex_lock(&s_responseCacheMutex);
+
+    cached = findCachedResponse(pCI->requestNumber);
+    if (cached == NULL) {
+        pthread_mutex_unlock(&s_responseCacheMutex);
+        return -1;
+    }
+
+    p.writeInt32(RESPONSE_SOLICITED);
+    p.writeInt32(token);
+    p.write(cached->data, cached->size);
+
+    pthread_mutex_unlock(&s_responseCacheMutex);
+
+    RLOGD("[%04d]< %s (cached)", token, requestToString(pCI->requestNumber));
+
+    if (sendResponse(client, client->epoch, p) < 0) {
+        RLOGE("failed to send cached response");
+    }
+
+    return 0;
+}
+
+/* Keeps the encoded response of pRI, starting at offset in p */
+static void storeCachedResponse(RequestInfo* pRI, Parcel& p, size_t offset)
+{
+    CachedResponse* cached;
+    uint8_t* data;
+    size_t size = p.dataSize() - offset;
+
+    // the modem may be going away, don't keep what it said last
+    if (s_callbacks.onStateRequest() == RADIO_STATE_UNAVAILABLE) {
+        return;
+    }
+
+    data = (uint8_t*)malloc(size);
+    if (data == NULL) {
+        return;
+    }
+    memcpy(data, p.data() + offset, size);
+
+    pthread_mutex_lock(&s_responseCacheMutex);
+
+    cached = findCachedResponse(pRI->pCI->requestNumber);
+    if (cached == NULL) {
+        cached = findCachedResponse(0);
+    }
+
+    if (cached != NULL) {
+        free(cached->data);
+        cached->requestNumber = pRI->pCI->requestNumber;
+        cached->data = data;
+        cached->size = size;
+        data = NULL;
+    }
+
+    pthread_mutex_unlock(&s_responseCacheMutex);
+
+    free(data);
+}
+
+static void invalidateResponseCache(void)
+{
+    pthread_mutex_lock(&s_responseCacheMutex);
+
+    for (int i = 0; i < MAX_CACHED_RESPONSES; i++) {
+        free(s_responseCache[i].data);
+        s_responseCache[i].requestNumber = 0;
+        s_responseCache[i].data = NULL;
+        s_responseCache[i].size = 0;
+    }
+
+    pthread_mutex_unlock(&s_responseCacheMutex);
+}
+
+/* must be called with the lock protecting stats held */
+static void poolStatsAlloc(PoolStats* stats, bool hit)
+{
+    if (hit) {
+        stats->hits++;
+    } else {
+        stats->misses++;
+    }
+
+    if (++stats->inUse > stats->peak) {
+        stats->peak = stats->inUse;
+    }
+}
+
+#if RIL_DISPATCH_WORKERS > 0
+static void* allocRequestPayload(size_t size)
+{
+    RequestPayload* payload = NULL;
+
+    pthread_mutex_lock(&s_requestPayloadMutex);
+    if (size <= REQUEST_PAYLOAD_SIZE) {
+        if (s_freeRequestPayloads != NULL) {
+            payload = s_freeRequestPayloads;
+            s_freeRequestPayloads = payload->p_next;
+        } else if (s_usedRequestPayloads < MAX_REQUEST_PAYLOADS) {
+            payload = &s_requestPayloads[s_usedRequestPayloads++];
+        }
+    }
+
+    if (payload != NULL) {
+        poolStatsAlloc(&s_requestPayloadPoolStats, true);
+        pthread_mutex_unlock(&s_requestPayloadMutex);
+        return payload;
+    }
+
+    pthread_mutex_unlock(&s_requestPayloadMutex);
+
+    payload = (RequestPayload*)malloc(size > 0 ? size : 1);
+    if (payload != NULL) {
+        pthread_mutex_lock(&s_requestPayloadMutex);
+        poolStatsAlloc(&s_requestPayloadPoolStats, false);
+        pthread_mutex_unlock(&s_requestPayloadMutex);
+    }
+
+    return payload;
+}
+
+static void freeRequestPayload(void* data)
 {
-    if (s != NULL) {
-        memset(s, 0, strlen(s));
+    RequestPayload* payload = (RequestPayload*)data;
+
+    if (payload == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_requestPayloadMutex);
+    s_requestPayloadPoolStats.inUse--;
+    if (payload >= s_requestPayloads && payload < s_requestPayloads + MAX_REQUEST_PAYLOADS) {
+        payload->p_next = s_freeRequestPayloads;
+        s_freeRequestPayloads = payload;
+        payload = NULL;
     }
+    pthread_mutex_unlock(&s_requestPayloadMutex);
+
+    free(payload);
 }
+#endif
 
-static int processCommandBuffer(void* buffer, size_t buflen)
+static int processCommandBuffer(RilClient* client, void* buffer, size_t buflen)
 {
     Parcel p;
     status_t status;
     int32_t request;
     int32_t token;
+    int32_t timeoutMs = -1;
+    size_t dataOffset;
+    const CommandInfo* pCI;
     RequestInfo* pRI;
+    uint32_t traceId;
+    RIL_Token t;
     int ret = 0;
 
     (void)ret;
@@ -346,19 +1141,22 @@ static int processCommandBuffer(void* buffer, size_t buflen)
     status = p.readInt32(&request);
     status = p.readInt32(&token);
 
+    if (status == NO_ERROR && request == RIL_REQUEST_WITH_DEADLINE) {
+        // the wrapped request follows its deadline
+        status = p.readInt32(&timeoutMs);
+        status = p.readInt32(&request);
+    }
+
     if (status != NO_ERROR) {
         RLOGE("invalid request block");
         return 0;
     }
 
-    if (request < 1
-        || (request >= (int32_t)NUM_ELEMS(s_commands)
-            && request <= RIL_SECOND_REQUEST_BASE)
-        || (request >= RIL_SECOND_REQUEST_BASE + (int32_t)NUM_ELEMS(s_second_commands)
-            && request <= RIL_IMS_REQUEST_BASE)
-        || (request >= RIL_IMS_REQUEST_BASE + (int32_t)NUM_ELEMS(s_ims_commands)
-            && request <= RIL_CUS_REQUEST_BASE)
-        || request >= RIL_CUS_REQUEST_BASE + (int32_t)NUM_ELEMS(s_cus_commands)) {
+    dataOffset = p.dataPosition();
+    ril_trace(RIL_TRACE_REQUEST, token, request, 0, buflen - dataOffset);
+
+    pCI = findCommandInfo(request);
+    if (pCI == NULL) {
         Parcel pErr;
         RLOGE("unsupported request code %ld token %ld", request, token);
         // FIXME this should perhaps return a response
@@ -371,1178 +1169,2781 @@ static int processCommandBuffer(void* buffer, size_t buflen)
             return 0;
         }
 
-        if (sendResponse(pErr) < 0) {
+        if (sendResponse(client, client->epoch, pErr) < 0) {
             RLOGE("failed to send error response parcel");
         }
 
         return 0;
     }
 
-    pRI = (RequestInfo*)calloc(1, sizeof(RequestInfo));
-    if (pRI == NULL) {
-        RLOGE("Memory allocation failed for request %s", requestToString(request));
+    // answered without a modem round trip
+    if (pCI->caching == CACHE_STATIC && sendCachedResponse(client, token, pCI) == 0) {
         return 0;
     }
 
-    pRI->token = token;
-    if (request > 0 && request < (int32_t)NUM_ELEMS(s_commands)) {
-        pRI->pCI = &(s_commands[request]);
-    } else if (request > RIL_SECOND_REQUEST_BASE
-        && request < RIL_SECOND_REQUEST_BASE + (int32_t)NUM_ELEMS(s_second_commands)) {
-        request = request - RIL_SECOND_REQUEST_BASE;
-        pRI->pCI = &(s_second_commands[request]);
-    } else if (request > RIL_IMS_REQUEST_BASE
-        && request < RIL_IMS_REQUEST_BASE + (int32_t)NUM_ELEMS(s_ims_commands)) {
-        request = request - RIL_IMS_REQUEST_BASE;
-        pRI->pCI = &(s_ims_commands[request]);
-    } else if (request > RIL_CUS_REQUEST_BASE
-        && request < RIL_CUS_REQUEST_BASE + (int32_t)NUM_ELEMS(s_cus_commands)) {
-        request = request - RIL_CUS_REQUEST_BASE;
-        pRI->pCI = &(s_cus_commands[request]);
+    pRI = allocRequestInfo(client, token);
+    if (pRI == NULL) {
+        RLOGE("No pending request slot for request %s", requestToString(pCI->requestNumber));
+        return 0;
     }
 
-    ret = pthread_mutex_lock(&s_pendingRequestsMutex);
-    assert(ret == 0);
+    pRI->pCI = pCI;
+    traceRequestReceived(pRI);
 
-    pRI->p_next = s_pendingRequests;
-    s_pendingRequests = pRI;
+    // before attaching, so attached requests keep their own deadline
+    setRequestDeadline(pRI, timeoutMs >= 0 ? timeoutMs : pCI->deadline * 1000);
 
-    ret = pthread_mutex_unlock(&s_pendingRequestsMutex);
-    assert(ret == 0);
+    if (pCI->caching != CACHE_NONE && attachToInFlightRequest(pRI)) {
+        RLOGD("[%04d]> %s attached to a request in flight", token,
+            requestToString(pCI->requestNumber));
+        return 0;
+    }
 
     /* sLastDispatchedToken = token; */
     if (NULL == pRI->pCI->dispatchFunction) {
-        RIL_onRequestComplete(pRI, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
         return 0;
     }
-    pRI->pCI->dispatchFunction(p, pRI);
-
-    return 0;
-}
 
-static void invalidCommandBlock(RequestInfo* pRI)
-{
-    RLOGE("invalid command block for token %ld request %s",
-        pRI->token, requestToString(pRI->pCI->requestNumber));
+#if RIL_DISPATCH_WORKERS > 0
+    // a cancel must not queue up behind the request it cancels, the
+    // shared ring setup adds events to the loop
+    if (s_dispatchWorkersStarted > 0 && pCI->requestNumber != RIL_REQUEST_CANCEL_REQUEST
+        && pCI->requestNumber != RIL_REQUEST_SETUP_SHARED_RING) {
+        /* the record buffer is reused by the next read, keep a copy
+         * of the request data */
+        pRI->buflen = buflen - dataOffset;
+        pRI->buffer = allocRequestPayload(pRI->buflen);
+        if (pRI->buffer == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            RIL_onRequestComplete(requestToken(pRI), RIL_E_NO_MEMORY, NULL, 0);
+            return 0;
+        }
+
+        memcpy(pRI->buffer, (uint8_t*)buffer + dataOffset, pRI->buflen);
+        enqueueRequest(pRI);
+        return 0;
+    }
+#endif
+
+    setRequestDispatched(pRI);
+    pRI->arena = &s_loopArena;
+    t = requestToken(pRI);
+    traceId = traceRequestDispatch(pRI);
+    pRI->pCI->dispatchFunction(p, pRI);
+    traceRequestReturn(t, traceId);
+    requestArenaReset(&s_loopArena);
+
+    return 0;
 }
 
-/* Callee expects NULL */
-static void dispatchVoid(Parcel& p, RequestInfo* pRI)
+/* must be called with s_pendingRequestsMutex held */
+static void setRequestState(RequestInfo* pRI, RequestState state)
 {
-    clearPrintBuf;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
-    s_callbacks.onRequest(pRI->pCI->requestNumber, NULL, 0, pRI);
+    s_requestStateCounts[pRI->state]--;
+    s_requestStateCounts[state]++;
+    pRI->state = state;
 }
 
-/* Callee expects const char * */
-static void dispatchString(Parcel& p, RequestInfo* pRI)
+/* must be called with s_pendingRequestsMutex held */
+static int growPendingRequests(void)
 {
-    char* string8 = NULL;
+    RequestInfo* chunk;
 
-    string8 = strdupReadString(p);
-    if (!string8) {
-        invalidCommandBlock(pRI);
-        return;
+    if (s_pendingRequestSlots >= MAX_PENDING_REQUESTS) {
+        return -1;
+    }
+
+    chunk = (RequestInfo*)calloc(PENDING_REQUESTS_CHUNK, sizeof(RequestInfo));
+    if (chunk == NULL) {
+        return -1;
     }
 
-    startRequest;
-    appendPrintBuf("%s%s", printBuf, string8);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    s_pendingRequestChunks[s_pendingRequestSlots / PENDING_REQUESTS_CHUNK] = chunk;
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, string8,
-        sizeof(char*), pRI);
+    // chunks are never freed, so stale tokens always point to readable slots
+    for (int i = PENDING_REQUESTS_CHUNK - 1; i >= 0; i--) {
+        chunk[i].slot = s_pendingRequestSlots + i;
+        chunk[i].state = REQUEST_FREE;
+        chunk[i].p_next = s_freeRequests;
+        s_freeRequests = &chunk[i];
+    }
 
-#ifdef MEMSET_FREED
-    memsetString(string8);
-#endif
+    s_pendingRequestSlots += PENDING_REQUESTS_CHUNK;
+    s_requestStateCounts[REQUEST_FREE] += PENDING_REQUESTS_CHUNK;
 
-    free(string8);
-    return;
+    return 0;
 }
 
-/* Callee expects const char ** */
-static void dispatchStrings(Parcel& p, RequestInfo* pRI)
+/* must be called with s_pendingRequestsMutex held */
+static RequestInfo* allocOverflowRequest(void)
 {
-    int32_t countStrings;
-    status_t status;
-    size_t datalen;
-    char** pStrings;
-
-    status = p.readInt32(&countStrings);
+    OverflowRequest* entry;
+    RequestInfo* pRI;
+    int index;
 
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (s_freeOverflowRequest >= 0) {
+        index = s_freeOverflowRequest;
+    } else if (s_usedOverflowRequests < MAX_OVERFLOW_REQUESTS) {
+        index = s_usedOverflowRequests;
+    } else {
+        return NULL;
     }
 
-    startRequest;
-    if (countStrings == 0) {
-        // just some non-null pointer
-        pStrings = (char**)calloc(1, sizeof(char*));
-        if (pStrings == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            closeRequest;
-            return;
-        }
+    pRI = (RequestInfo*)calloc(1, sizeof(RequestInfo));
+    if (pRI == NULL) {
+        return NULL;
+    }
 
-        datalen = 0;
-    } else if (countStrings < 0) {
-        pStrings = NULL;
-        datalen = 0;
+    entry = &s_overflowRequests[index];
+    if (index == s_usedOverflowRequests) {
+        s_usedOverflowRequests++;
     } else {
-        datalen = sizeof(char*) * countStrings;
+        s_freeOverflowRequest = entry->nextFree;
+    }
 
-        pStrings = (char**)calloc(countStrings, sizeof(char*));
-        if (pStrings == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            closeRequest;
-            return;
-        }
+    entry->pRI = pRI;
+    pRI->slot = MAX_PENDING_REQUESTS + index;
+    pRI->generation = entry->generation;
 
-        for (int i = 0; i < countStrings; i++) {
-            pStrings[i] = strdupReadString(p);
-            appendPrintBuf("%s%s,", printBuf, pStrings[i]);
-        }
-    }
-    removeLastChar;
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    return pRI;
+}
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, pStrings, datalen, pRI);
+/* Returns the head of the client->requests list pRI belongs in */
+static RequestInfo** clientRequestBucket(RequestInfo* pRI)
+{
+    return &pRI->client->requests[(uint32_t)pRI->token & (CLIENT_REQUEST_BUCKETS - 1)];
+}
 
-    if (pStrings != NULL) {
-        for (int i = 0; i < countStrings; i++) {
-#ifdef MEMSET_FREED
-            memsetString(pStrings[i]);
-#endif
-            free(pStrings[i]);
-        }
+/* must be called with s_pendingRequestsMutex held */
+static void linkClientRequest(RequestInfo* pRI)
+{
+    RequestInfo** pp_bucket = clientRequestBucket(pRI);
 
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, datalen);
-#endif
-        free(pStrings);
-    }
+    pRI->p_nextOfClient = *pp_bucket;
+    *pp_bucket = pRI;
+}
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+/* must be called with s_pendingRequestsMutex held */
+static void unlinkClientRequest(RequestInfo* pRI)
+{
+    for (RequestInfo** pp_cur = clientRequestBucket(pRI); *pp_cur != NULL;
+         pp_cur = &(*pp_cur)->p_nextOfClient) {
+        if (*pp_cur == pRI) {
+            *pp_cur = pRI->p_nextOfClient;
+            return;
+        }
+    }
 }
 
-/* Callee expects const int * */
-static void dispatchInts(Parcel& p, RequestInfo* pRI)
+static RequestInfo* allocRequestInfo(RilClient* client, int32_t token)
 {
-    int32_t count;
-    status_t status;
-    size_t datalen;
-    int* pInts;
+    RequestInfo* pRI = NULL;
+    uint16_t generation;
+    int slot;
 
-    status = p.readInt32(&count);
+    pthread_mutex_lock(&s_pendingRequestsMutex);
 
-    if (status != NO_ERROR || count <= 0) {
-        goto invalid;
+    if (s_freeRequests != NULL || growPendingRequests() == 0) {
+        pRI = s_freeRequests;
+        s_freeRequests = pRI->p_next;
+
+        slot = pRI->slot;
+        generation = pRI->generation;
+        memset(pRI, 0, sizeof(RequestInfo));
+        pRI->slot = slot;
+        pRI->generation = generation;
+        poolStatsAlloc(&s_requestPoolStats, true);
+    } else {
+        pRI = allocOverflowRequest();
+        if (pRI != NULL) {
+            s_requestStateCounts[REQUEST_FREE]++;
+            poolStatsAlloc(&s_requestPoolStats, false);
+        }
     }
 
-    datalen = sizeof(int) * count;
-    pInts = (int*)calloc(count, sizeof(int));
-    if (pInts == NULL) {
-        RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
-        return;
+    if (pRI != NULL) {
+        pRI->state = REQUEST_FREE;
+        pRI->client = client;
+        pRI->epoch = client->epoch;
+        pRI->token = token;
+        pRI->deadlineIndex = -1;
+        linkClientRequest(pRI);
+        setRequestState(pRI, REQUEST_QUEUED);
     }
 
-    startRequest;
-    for (int i = 0; i < count; i++) {
-        int32_t t;
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
 
-        status = p.readInt32(&t);
-        pInts[i] = (int)t;
-        appendPrintBuf("%s%d,", printBuf, t);
+    return pRI;
+}
 
-        if (status != NO_ERROR) {
-            free(pInts);
-            goto invalid;
-        }
+static void freeRequestInfo(RequestInfo* pRI)
+{
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+
+    setRequestState(pRI, REQUEST_FREE);
+    s_requestPoolStats.inUse--;
+    pRI->generation++;
+    unlinkClientRequest(pRI);
+    removeRequestDeadline(pRI);
+
+    if (pRI->slot >= MAX_PENDING_REQUESTS) {
+        int index = pRI->slot - MAX_PENDING_REQUESTS;
+        OverflowRequest* entry = &s_overflowRequests[index];
+
+        entry->pRI = NULL;
+        entry->generation = pRI->generation;
+        entry->nextFree = s_freeOverflowRequest;
+        s_freeOverflowRequest = index;
+        s_requestStateCounts[REQUEST_FREE]--;
+        pthread_mutex_unlock(&s_pendingRequestsMutex);
+        free(pRI);
+        return;
     }
-    removeLastChar;
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, const_cast<int*>(pInts),
-        datalen, pRI);
+    pRI->p_next = s_freeRequests;
+    s_freeRequests = pRI;
 
-#ifdef MEMSET_FREED
-    memset(pInts, 0, datalen);
-#endif
-    free(pInts);
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+}
+
+/* What the vendor RIL gets as RIL_Token, see findRequest */
+static RIL_Token requestToken(RequestInfo* pRI)
+{
+    return (RIL_Token)(((uintptr_t)pRI->generation << 16) | (uintptr_t)(pRI->slot + 1));
 }
 
 /**
- * Callee expects const RIL_SMS_WriteArgs *
- * Payload is:
- *   int32_t status
- *   String pdu
+ * Returns the request t was handed out for, or NULL once it is freed.
+ * A token is only decoded, so stale or bogus ones are safe to pass.
+ * must be called with s_pendingRequestsMutex held
  */
-static void dispatchSmsWrite(Parcel& p, RequestInfo* pRI)
+static RequestInfo* findRequest(RIL_Token t)
 {
-    RIL_SMS_WriteArgs args;
-    int32_t t;
-    status_t status;
-
-    RLOGD("dispatchSmsWrite");
-    memset(&args, 0, sizeof(args));
-
-    status = p.readInt32(&t);
-    args.status = (int)t;
-
-    args.pdu = strdupReadString(p);
+    uintptr_t token = (uintptr_t)t;
+    int slot = (int)(token & 0xffff) - 1;
+    RequestInfo* pRI;
 
-    if (status != NO_ERROR || args.pdu == NULL) {
-        goto invalid;
+    if (slot >= 0 && slot < s_pendingRequestSlots) {
+        pRI = &s_pendingRequestChunks[slot / PENDING_REQUESTS_CHUNK]
+                                     [slot % PENDING_REQUESTS_CHUNK];
+    } else if (slot >= MAX_PENDING_REQUESTS
+        && slot < MAX_PENDING_REQUESTS + s_usedOverflowRequests) {
+        pRI = s_overflowRequests[slot - MAX_PENDING_REQUESTS].pRI;
+    } else {
+        return NULL;
     }
 
-    args.smsc = strdupReadString(p);
+    if (pRI == NULL || pRI->state == REQUEST_FREE || token >> 16 != pRI->generation) {
+        return NULL;
+    }
 
-    startRequest;
-    appendPrintBuf("%s%d,%s,smsc=%s", printBuf, args.status,
-        (char*)args.pdu, (char*)args.smsc);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    return pRI;
+}
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &args, sizeof(args), pRI);
+static void setRequestDispatched(RequestInfo* pRI)
+{
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    setRequestState(pRI, REQUEST_DISPATCHED);
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+}
 
-#ifdef MEMSET_FREED
-    memsetString(args.pdu);
-#endif
+#if RIL_LATENCY_TRACE_SIZE > 0
+static void traceRequestReceived(RequestInfo* pRI)
+{
+    pRI->traceId = __atomic_add_fetch(&s_nextTraceId, 1, __ATOMIC_RELAXED);
+    pRI->enqueueNs = ril_nano_time();
+}
 
-    free(args.pdu);
+/* Returns what traceRequestReturn needs to find pRI again */
+static uint32_t traceRequestDispatch(RequestInfo* pRI)
+{
+    pRI->dispatchNs = ril_nano_time();
+    return pRI->traceId;
+}
 
-#ifdef MEMSET_FREED
-    memset(&args, 0, sizeof(args));
-#endif
+/* t may have been completed, or even reused, by the time onRequest returns */
+static void traceRequestReturn(RIL_Token t, uint32_t traceId)
+{
+    uint64_t now = ril_nano_time();
+    RequestInfo* pRI;
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    pRI = findRequest(t);
+    if (pRI != NULL && pRI->traceId == traceId
+        && (pRI->state == REQUEST_DISPATCHED || pRI->state == REQUEST_EXPIRED)) {
+        pRI->returnNs = now;
+    }
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
 }
 
 /**
- * Callee expects const RIL_Dial *
- * Payload is:
- *   String address
- *   int32_t clir
+ * Adds pRI to the latency ring. Any thread may complete a request, so
+ * each record is guarded by its own sequence number instead of a lock:
+ * readers skip records whose sequence is odd or changes under them.
  */
-static void dispatchDial(Parcel& p, RequestInfo* pRI)
+static void traceRequestComplete(RequestInfo* pRI, RIL_Errno e)
 {
-    RIL_Dial dial;
-    RIL_UUS_Info uusInfo;
-    int32_t sizeOfDial;
-    int32_t t;
-    int32_t uusPresent;
-    status_t status;
+    LatencyRecord* r;
+    uint32_t n;
+    uint64_t returnNs;
 
-    RLOGD("dispatchDial");
-    memset(&dial, 0, sizeof(dial));
+    if (pRI->dispatchNs == 0) {
+        return;
+    }
 
-    dial.address = strdupReadString(p);
+    // written under the lock by traceRequestReturn
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    returnNs = pRI->returnNs;
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
 
-    status = p.readInt32(&t);
-    dial.clir = (int)t;
+    n = __atomic_fetch_add(&s_latencyHead, 1, __ATOMIC_RELAXED);
+    r = &s_latencyRing[n % RIL_LATENCY_TRACE_SIZE];
 
-    if (status != NO_ERROR || dial.address == NULL) {
-        goto invalid;
-    }
+    __atomic_store_n(&r->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
 
-    if (s_callbacks.version < 3) { // Remove when partners upgrade to version 3
-        uusPresent = 0;
-        sizeOfDial = sizeof(dial) - sizeof(RIL_UUS_Info*);
-    } else {
-        status = p.readInt32(&uusPresent);
+    r->requestNumber = pRI->pCI->requestNumber;
+    r->token = pRI->token;
+    r->error = e;
+    r->enqueueNs = pRI->enqueueNs;
+    r->dispatchNs = pRI->dispatchNs;
+    r->returnNs = returnNs;
+    r->completeNs = ril_nano_time();
 
-        if (status != NO_ERROR) {
-            goto invalid;
-        }
+    __atomic_store_n(&r->seq, 2 * n + 2, __ATOMIC_RELEASE);
+}
+#endif
 
-        if (uusPresent == 0) {
-            dial.uusInfo = NULL;
-        } else {
-            int32_t len;
+/**
+ * Attaches pRI to an identical request that was not dispatched yet, so
+ * one vendor call answers both. Otherwise pRI becomes the request later
+ * ones attach to.
+ *
+ * Returns true if pRI was attached and must not be dispatched
+ */
+static bool attachToInFlightRequest(RequestInfo* pRI)
+{
+    int freeSlot = -1;
+    bool attached = false;
 
-            memset(&uusInfo, 0, sizeof(RIL_UUS_Info));
+    pthread_mutex_lock(&s_pendingRequestsMutex);
 
-            status = p.readInt32(&t);
-            uusInfo.uusType = (RIL_UUS_Type)t;
+    // already expired, the dispatch worker drops it
+    if (pRI->cancelled) {
+        pthread_mutex_unlock(&s_pendingRequestsMutex);
+        return false;
+    }
 
-            status = p.readInt32(&t);
-            uusInfo.uusDcs = (RIL_UUS_DCS)t;
+    for (int i = 0; i < MAX_SHARED_REQUESTS; i++) {
+        RequestInfo* leader = s_inFlightRequests[i];
 
-            status = p.readInt32(&len);
-            if (status != NO_ERROR) {
-                goto invalid;
+        if (leader == NULL) {
+            if (freeSlot < 0) {
+                freeSlot = i;
             }
+            continue;
+        }
 
-            // The java code writes -1 for null arrays
-            if (((int)len) == -1) {
-                uusInfo.uusData = NULL;
-                len = 0;
-            } else {
-                uusInfo.uusData = (char*)p.readInplace(len);
-            }
+        if (leader->pCI != pRI->pCI) {
+            continue;
+        }
 
-            uusInfo.uusLength = len;
-            dial.uusInfo = &uusInfo;
+        // once dispatched, the answer may predate what pRI asks about
+        if (leader->state == REQUEST_QUEUED && !leader->cancelled) {
+            pRI->p_nextFollower = leader->p_followers;
+            pRI->p_leader = leader;
+            leader->p_followers = pRI;
+            setRequestState(pRI, REQUEST_ATTACHED);
+            attached = true;
+        } else {
+            s_inFlightRequests[i] = pRI;
         }
-        sizeOfDial = sizeof(dial);
+        freeSlot = -1;
+        break;
     }
 
-    startRequest;
-    appendPrintBuf("%snum=%s,clir=%d", printBuf, dial.address, dial.clir);
-    if (uusPresent) {
-        appendPrintBuf("%s,uusType=%d,uusDcs=%d,uusLen=%d", printBuf,
-            dial.uusInfo->uusType, dial.uusInfo->uusDcs,
-            dial.uusInfo->uusLength);
+    if (freeSlot >= 0) {
+        s_inFlightRequests[freeSlot] = pRI;
     }
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &dial, sizeOfDial, pRI);
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
 
-#ifdef MEMSET_FREED
-    memsetString(dial.address);
-#endif
+    return attached;
+}
 
-    free(dial.address);
+/* must be called with s_pendingRequestsMutex held */
+static void clearInFlightRequest(RequestInfo* pRI)
+{
+    if (pRI->pCI == NULL || pRI->pCI->caching == CACHE_NONE) {
+        return;
+    }
 
-#ifdef MEMSET_FREED
-    memset(&uusInfo, 0, sizeof(RIL_UUS_Info));
-    memset(&dial, 0, sizeof(dial));
-#endif
+    for (int i = 0; i < MAX_SHARED_REQUESTS; i++) {
+        if (s_inFlightRequests[i] == pRI) {
+            s_inFlightRequests[i] = NULL;
+            break;
+        }
+    }
+}
 
-    return;
-invalid:
+static void deadlineHeapSet(int index, RequestInfo* pRI)
+{
+    s_deadlineHeap[index] = pRI;
+    pRI->deadlineIndex = index;
+}
+
+static void deadlineHeapSiftUp(int index)
+{
+    RequestInfo* pRI = s_deadlineHeap[index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+
+        if (pRI->deadline >= s_deadlineHeap[parent]->deadline) {
+            break;
+        }
+        deadlineHeapSet(index, s_deadlineHeap[parent]);
+        index = parent;
+    }
+    deadlineHeapSet(index, pRI);
+}
+
+static void deadlineHeapSiftDown(int index)
+{
+    RequestInfo* pRI = s_deadlineHeap[index];
+
+    for (;;) {
+        int child = 2 * index + 1;
+
+        if (child >= s_deadlineCount) {
+            break;
+        }
+        if (child + 1 < s_deadlineCount
+            && s_deadlineHeap[child + 1]->deadline < s_deadlineHeap[child]->deadline) {
+            child++;
+        }
+        if (s_deadlineHeap[child]->deadline >= pRI->deadline) {
+            break;
+        }
+        deadlineHeapSet(index, s_deadlineHeap[child]);
+        index = child;
+    }
+    deadlineHeapSet(index, pRI);
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static int addRequestDeadline(RequestInfo* pRI)
+{
+    if (s_deadlineCount == s_deadlineCapacity) {
+        int capacity = s_deadlineCapacity ? s_deadlineCapacity * 2 : PENDING_REQUESTS_CHUNK;
+        RequestInfo** heap;
+
+        heap = (RequestInfo**)realloc(s_deadlineHeap, capacity * sizeof(*heap));
+        if (heap == NULL) {
+            return -1;
+        }
+        s_deadlineHeap = heap;
+        s_deadlineCapacity = capacity;
+    }
+
+    deadlineHeapSet(s_deadlineCount++, pRI);
+    deadlineHeapSiftUp(pRI->deadlineIndex);
+    return 0;
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static void removeRequestDeadline(RequestInfo* pRI)
+{
+    int index = pRI->deadlineIndex;
+    RequestInfo* last;
+
+    if (index < 0) {
+        return;
+    }
+
+    last = s_deadlineHeap[--s_deadlineCount];
+    pRI->deadlineIndex = -1;
+    if (last == pRI) {
+        return;
+    }
+
+    deadlineHeapSet(index, last);
+    if (index > 0 && last->deadline < s_deadlineHeap[(index - 1) / 2]->deadline) {
+        deadlineHeapSiftUp(index);
+    } else {
+        deadlineHeapSiftDown(index);
+    }
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static void scheduleDeadlineCheck(int64_t deadline)
+{
+    int64_t now = monotonicMs();
+    struct timeval delay;
+
+    if (s_nextDeadline != 0 && s_nextDeadline <= deadline) {
+        return;
+    }
+
+    delay.tv_sec = deadline > now ? (deadline - now) / 1000 : 0;
+    delay.tv_usec = deadline > now ? ((deadline - now) % 1000) * 1000 : 0;
+
+    // a timer of its own, so it never runs out of timed callback slots;
+    // re-arming reschedules it, if it already fired it finds nothing due
+    if (ril_timer_add(&s_deadline_event, &delay) < 0) {
+        RLOGE("Failed to schedule the request deadline check");
+        s_nextDeadline = 0;
+        return;
+    }
+    s_nextDeadline = deadline;
+
+    triggerEvLoop();
+}
+
+/* Fails pRI if it is still pending after timeoutMs, 0 for never */
+static void setRequestDeadline(RequestInfo* pRI, int timeoutMs)
+{
+    if (timeoutMs <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    pRI->deadline = monotonicMs() + timeoutMs;
+    if (addRequestDeadline(pRI) < 0) {
+        RLOGE("No memory to track the deadline of %s", requestToString(pRI->pCI->requestNumber));
+        pRI->deadline = 0;
+    } else {
+        scheduleDeadlineCheck(pRI->deadline);
+    }
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static bool isAbortableRequest(RequestInfo* pRI)
+{
+    return pRI->state == REQUEST_DISPATCHED
+        || (pRI->state == REQUEST_QUEUED && !pRI->cancelled);
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static bool isCancellableLeader(RequestInfo* pRI)
+{
+    // the followers of a completing request belong to RIL_onRequestComplete
+    return !pRI->expiring && (pRI->state == REQUEST_QUEUED || pRI->state == REQUEST_DISPATCHED);
+}
+
+/**
+ * Takes pRI out of the pending requests, its response is failed by the
+ * caller.
+ * must be called with s_pendingRequestsMutex held
+ */
+static void abortRequest(RequestInfo* pRI)
+{
+    clearInFlightRequest(pRI);
+    if (pRI->state == REQUEST_DISPATCHED) {
+        // the vendor RIL still holds the token, keep the slot until
+        // it completes it
+        setRequestState(pRI, REQUEST_EXPIRED);
+    } else {
+        // dropped by the dispatch worker
+        pRI->cancelled = 1;
+    }
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static void addExpiredRequest(RequestInfo** pp_list, RequestInfo* pRI)
+{
+    pRI->expiring = 1;
+    pRI->p_nextExpired = *pp_list;
+    *pp_list = pRI;
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static void detachFollower(RequestInfo* leader, RequestInfo* pFollower)
+{
+    RequestInfo** pp_cur = &leader->p_followers;
+
+    while (*pp_cur != pFollower) {
+        pp_cur = &(*pp_cur)->p_nextFollower;
+    }
+    *pp_cur = pFollower->p_nextFollower;
+}
+
+/**
+ * Hands the vendor call of pRI over to its first attached request, which
+ * swaps client, epoch, token and deadline with pRI.
+ * must be called with s_pendingRequestsMutex held
+ *
+ * Returns the detached twin, carrying what pRI was sent with
+ */
+static RequestInfo* promoteFollower(RequestInfo* pRI)
+{
+    RequestInfo* pFollower = pRI->p_followers;
+    RilClient* client = pRI->client;
+    uint32_t epoch = pRI->epoch;
+    int32_t token = pRI->token;
+    int64_t deadline = pRI->deadline;
+    int leaderIndex = pRI->deadlineIndex;
+    int followerIndex = pFollower->deadlineIndex;
+
+    unlinkClientRequest(pRI);
+    unlinkClientRequest(pFollower);
+
+    pRI->p_followers = pFollower->p_nextFollower;
+    pRI->client = pFollower->client;
+    pRI->epoch = pFollower->epoch;
+    pRI->token = pFollower->token;
+    pRI->deadline = pFollower->deadline;
+    pFollower->client = client;
+    pFollower->epoch = epoch;
+    pFollower->token = token;
+    pFollower->deadline = deadline;
+    pFollower->p_leader = NULL;
+
+    linkClientRequest(pRI);
+    linkClientRequest(pFollower);
+
+    // the heap entries follow the deadlines, its order stays the same
+    pRI->deadlineIndex = -1;
+    pFollower->deadlineIndex = -1;
+    if (followerIndex >= 0) {
+        deadlineHeapSet(followerIndex, pRI);
+    }
+    if (leaderIndex >= 0) {
+        deadlineHeapSet(leaderIndex, pFollower);
+    }
+
+    return pFollower;
+}
+
+/**
+ * Takes pRI, whose deadline has passed, off the deadline heap and out of
+ * the pending requests. An expired request with followers hands its vendor
+ * call over to the first of them, an attached one leaves its leader.
+ * must be called with s_pendingRequestsMutex held
+ */
+static void expireRequest(RequestInfo* pRI, RequestInfo** pp_dispatched,
+    RequestInfo** pp_dropped)
+{
+    if (pRI->state == REQUEST_ATTACHED) {
+        removeRequestDeadline(pRI);
+        if (isCancellableLeader(pRI->p_leader)) {
+            detachFollower(pRI->p_leader, pRI);
+            setRequestState(pRI, REQUEST_COMPLETING);
+            addExpiredRequest(pp_dropped, pRI);
+        }
+        return;
+    }
+
+    if (!isAbortableRequest(pRI)) {
+        removeRequestDeadline(pRI);
+        return;
+    }
+
+    if (pRI->p_followers != NULL) {
+        // the twin takes the expired deadline, pRI the one of the follower
+        RequestInfo* pTwin = promoteFollower(pRI);
+
+        removeRequestDeadline(pTwin);
+        setRequestState(pTwin, REQUEST_COMPLETING);
+        addExpiredRequest(pp_dropped, pTwin);
+        return;
+    }
+
+    removeRequestDeadline(pRI);
+    abortRequest(pRI);
+    addExpiredRequest(pRI->state == REQUEST_EXPIRED ? pp_dispatched : pp_dropped, pRI);
+}
+
+static void sendErrorResponse(RequestInfo* pRI, RIL_Errno e)
+{
+    Parcel p;
+
+    p.writeInt32(RESPONSE_SOLICITED);
+    p.writeInt32(pRI->token);
+    p.writeInt32(e);
+
+    if (sendResponse(pRI->client, pRI->epoch, p) < 0) {
+        RLOGE("failed to send error response for %s",
+            requestToString(pRI->pCI->requestNumber));
+    }
+}
+
+/* Fails each request of list with RIL_E_CANCELLED */
+static void failExpiredRequests(RequestInfo* list, bool cancelVendor, const char* reason)
+{
+    for (RequestInfo* pRI = list; pRI != NULL; pRI = pRI->p_nextExpired) {
+        RLOGW("[%04d]< %s %s", pRI->token,
+            requestToString(pRI->pCI->requestNumber), reason);
+
+        sendErrorResponse(pRI, RIL_E_CANCELLED);
+
+        if (cancelVendor && s_callbacks.onCancel != NULL) {
+            s_callbacks.onCancel(requestToken(pRI));
+        }
+    }
+}
+
+/* Frees the requests of list that were completed while being failed */
+static void releaseExpiredRequests(RequestInfo* list)
+{
+    while (list != NULL) {
+        RequestInfo* pRI = list;
+        bool completed;
+
+        list = pRI->p_nextExpired;
+
+        pthread_mutex_lock(&s_pendingRequestsMutex);
+        pRI->expiring = 0;
+        completed = (pRI->state == REQUEST_COMPLETING);
+        pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+        if (completed) {
+            freeRequestInfo(pRI);
+        }
+    }
+}
+
+/* Runs on the event loop once the earliest request deadline passed */
+static void checkRequestDeadlines(int fd, short flags, void* param)
+{
+    RequestInfo* p_dispatched = NULL; // the vendor RIL has to cancel these
+    RequestInfo* p_dropped = NULL;
+    int64_t now = monotonicMs();
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+
+    s_nextDeadline = 0;
+
+    // each pass takes the root off the heap
+    while (s_deadlineCount > 0 && s_deadlineHeap[0]->deadline <= now) {
+        expireRequest(s_deadlineHeap[0], &p_dispatched, &p_dropped);
+    }
+
+    if (s_deadlineCount > 0) {
+        scheduleDeadlineCheck(s_deadlineHeap[0]->deadline);
+    }
+
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+    // expiring keeps all of these from being freed under our feet
+    failExpiredRequests(p_dispatched, true, "deadline expired");
+    failExpiredRequests(p_dropped, false, "deadline expired");
+
+    releaseExpiredRequests(p_dispatched);
+    releaseExpiredRequests(p_dropped);
+}
+
+#if RIL_DISPATCH_WORKERS > 0
+static void enqueueRequest(RequestInfo* pRI)
+{
+    DispatchQueue* q = &s_dispatchQueues[pRI->pCI->queue];
+
+    pthread_mutex_lock(&s_dispatchMutex);
+
+    pRI->p_nextQueued = NULL;
+    if (q->p_tail == NULL) {
+        q->p_head = pRI;
+    } else {
+        q->p_tail->p_nextQueued = pRI;
+    }
+    q->p_tail = pRI;
+
+    if (!q->busy) {
+        pthread_cond_signal(&s_dispatchCond);
+    }
+
+    pthread_mutex_unlock(&s_dispatchMutex);
+}
+
+/* must be called with s_dispatchMutex held */
+static RequestInfo* dequeueRunnableRequest(RequestQueue* p_queue)
+{
+    for (int i = 0; i < QUEUE_COUNT; i++) {
+        int index = (s_nextDispatchQueue + i) % QUEUE_COUNT;
+        DispatchQueue* q = &s_dispatchQueues[index];
+        RequestInfo* pRI = q->p_head;
+
+        if (q->busy || pRI == NULL) {
+            continue;
+        }
+
+        q->p_head = pRI->p_nextQueued;
+        if (q->p_head == NULL) {
+            q->p_tail = NULL;
+        }
+        q->busy = true;
+
+        // round robin, so one busy category can't starve the others
+        s_nextDispatchQueue = (index + 1) % QUEUE_COUNT;
+        *p_queue = (RequestQueue)index;
+        return pRI;
+    }
+
+    return NULL;
+}
+
+static void runQueuedRequest(RequestInfo* pRI, RequestArena* arena)
+{
+    Parcel p;
+    const CommandInfo* pCI = pRI->pCI;
+    uint32_t traceId;
+    RIL_Token t;
+    char cancelled;
+    char deferFree = 0;
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    // still dispatched for the sake of attached requests
+    cancelled = (pRI->cancelled || pRI->epoch != pRI->client->epoch)
+        && pRI->p_followers == NULL;
+    if (cancelled) {
+        clearInFlightRequest(pRI);
+        setRequestState(pRI, REQUEST_COMPLETING);
+        // checkRequestDeadlines frees it once done with it
+        deferFree = pRI->expiring;
+    } else {
+        setRequestState(pRI, REQUEST_DISPATCHED);
+    }
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+    if (cancelled) {
+        // the client went away, or the deadline expired, before this one
+        // was dispatched
+        RLOGD("drop cancelled request %s", requestToString(pCI->requestNumber));
+        freeRequestPayload(pRI->buffer);
+        pRI->buffer = NULL;
+        if (!deferFree) {
+            freeRequestInfo(pRI);
+        }
+        return;
+    }
+
+    // the request header was already parsed by processCommandBuffer()
+    p.setData((uint8_t*)pRI->buffer, pRI->buflen);
+    freeRequestPayload(pRI->buffer);
+    pRI->buffer = NULL;
+
+    // pRI may be completed and freed before this returns, so the arena
+    // is reset through our own pointer
+    pRI->arena = arena;
+    t = requestToken(pRI);
+    traceId = traceRequestDispatch(pRI);
+    pCI->dispatchFunction(p, pRI);
+    traceRequestReturn(t, traceId);
+    requestArenaReset(arena);
+}
+
+static void* dispatchWorkerLoop(void* param)
+{
+    RequestInfo* pRI;
+    RequestQueue queue;
+    RequestArena arena;
+
+    requestArenaInit(&arena);
+
+    for (;;) {
+        pthread_mutex_lock(&s_dispatchMutex);
+        while ((pRI = dequeueRunnableRequest(&queue)) == NULL) {
+            pthread_cond_wait(&s_dispatchCond, &s_dispatchMutex);
+        }
+        pthread_mutex_unlock(&s_dispatchMutex);
+
+        runQueuedRequest(pRI, &arena);
+
+        pthread_mutex_lock(&s_dispatchMutex);
+        s_dispatchQueues[queue].busy = false;
+        if (s_dispatchQueues[queue].p_head != NULL) {
+            pthread_cond_signal(&s_dispatchCond);
+        }
+        pthread_mutex_unlock(&s_dispatchMutex);
+    }
+
+    return NULL;
+}
+
+static void startDispatchWorkers(void)
+{
+    pthread_attr_t attr;
+    int started = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (int i = 0; i < RIL_DISPATCH_WORKERS; i++) {
+        if (pthread_create(&s_dispatchWorkers[i], &attr, dispatchWorkerLoop, NULL) != 0) {
+            RLOGE("Failed to create dispatch worker %d errno: %d", i, errno);
+            break;
+        }
+        started++;
+    }
+
+    pthread_attr_destroy(&attr);
+
+    // with no worker at all, requests keep being dispatched inline
+    s_dispatchWorkersStarted = started;
+    RLOGI("%d request dispatch workers started", started);
+}
+#endif
+
+static void invalidCommandBlock(RequestInfo* pRI)
+{
+    RLOGE("invalid command block for token %ld request %s",
+        pRI->token, requestToString(pRI->pCI->requestNumber));
+}
+
+/* Callee expects NULL */
+static void dispatchVoid(Parcel& p, RequestInfo* pRI)
+{
+    s_callbacks.onRequest(pRI->pCI->requestNumber, NULL, 0, requestToken(pRI));
+}
+
+/* Callee expects const char * */
+static void dispatchString(Parcel& p, RequestInfo* pRI)
+{
+    char* string8 = NULL;
+
+    string8 = strdupReadString(p, pRI);
+    if (!string8) {
+        invalidCommandBlock(pRI);
+        return;
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, string8,
+        sizeof(char*), requestToken(pRI));
+
+    return;
+}
+
+/* Callee expects const char ** */
+static void dispatchStrings(Parcel& p, RequestInfo* pRI)
+{
+    int32_t countStrings;
+    status_t status;
+    size_t datalen;
+    char** pStrings;
+
+    status = p.readInt32(&countStrings);
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    if (countStrings == 0) {
+        // just some non-null pointer
+        pStrings = (char**)requestArenaAlloc(pRI, sizeof(char*));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+
+        datalen = 0;
+    } else if (countStrings < 0) {
+        pStrings = NULL;
+        datalen = 0;
+    } else {
+        datalen = sizeof(char*) * countStrings;
+
+        pStrings = (char**)requestArenaAlloc(pRI, countStrings * sizeof(char*));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+
+        for (int i = 0; i < countStrings; i++) {
+            pStrings[i] = strdupReadString(p, pRI);
+        }
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, pStrings, datalen, requestToken(pRI));
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/* Callee expects const int * */
+static void dispatchInts(Parcel& p, RequestInfo* pRI)
+{
+    int32_t count;
+    status_t status;
+    size_t datalen;
+    int* pInts;
+
+    status = p.readInt32(&count);
+
+    if (status != NO_ERROR || count <= 0) {
+        goto invalid;
+    }
+
+    datalen = sizeof(int) * count;
+    pInts = (int*)requestArenaAlloc(pRI, datalen);
+    if (pInts == NULL) {
+        RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int32_t t;
+
+        status = p.readInt32(&t);
+        pInts[i] = (int)t;
+
+        if (status != NO_ERROR) {
+            goto invalid;
+        }
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, const_cast<int*>(pInts),
+        datalen, requestToken(pRI));
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/**
+ * Callee expects const RIL_SMS_WriteArgs *
+ * Payload is:
+ *   int32_t status
+ *   String pdu
+ */
+static void dispatchSmsWrite(Parcel& p, RequestInfo* pRI)
+{
+    RIL_SMS_WriteArgs args;
+    int32_t t;
+    status_t status;
+
+    RLOGD("dispatchSmsWrite");
+    memset(&args, 0, sizeof(args));
+
+    status = p.readInt32(&t);
+    args.status = (int)t;
+
+    args.pdu = strdupReadString(p, pRI);
+
+    if (status != NO_ERROR || args.pdu == NULL) {
+        goto invalid;
+    }
+
+    args.smsc = strdupReadString(p, pRI);
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &args, sizeof(args), requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&args, 0, sizeof(args));
+#endif
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/**
+ * Callee expects const RIL_Dial *
+ * Payload is:
+ *   String address
+ *   int32_t clir
+ */
+static void dispatchDial(Parcel& p, RequestInfo* pRI)
+{
+    RIL_Dial dial;
+    RIL_UUS_Info uusInfo;
+    int32_t sizeOfDial;
+    int32_t t;
+    int32_t uusPresent;
+    status_t status;
+
+    RLOGD("dispatchDial");
+    memset(&dial, 0, sizeof(dial));
+
+    dial.address = strdupReadString(p, pRI);
+
+    status = p.readInt32(&t);
+    dial.clir = (int)t;
+
+    if (status != NO_ERROR || dial.address == NULL) {
+        goto invalid;
+    }
+
+    if (s_callbacks.version < 3) { // Remove when partners upgrade to version 3
+        uusPresent = 0;
+        sizeOfDial = sizeof(dial) - sizeof(RIL_UUS_Info*);
+    } else {
+        status = p.readInt32(&uusPresent);
+
+        if (status != NO_ERROR) {
+            goto invalid;
+        }
+
+        if (uusPresent == 0) {
+            dial.uusInfo = NULL;
+        } else {
+            int32_t len;
+
+            memset(&uusInfo, 0, sizeof(RIL_UUS_Info));
+
+            status = p.readInt32(&t);
+            uusInfo.uusType = (RIL_UUS_Type)t;
+
+            status = p.readInt32(&t);
+            uusInfo.uusDcs = (RIL_UUS_DCS)t;
+
+            status = p.readInt32(&len);
+            if (status != NO_ERROR) {
+                goto invalid;
+            }
+
+            // The java code writes -1 for null arrays
+            if (((int)len) == -1) {
+                uusInfo.uusData = NULL;
+                len = 0;
+            } else {
+                uusInfo.uusData = (char*)p.readInplace(len);
+            }
+
+            uusInfo.uusLength = len;
+            dial.uusInfo = &uusInfo;
+        }
+        sizeOfDial = sizeof(dial);
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &dial, sizeOfDial, requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&uusInfo, 0, sizeof(RIL_UUS_Info));
+    memset(&dial, 0, sizeof(dial));
+#endif
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/**
+ * Callee expects const RIL_SIM_IO *
+ * Payload is:
+ *   int32_t command
+ *   int32_t fileid
+ *   String path
+ *   int32_t p1, p2, p3
+ *   String data
+ *   String pin2
+ *   String aidPtr
+ */
+static void dispatchSIM_IO(Parcel& p, RequestInfo* pRI)
+{
+    union RIL_SIM_IO {
+        RIL_SIM_IO_v6 v6;
+        RIL_SIM_IO_v5 v5;
+    } simIO;
+
+    int32_t t;
+    int size;
+    status_t status;
+
+    RLOGD("dispatchSIM_IO");
+    memset(&simIO, 0, sizeof(simIO));
+
+    // note we only check status at the end
+
+    status = p.readInt32(&t);
+    simIO.v6.command = (int)t;
+
+    status = p.readInt32(&t);
+    simIO.v6.fileid = (int)t;
+
+    simIO.v6.path = strdupReadString(p, pRI);
+
+    status = p.readInt32(&t);
+    simIO.v6.p1 = (int)t;
+
+    status = p.readInt32(&t);
+    simIO.v6.p2 = (int)t;
+
+    status = p.readInt32(&t);
+    simIO.v6.p3 = (int)t;
+
+    simIO.v6.data = strdupReadString(p, pRI);
+    simIO.v6.pin2 = strdupReadString(p, pRI);
+    simIO.v6.aidPtr = strdupReadString(p, pRI);
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    size = (s_callbacks.version < 6) ? sizeof(simIO.v5) : sizeof(simIO.v6);
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &simIO, size, requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&simIO, 0, sizeof(simIO));
+#endif
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/**
+ * Callee expects const RIL_SIM_APDU *
+ * Payload is:
+ *   int32_t sessionid
+ *   int32_t cla
+ *   int32_t instruction
+ *   int32_t p1, p2, p3
+ *   String data
+ */
+static void dispatchSIM_APDU(Parcel& p, RequestInfo* pRI)
+{
+    int32_t t;
+    status_t status;
+    RIL_SIM_APDU apdu;
+
+    RLOGD("dispatchSIM_APDU");
+    memset(&apdu, 0, sizeof(RIL_SIM_APDU));
+
+    // Note we only check status at the end. Any single failure leads to
+    // subsequent reads filing.
+    status = p.readInt32(&t);
+    apdu.sessionid = (int)t;
+
+    status = p.readInt32(&t);
+    apdu.cla = (int)t;
+
+    status = p.readInt32(&t);
+    apdu.instruction = (int)t;
+
+    status = p.readInt32(&t);
+    apdu.p1 = (int)t;
+
+    status = p.readInt32(&t);
+    apdu.p2 = (int)t;
+
+    status = p.readInt32(&t);
+    apdu.p3 = (int)t;
+
+    apdu.data = strdupReadString(p, pRI);
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &apdu, sizeof(RIL_SIM_APDU), requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&apdu, 0, sizeof(RIL_SIM_APDU));
+#endif
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+/**
+ * Callee expects const RIL_CallForwardInfo *
+ * Payload is:
+ *  int32_t status/action
+ *  int32_t reason
+ *  int32_t serviceCode
+ *  int32_t toa
+ *  String number  (0 length -> null)
+ *  int32_t timeSeconds
+ */
+static void dispatchCallForward(Parcel& p, RequestInfo* pRI)
+{
+    RIL_CallForwardInfo cff;
+    int32_t t;
+    status_t status;
+
+    RLOGD("dispatchCallForward");
+    memset(&cff, 0, sizeof(cff));
+
+    // note we only check status at the end
+
+    status = p.readInt32(&t);
+    cff.status = (int)t;
+
+    status = p.readInt32(&t);
+    cff.reason = (int)t;
+
+    status = p.readInt32(&t);
+    cff.serviceClass = (int)t;
+
+    status = p.readInt32(&t);
+    cff.toa = (int)t;
+
+    cff.number = strdupReadString(p, pRI);
+
+    status = p.readInt32(&t);
+    cff.timeSeconds = (int)t;
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    // special case: number 0-length fields is null
+
+    if (cff.number != NULL && strlen(cff.number) == 0) {
+        cff.number = NULL;
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &cff, sizeof(cff), requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&cff, 0, sizeof(cff));
+#endif
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+static void dispatchRaw(Parcel& p, RequestInfo* pRI)
+{
+    int32_t len;
+    status_t status;
+    const void* data;
+
+    RLOGD("dispatchRaw");
+    status = p.readInt32(&len);
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    // The java code writes -1 for null arrays
+    if (((int)len) == -1) {
+        data = NULL;
+        len = 0;
+    }
+
+    data = p.readInplace(len);
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, const_cast<void*>(data), len, requestToken(pRI));
+
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+static void dispatchImsGsmSms(Parcel& p, RequestInfo* pRI, uint8_t retry,
+    int32_t messageRef)
+{
+    RIL_IMS_SMS_Message rism;
+    int32_t countStrings;
+    status_t status;
+    size_t datalen;
+    char** pStrings;
+    RLOGD("dispatchImsGsmSms: retry=%d, messageRef=%ld", retry, messageRef);
+
+    status = p.readInt32(&countStrings);
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    memset(&rism, 0, sizeof(rism));
+    rism.tech = RADIO_TECH_3GPP;
+    rism.retry = retry;
+    rism.messageRef = messageRef;
+
+    if (countStrings == 0) {
+        // just some non-null pointer
+        pStrings = (char**)requestArenaAlloc(pRI, sizeof(char*));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+
+        datalen = 0;
+    } else if (countStrings < 0) {
+        pStrings = NULL;
+        datalen = 0;
+    } else {
+        if ((unsigned int)countStrings > (INT_MAX / sizeof(char*))) {
+            RLOGE("Invalid value of countStrings: \n");
+            return;
+        }
+        datalen = sizeof(char*) * countStrings;
+
+        pStrings = (char**)requestArenaAlloc(pRI, countStrings * sizeof(char*));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+
+        for (int i = 0; i < countStrings; i++) {
+            pStrings[i] = strdupReadString(p, pRI);
+        }
+    }
+
+    rism.message.gsmMessage = pStrings;
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &rism,
+        sizeof(RIL_RadioTechnologyFamily) + sizeof(uint8_t) + sizeof(int32_t) + datalen,
+        requestToken(pRI));
+
+#ifdef MEMSET_FREED
+    memset(&rism, 0, sizeof(rism));
+#endif
+    return;
+invalid:
+    RLOGE("dispatchImsGsmSms invalid block");
+    invalidCommandBlock(pRI);
+    return;
+}
+
+static void dispatchImsSms(Parcel& p, RequestInfo* pRI)
+{
+    int32_t t;
+    status_t status = p.readInt32(&t);
+    RIL_RadioTechnologyFamily format;
+    uint8_t retry;
+    int32_t messageRef;
+
+    RLOGD("dispatchImsSms");
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+    format = (RIL_RadioTechnologyFamily)t;
+
+    // read retry field
+    status = p.read(&retry, sizeof(retry));
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+    // read messageRef field
+    status = p.read(&messageRef, sizeof(messageRef));
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    if (RADIO_TECH_3GPP == format) {
+        dispatchImsGsmSms(p, pRI, retry, messageRef);
+    } else {
+        RLOGE("requestImsSendSMS invalid format value = %d", format);
+    }
+
+    return;
+
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+static void dispatchGsmBrSmsCnf(Parcel& p, RequestInfo* pRI)
+{
+    int32_t t;
+    status_t status;
+    int32_t num;
+
+    status = p.readInt32(&num);
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    {
+        RIL_GSM_BroadcastSmsConfigInfo gsmBci[num];
+        RIL_GSM_BroadcastSmsConfigInfo* gsmBciPtrs[num];
+
+        for (int i = 0; i < num; i++) {
+            gsmBciPtrs[i] = &gsmBci[i];
+
+            status = p.readInt32(&t);
+            gsmBci[i].fromServiceId = (int)t;
+
+            status = p.readInt32(&t);
+            gsmBci[i].toServiceId = (int)t;
+
+            status = p.readInt32(&t);
+            gsmBci[i].fromCodeScheme = (int)t;
+
+            status = p.readInt32(&t);
+            gsmBci[i].toCodeScheme = (int)t;
+
+            status = p.readInt32(&t);
+            gsmBci[i].selected = (uint8_t)t;
+        }
+
+        if (status != NO_ERROR) {
+            goto invalid;
+        }
+
+        s_callbacks.onRequest(pRI->pCI->requestNumber,
+            gsmBciPtrs,
+            num * sizeof(RIL_GSM_BroadcastSmsConfigInfo*),
+            requestToken(pRI));
+
+#ifdef MEMSET_FREED
+        memset(gsmBci, 0, num * sizeof(RIL_GSM_BroadcastSmsConfigInfo));
+        memset(gsmBciPtrs, 0, num * sizeof(RIL_GSM_BroadcastSmsConfigInfo*));
+#endif
+    }
+
+    return;
+
+invalid:
     invalidCommandBlock(pRI);
     return;
 }
 
-/**
- * Callee expects const RIL_SIM_IO *
- * Payload is:
- *   int32_t command
- *   int32_t fileid
- *   String path
- *   int32_t p1, p2, p3
- *   String data
- *   String pin2
- *   String aidPtr
- */
-static void dispatchSIM_IO(Parcel& p, RequestInfo* pRI)
+// For backwards compatibility in RIL_REQUEST_SETUP_DATA_CALL.
+// Version 4 of the RIL interface adds a new PDP type parameter to support
+// IPv6 and dual-stack PDP contexts. When dealing with a previous version of
+// RIL, remove the parameter from the request.
+static void dispatchDataCall(Parcel& p, RequestInfo* pRI)
+{
+    // In RIL v3, REQUEST_SETUP_DATA_CALL takes 6 parameters.
+    const int numParamsRilV3 = 6;
+
+    // The first bytes of the RIL parcel contain the request number and the
+    // serial number - see processCommandBuffer(). Copy them over too.
+    int pos = p.dataPosition();
+
+    int numParams = p.readInt32();
+    if (s_callbacks.version < 4 && numParams > numParamsRilV3) {
+        Parcel p2;
+        p2.appendFrom(&p, 0, pos);
+        p2.writeInt32(numParamsRilV3);
+        p2.setDataPosition(pos);
+        dispatchStrings(p2, pRI);
+    } else {
+        p.setDataPosition(pos);
+        dispatchStrings(p, pRI);
+    }
+}
+
+// For backwards compatibility with RILs that dont support RIL_REQUEST_VOICE_RADIO_TECH.
+// When all RILs handle this request, this function can be removed and
+// the request can be sent directly to the RIL using dispatchVoid.
+static void dispatchVoiceRadioTech(Parcel& p, RequestInfo* pRI)
+{
+    RIL_RadioState state = s_callbacks.onStateRequest();
+
+    if ((RADIO_STATE_UNAVAILABLE == state) || (RADIO_STATE_OFF == state)) {
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_RADIO_NOT_AVAILABLE, NULL, 0);
+    }
+
+    // RILs that support RADIO_STATE_ON should support this request.
+    if (RADIO_STATE_ON == state) {
+        dispatchVoid(p, pRI);
+        return;
+    }
+
+    // For Older RILs, that do not support RADIO_STATE_ON, assume that they
+    // will not support this new request either and decode Voice Radio Technology
+    // from Radio State
+    voiceRadioTech = decodeVoiceRadioTechnology(state);
+
+    if (voiceRadioTech < 0)
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_GENERIC_FAILURE, NULL, 0);
+    else
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_SUCCESS, &voiceRadioTech, sizeof(int));
+}
+
+static void dispatchSetInitialAttachApn(Parcel& p, RequestInfo* pRI)
 {
-    union RIL_SIM_IO {
-        RIL_SIM_IO_v6 v6;
-        RIL_SIM_IO_v5 v5;
-    } simIO;
-
+    RIL_InitialAttachApn pf;
     int32_t t;
-    int size;
     status_t status;
 
-    RLOGD("dispatchSIM_IO");
-    memset(&simIO, 0, sizeof(simIO));
+    memset(&pf, 0, sizeof(pf));
 
-    // note we only check status at the end
+    pf.apn = strdupReadString(p, pRI);
+    pf.protocol = strdupReadString(p, pRI);
 
     status = p.readInt32(&t);
-    simIO.v6.command = (int)t;
+    pf.authtype = (int)t;
 
-    status = p.readInt32(&t);
-    simIO.v6.fileid = (int)t;
+    pf.username = strdupReadString(p, pRI);
+    pf.password = strdupReadString(p, pRI);
 
-    simIO.v6.path = strdupReadString(p);
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &pf, sizeof(pf), requestToken(pRI));
 
-    status = p.readInt32(&t);
-    simIO.v6.p1 = (int)t;
+#ifdef MEMSET_FREED
+    memset(&pf, 0, sizeof(pf));
+#endif
 
-    status = p.readInt32(&t);
-    simIO.v6.p2 = (int)t;
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
 
-    status = p.readInt32(&t);
-    simIO.v6.p3 = (int)t;
+static void dispatchManualSelection(Parcel& p, RequestInfo* pRI)
+{
+    int32_t t;
+    status_t status;
+    RIL_NetworkOperator op;
+
+    RLOGD("dispatchManualSelection");
+    memset(&op, 0, sizeof(op));
 
-    simIO.v6.data = strdupReadString(p);
-    simIO.v6.pin2 = strdupReadString(p);
-    simIO.v6.aidPtr = strdupReadString(p);
+    op.operatorNumeric = strdupReadString(p, pRI);
 
-    startRequest;
-    appendPrintBuf("%scmd=0x%X,efid=0x%X,path=%s,%d,%d,%d,%s,pin2=%s,aid=%s", printBuf,
-        simIO.v6.command, simIO.v6.fileid, (char*)simIO.v6.path,
-        simIO.v6.p1, simIO.v6.p2, simIO.v6.p3,
-        (char*)simIO.v6.data, (char*)simIO.v6.pin2, simIO.v6.aidPtr);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    status = p.readInt32(&t);
+    op.act = (RIL_RadioAccessNetworks)t;
 
     if (status != NO_ERROR) {
         goto invalid;
     }
 
-    size = (s_callbacks.version < 6) ? sizeof(simIO.v5) : sizeof(simIO.v6);
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &simIO, size, pRI);
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &op, sizeof(RIL_NetworkOperator),
+        requestToken(pRI));
 
 #ifdef MEMSET_FREED
-    memsetString(simIO.v6.path);
-    memsetString(simIO.v6.data);
-    memsetString(simIO.v6.pin2);
-    memsetString(simIO.v6.aidPtr);
+    memset(&op, 0, sizeof(op));
 #endif
 
-    free(simIO.v6.path);
-    free(simIO.v6.data);
-    free(simIO.v6.pin2);
-    free(simIO.v6.aidPtr);
+    return;
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
 
-#ifdef MEMSET_FREED
-    memset(&simIO, 0, sizeof(simIO));
-#endif
+static void dispatchDataProfile(Parcel& p, RequestInfo* pRI)
+{
+    int32_t t;
+    status_t status;
+    int32_t num;
+
+    status = p.readInt32(&num);
+    if (status != NO_ERROR || num < 0) {
+        goto invalid;
+    }
+
+    {
+        RIL_DataProfileInfo* dataProfiles = (RIL_DataProfileInfo*)requestArenaAlloc(pRI,
+            num * sizeof(RIL_DataProfileInfo));
+        if (dataProfiles == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+        RIL_DataProfileInfo** dataProfilePtrs = (RIL_DataProfileInfo**)requestArenaAlloc(pRI,
+            num * sizeof(RIL_DataProfileInfo*));
+        if (dataProfilePtrs == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                requestToString(pRI->pCI->requestNumber));
+            return;
+        }
+
+        for (int i = 0; i < num; i++) {
+            dataProfilePtrs[i] = &dataProfiles[i];
+
+            status = p.readInt32(&t);
+            dataProfiles[i].profileId = (int)t;
+
+            dataProfiles[i].apn = strdupReadString(p, pRI);
+            dataProfiles[i].protocol = strdupReadString(p, pRI);
+            status = p.readInt32(&t);
+            dataProfiles[i].authType = (int)t;
+
+            dataProfiles[i].user = strdupReadString(p, pRI);
+            dataProfiles[i].password = strdupReadString(p, pRI);
+
+            status = p.readInt32(&t);
+            dataProfiles[i].type = (int)t;
+
+            status = p.readInt32(&t);
+            dataProfiles[i].maxConnsTime = (int)t;
+            status = p.readInt32(&t);
+            dataProfiles[i].maxConns = (int)t;
+            status = p.readInt32(&t);
+            dataProfiles[i].waitTime = (int)t;
+
+            status = p.readInt32(&t);
+            dataProfiles[i].enabled = (int)t;
+        }
+        if (status != NO_ERROR) {
+            goto invalid;
+        }
+
+        s_callbacks.onRequest(pRI->pCI->requestNumber,
+            dataProfilePtrs,
+            num * sizeof(RIL_DataProfileInfo*),
+            requestToken(pRI));
+    }
+
+    return;
+
+invalid:
+    invalidCommandBlock(pRI);
+    return;
+}
+
+static void dispatchConferenceInvite(Parcel& p, RequestInfo* pRI)
+{
+    RIL_ConferenceInvite cinfo;
+    int32_t t;
+    status_t status;
+
+    RLOGD("dispatchConferenceInvite");
+    memset(&cinfo, 0, sizeof(RIL_ConferenceInvite));
+
+    status = p.readInt32(&t);
+    cinfo.nparticipants = (int)t;
+
+    if (status != NO_ERROR) {
+        goto invalid;
+    }
+
+    cinfo.numbers = strdupReadString(p, pRI);
+
+    if (!cinfo.numbers) {
+        goto invalid;
+    }
+
+    s_callbacks.onRequest(pRI->pCI->requestNumber, &cinfo, sizeof(RIL_ConferenceInvite),
+        requestToken(pRI));
 
     return;
+
 invalid:
     invalidCommandBlock(pRI);
     return;
 }
 
+/* Handled here, the vendor RIL never sees this request */
+static void dispatchSetUnsolSubscriptions(Parcel& p, RequestInfo* pRI)
+{
+    RilClient* client = pRI->client;
+    uint32_t filter[UNSOL_FILTER_WORDS];
+    int32_t count;
+    status_t status;
+
+    memset(filter, 0, sizeof(filter));
+
+    status = p.readInt32(&count);
+
+    if (status != NO_ERROR || count < 0 || client == NULL) {
+        goto invalid;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int32_t t;
+
+        status = p.readInt32(&t);
+
+        if (status != NO_ERROR) {
+            goto invalid;
+        }
+
+        // bits past the end of s_unsolResponses are ignored
+        if (i < UNSOL_FILTER_WORDS) {
+            filter[i] = (uint32_t)t;
+        }
+    }
+
+    pthread_mutex_lock(&s_writeMutex);
+    if (client->fd >= 0 && client->epoch == pRI->epoch) {
+        memcpy(client->unsolFilter, filter, sizeof(filter));
+        updateUnsolWanted();
+    }
+    pthread_mutex_unlock(&s_writeMutex);
+
+    RIL_onRequestComplete(requestToken(pRI), RIL_E_SUCCESS, NULL, 0);
+    return;
+
+invalid:
+    invalidCommandBlock(pRI);
+    RIL_onRequestComplete(requestToken(pRI), RIL_E_INVALID_ARGUMENTS, NULL, 0);
+}
+
 /**
- * Callee expects const RIL_SIM_APDU *
- * Payload is:
- *   int32_t sessionid
- *   int32_t cla
- *   int32_t instruction
- *   int32_t p1, p2, p3
- *   String data
+ * Returns the request of client sent with token that is still waiting for
+ * its response, NULL if there is none. *pp_leader is set to the request it
+ * is attached to, if any.
+ * must be called with s_pendingRequestsMutex held
  */
-static void dispatchSIM_APDU(Parcel& p, RequestInfo* pRI)
+/**
+ * Returns the request of cancel's client with the given serial, if it can
+ * still be cancelled, with *pp_leader set to the request it is attached to.
+ * must be called with s_pendingRequestsMutex held
+ */
+static RequestInfo* findClientRequest(RequestInfo* cancel, int32_t token,
+    RequestInfo** pp_leader)
 {
-    int32_t t;
+    RilClient* client = cancel->client;
+
+    for (RequestInfo* p_cur = client->requests[(uint32_t)token & (CLIENT_REQUEST_BUCKETS - 1)];
+         p_cur != NULL; p_cur = p_cur->p_nextOfClient) {
+        if (p_cur == cancel || p_cur->epoch != cancel->epoch || p_cur->token != token) {
+            continue;
+        }
+
+        if (p_cur->state == REQUEST_ATTACHED && isCancellableLeader(p_cur->p_leader)) {
+            *pp_leader = p_cur->p_leader;
+            return p_cur;
+        }
+
+        if (isCancellableLeader(p_cur) && isAbortableRequest(p_cur)) {
+            *pp_leader = NULL;
+            return p_cur;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Handled here, on the event loop, so it never waits behind the request
+ * it cancels. The cancelled request is failed like an expired one.
+ */
+static void dispatchCancelRequest(Parcel& p, RequestInfo* pRI)
+{
+    RequestInfo* target = NULL;
+    RequestInfo* leader = NULL;
+    RequestInfo* p_dispatched = NULL; // the vendor RIL has to cancel these
+    RequestInfo* p_dropped = NULL;
+    int32_t token;
     status_t status;
-    RIL_SIM_APDU apdu;
 
-    RLOGD("dispatchSIM_APDU");
-    memset(&apdu, 0, sizeof(RIL_SIM_APDU));
+    status = p.readInt32(&token);
 
-    // Note we only check status at the end. Any single failure leads to
-    // subsequent reads filing.
-    status = p.readInt32(&t);
-    apdu.sessionid = (int)t;
+    if (status != NO_ERROR || pRI->client == NULL) {
+        invalidCommandBlock(pRI);
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_INVALID_ARGUMENTS, NULL, 0);
+        return;
+    }
 
-    status = p.readInt32(&t);
-    apdu.cla = (int)t;
+    pthread_mutex_lock(&s_pendingRequestsMutex);
 
-    status = p.readInt32(&t);
-    apdu.instruction = (int)t;
+    target = findClientRequest(pRI, token, &leader);
 
-    status = p.readInt32(&t);
-    apdu.p1 = (int)t;
+    if (target != NULL && leader == NULL && target->p_followers != NULL) {
+        // other clients still wait for this vendor call: the first attached
+        // request takes over the response, and its twin fails in its place
+        leader = target;
+        target = promoteFollower(leader);
+    } else if (target != NULL && leader != NULL) {
+        detachFollower(leader, target);
+    }
 
-    status = p.readInt32(&t);
-    apdu.p2 = (int)t;
+    if (target != NULL && leader != NULL) {
+        setRequestState(target, REQUEST_COMPLETING);
+        addExpiredRequest(&p_dropped, target);
+    } else if (target != NULL) {
+        abortRequest(target);
+        addExpiredRequest(target->state == REQUEST_EXPIRED ? &p_dispatched : &p_dropped, target);
+    }
 
-    status = p.readInt32(&t);
-    apdu.p3 = (int)t;
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+    failExpiredRequests(p_dispatched, true, "cancelled by the client");
+    failExpiredRequests(p_dropped, false, "cancelled by the client");
+
+    releaseExpiredRequests(p_dispatched);
+    releaseExpiredRequests(p_dropped);
+
+    // already answered, or not a request of this client
+    RIL_onRequestComplete(requestToken(pRI), target != NULL ? RIL_E_SUCCESS : RIL_E_INVALID_STATE,
+        NULL, 0);
+}
+
+/**
+ * Runs on the event loop, which owns the client's events. The rings are
+ * only used for responses once the response carrying their fds is out.
+ */
+static void dispatchSetupSharedRing(Parcel& p, RequestInfo* pRI)
+{
+#if RIL_SHM_TRANSPORT
+    RilClient* client = pRI->client;
+    RIL_ShmHeader* header;
+    size_t length;
+    int32_t ringSize;
+    int memfd;
+    int toClientFd;
+    int toRilFd;
+    int response;
+    status_t status;
+
+    status = p.readInt32(&ringSize);
+
+    if (status != NO_ERROR || client == NULL || ringSize < 0) {
+        invalidCommandBlock(pRI);
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_INVALID_ARGUMENTS, NULL, 0);
+        return;
+    }
+
+    if (client->shm != NULL) {
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_INVALID_STATE, NULL, 0);
+        return;
+    }
 
-    apdu.data = strdupReadString(p);
+    memfd = ril_shm_create(ringSize, &header, &length);
+    if (memfd < 0) {
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_NO_RESOURCES, NULL, 0);
+        return;
+    }
 
-    startRequest;
-    appendPrintBuf("%ssessionid=%d,cla=%d,ins=%d,p1=%d,p2=%d,p3=%d,data=%s",
-        printBuf, apdu.sessionid, apdu.cla, apdu.instruction, apdu.p1, apdu.p2,
-        apdu.p3, (char*)apdu.data);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    toClientFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    toRilFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (toClientFd < 0 || toRilFd < 0) {
+        RLOGE("Error in eventfd() errno: %d", errno);
+        if (toClientFd >= 0) {
+            close(toClientFd);
+        }
+        if (toRilFd >= 0) {
+            close(toRilFd);
+        }
+        munmap(header, length);
+        close(memfd);
+        RIL_onRequestComplete(requestToken(pRI), RIL_E_NO_RESOURCES, NULL, 0);
+        return;
     }
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &apdu, sizeof(RIL_SIM_APDU), pRI);
+    pthread_mutex_lock(&s_writeMutex);
+    client->shm = header;
+    client->shmLength = length;
+    ril_shm_rings(header, &client->toClient, &client->toRil);
+    client->toClient.eventFd = toClientFd;
+    client->toRil.eventFd = toRilFd;
+    client->passFds[0] = memfd;
+    client->passFds[1] = toClientFd;
+    client->passFds[2] = toRilFd;
+    client->numPassFds = 3;
+    pthread_mutex_unlock(&s_writeMutex);
 
-#ifdef MEMSET_FREED
-    memsetString(apdu.data);
-#endif
-    free(apdu.data);
+    // the client's first request has to wake us
+    ril_shm_ring_prepare_wait(&client->toRil);
+    ril_event_set(&client->shmEvent, toRilFd, true, processSharedRingCallback, client);
+    rilEventAddWakeup(&client->shmEvent);
 
-#ifdef MEMSET_FREED
-    memset(&apdu, 0, sizeof(RIL_SIM_APDU));
-#endif
+    response = header->ringSize;
+    RIL_onRequestComplete(requestToken(pRI), RIL_E_SUCCESS, &response, sizeof(response));
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    pthread_mutex_lock(&s_writeMutex);
+    client->shmActive = (client->shm != NULL);
+    pthread_mutex_unlock(&s_writeMutex);
+#else
+    RIL_onRequestComplete(requestToken(pRI), RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
+#endif
 }
 
-/**
- * Callee expects const RIL_CallForwardInfo *
- * Payload is:
- *  int32_t status/action
- *  int32_t reason
- *  int32_t serviceCode
- *  int32_t toa
- *  String number  (0 length -> null)
- *  int32_t timeSeconds
- */
-static void dispatchCallForward(Parcel& p, RequestInfo* pRI)
+/* must be called with s_writeMutex held */
+static int outputBufferReserve(OutputBuffer* ob, size_t size)
 {
-    RIL_CallForwardInfo cff;
-    int32_t t;
-    status_t status;
+    size_t capacity;
+    uint8_t* data;
+    size_t first;
 
-    RLOGD("dispatchCallForward");
-    memset(&cff, 0, sizeof(cff));
+    if (size <= ob->capacity) {
+        return 0;
+    }
 
-    // note we only check status at the end
+    if (size > MAX_OUTPUT_BUFFER_BYTES) {
+        return -1;
+    }
 
-    status = p.readInt32(&t);
-    cff.status = (int)t;
+    capacity = ob->capacity ? ob->capacity : OUTPUT_BUFFER_INIT_BYTES;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (capacity > MAX_OUTPUT_BUFFER_BYTES) {
+        capacity = MAX_OUTPUT_BUFFER_BYTES;
+    }
 
-    status = p.readInt32(&t);
-    cff.reason = (int)t;
+    data = (uint8_t*)malloc(capacity);
+    if (data == NULL) {
+        return -1;
+    }
 
-    status = p.readInt32(&t);
-    cff.serviceClass = (int)t;
+    // unwrap the queued bytes into the new buffer
+    if (ob->count > 0) {
+        first = MIN(ob->count, ob->capacity - ob->head);
+        memcpy(data, ob->data + ob->head, first);
+        memcpy(data + first, ob->data, ob->count - first);
+    }
 
-    status = p.readInt32(&t);
-    cff.toa = (int)t;
+    free(ob->data);
+    ob->data = data;
+    ob->capacity = capacity;
+    ob->head = 0;
 
-    cff.number = strdupReadString(p);
+    return 0;
+}
 
-    status = p.readInt32(&t);
-    cff.timeSeconds = (int)t;
+/* must be called with s_writeMutex held, room must have been reserved */
+static void outputBufferAppend(OutputBuffer* ob, const void* src, size_t len)
+{
+    size_t tail = (ob->head + ob->count) % ob->capacity;
+    size_t first = MIN(len, ob->capacity - tail);
 
-    if (status != NO_ERROR) {
-        goto invalid;
-    }
+    memcpy(ob->data + tail, src, first);
+    memcpy(ob->data, (const uint8_t*)src + first, len - first);
+    ob->count += len;
+}
 
-    // special case: number 0-length fields is null
+/* must be called with s_writeMutex held */
+static void outputBufferPeek(OutputBuffer* ob, size_t offset, void* dst, size_t len)
+{
+    size_t start = (ob->head + offset) % ob->capacity;
+    size_t first = MIN(len, ob->capacity - start);
 
-    if (cff.number != NULL && strlen(cff.number) == 0) {
-        cff.number = NULL;
-    }
+    memcpy(dst, ob->data + start, first);
+    memcpy((uint8_t*)dst + first, ob->data, len - first);
+}
+
+/**
+ * writev() on the client socket, plus the fds waiting to be passed to
+ * the client if there are any.
+ * must be called with s_writeMutex held
+ *
+ * Returns what sendmsg() returns, EPIPE once the client hung up
+ */
+static ssize_t sendToClient(RilClient* client, const struct iovec* iov, int iovcnt)
+{
+    struct msghdr msg;
+    ssize_t sent;
+#if RIL_SHM_TRANSPORT
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(client->passFds))];
+    } control;
+#endif
 
-    startRequest;
-    appendPrintBuf("%sstat=%d,reason=%d,serv=%d,toa=%d,%s,tout=%d", printBuf,
-        cff.status, cff.reason, cff.serviceClass, cff.toa,
-        (char*)cff.number, cff.timeSeconds);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = iovcnt;
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &cff, sizeof(cff), pRI);
+#if RIL_SHM_TRANSPORT
+    if (client->numPassFds > 0) {
+        struct cmsghdr* cmsg;
+        size_t fdsLen = client->numPassFds * sizeof(int);
 
-#ifdef MEMSET_FREED
-    memsetString(cff.number);
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(fdsLen);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdsLen);
+        memcpy(CMSG_DATA(cmsg), client->passFds, fdsLen);
+    }
 #endif
 
-    free(cff.number);
+    // a client hanging up mid flush gets EPIPE, not rild a SIGPIPE
+    do {
+        sent = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
 
-#ifdef MEMSET_FREED
-    memset(&cff, 0, sizeof(cff));
+#if RIL_SHM_TRANSPORT
+    if (sent >= 0 && client->numPassFds > 0) {
+        // the client has its copies now, only the memfd was ours alone
+        close(client->passFds[0]);
+        client->numPassFds = 0;
+    }
 #endif
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    return sent;
 }
 
-static void dispatchRaw(Parcel& p, RequestInfo* pRI)
+/**
+ * Sends the queued responses one packet each, dropping their length
+ * headers.
+ * must be called with s_writeMutex held
+ *
+ * Returns 0 on success or EAGAIN, -1 on any other error
+ */
+static int outputBufferFlushPackets(RilClient* client)
 {
-    int32_t len;
-    status_t status;
-    const void* data;
-
-    RLOGD("dispatchRaw");
-    status = p.readInt32(&len);
+    OutputBuffer* ob = &client->output;
+
+    while (ob->count > 0) {
+        struct iovec iov[2];
+        uint32_t header;
+        size_t len;
+        size_t start;
+        size_t first;
+        ssize_t sent;
+
+        outputBufferPeek(ob, 0, &header, sizeof(header));
+        len = ntohl(header);
+        start = (ob->head + sizeof(header)) % ob->capacity;
+        first = MIN(len, ob->capacity - start);
+
+        iov[0].iov_base = ob->data + start;
+        iov[0].iov_len = first;
+        iov[1].iov_base = ob->data;
+        iov[1].iov_len = len - first;
+
+        sent = sendToClient(client, iov, first < len ? 2 : 1);
+
+        if (sent < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
 
-    if (status != NO_ERROR) {
-        goto invalid;
+        ob->head = (ob->head + sizeof(header) + len) % ob->capacity;
+        ob->count -= sizeof(header) + len;
     }
 
-    // The java code writes -1 for null arrays
-    if (((int)len) == -1) {
-        data = NULL;
-        len = 0;
+    ob->head = 0;
+    return 0;
+}
+
+/**
+ * Writes out as much of the buffer as the socket takes.
+ * must be called with s_writeMutex held
+ *
+ * Returns 0 on success or EAGAIN, -1 on any other error
+ */
+static int outputBufferFlush(RilClient* client)
+{
+    OutputBuffer* ob = &client->output;
+
+    if (s_seqPacket) {
+        return outputBufferFlushPackets(client);
     }
 
-    data = p.readInplace(len);
+    while (ob->count > 0) {
+        struct iovec iov[2];
+        int iovcnt = 1;
+        ssize_t written;
+        size_t first = MIN(ob->count, ob->capacity - ob->head);
+
+        iov[0].iov_base = ob->data + ob->head;
+        iov[0].iov_len = first;
+        if (first < ob->count) {
+            iov[1].iov_base = ob->data;
+            iov[1].iov_len = ob->count - first;
+            iovcnt = 2;
+        }
 
-    startRequest;
-    appendPrintBuf("%sraw_size=%d", printBuf, len);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+        written = sendToClient(client, iov, iovcnt);
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, const_cast<void*>(data), len, pRI);
+        if (written < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+        ob->head = (ob->head + written) % ob->capacity;
+        ob->count -= written;
+    }
+
+    ob->head = 0;
+    return 0;
 }
 
-static void dispatchImsGsmSms(Parcel& p, RequestInfo* pRI, uint8_t retry,
-    int32_t messageRef)
+/* must be called with s_writeMutex held */
+static void outputBufferReset(OutputBuffer* ob)
 {
-    RIL_IMS_SMS_Message rism;
-    int32_t countStrings;
-    status_t status;
-    size_t datalen;
-    char** pStrings;
-    RLOGD("dispatchImsGsmSms: retry=%d, messageRef=%ld", retry, messageRef);
+    free(ob->data);
+    ob->data = NULL;
+    ob->capacity = 0;
+    ob->head = 0;
+    ob->count = 0;
+}
 
-    status = p.readInt32(&countStrings);
+static bool isUnsolicitedResponse(const void* data, size_t dataSize)
+{
+    int32_t type;
 
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (dataSize < sizeof(type)) {
+        return false;
     }
 
-    memset(&rism, 0, sizeof(rism));
-    rism.tech = RADIO_TECH_3GPP;
-    rism.retry = retry;
-    rism.messageRef = messageRef;
+    memcpy(&type, data, sizeof(type));
+    return type == RESPONSE_UNSOLICITED;
+}
 
-    startRequest;
-    appendPrintBuf("%stech=%d, retry=%d, messageRef=%d, ", printBuf,
-        (int)rism.tech, (int)rism.retry, rism.messageRef);
-    if (countStrings == 0) {
-        // just some non-null pointer
-        pStrings = (char**)calloc(1, sizeof(char*));
-        if (pStrings == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            closeRequest;
-            return;
-        }
+/* must be called with s_writeMutex held */
+static void updateUnsolWanted(void)
+{
+    for (int w = 0; w < UNSOL_FILTER_WORDS; w++) {
+        uint32_t wanted = 0;
 
-        datalen = 0;
-    } else if (countStrings < 0) {
-        pStrings = NULL;
-        datalen = 0;
-    } else {
-        if ((unsigned int)countStrings > (INT_MAX / sizeof(char*))) {
-            RLOGE("Invalid value of countStrings: \n");
-            closeRequest;
-            return;
+        for (int i = 0; i < MAX_COMMAND_CLIENTS; i++) {
+            if (s_clients[i].fd >= 0) {
+                wanted |= s_clients[i].unsolFilter[w];
+            }
         }
-        datalen = sizeof(char*) * countStrings;
 
-        pStrings = (char**)calloc(countStrings, sizeof(char*));
-        if (pStrings == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            closeRequest;
-            return;
-        }
+        __atomic_store_n(&s_unsolWanted[w], wanted, __ATOMIC_RELAXED);
 
-        for (int i = 0; i < countStrings; i++) {
-            pStrings[i] = strdupReadString(p);
-            appendPrintBuf("%s%s,", printBuf, pStrings[i]);
+        // the next client to subscribe polls a fresh state instead
+        for (int b = 0; b < 32 && w * 32 + b < (int)NUM_ELEMS(s_stickyResponses); b++) {
+            StickyResponse* sticky = &s_stickyResponses[w * 32 + b];
+
+            if (sticky->sticky == STICKY_LAST && ((wanted >> b) & 1) == 0) {
+                sticky->size = 0;
+            }
         }
     }
-    removeLastChar;
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
-
-    rism.message.gsmMessage = pStrings;
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &rism,
-        sizeof(RIL_RadioTechnologyFamily) + sizeof(uint8_t) + sizeof(int32_t) + datalen,
-        pRI);
+}
 
-    if (pStrings != NULL) {
-        for (int i = 0; i < countStrings; i++) {
-#ifdef MEMSET_FREED
-            memsetString(pStrings[i]);
-#endif
-            free(pStrings[i]);
-        }
+static bool isUnsolWanted(const uint32_t* filter, int unsolResponseIndex)
+{
+    uint32_t word = __atomic_load_n(&filter[unsolResponseIndex / 32], __ATOMIC_RELAXED);
 
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, datalen);
-#endif
-        free(pStrings);
-    }
+    return (word >> (unsolResponseIndex % 32)) & 1;
+}
 
-#ifdef MEMSET_FREED
-    memset(&rism, 0, sizeof(rism));
-#endif
-    return;
-invalid:
-    RLOGE("dispatchImsGsmSms invalid block");
-    invalidCommandBlock(pRI);
-    return;
+/* must be called with s_writeMutex held */
+static void abortCommandOutput(RilClient* client)
+{
+    outputBufferReset(&client->output);
+    // the event loop sees the hangup on its next read and cleans up
+    shutdown(client->fd, SHUT_RDWR);
 }
 
-static void dispatchImsSms(Parcel& p, RequestInfo* pRI)
+#if RIL_SHM_TRANSPORT
+/**
+ * Writes responses to the client's toClient ring, with one wakeup for
+ * all of them.
+ * must be called with s_writeMutex held
+ *
+ * Returns the number of solicited responses that did not fit, copied to
+ * fallback for the socket
+ */
+static int writeSharedRing(RilClient* client, const struct iovec* responses, int count,
+    struct iovec* fallback)
 {
-    int32_t t;
-    status_t status = p.readInt32(&t);
-    RIL_RadioTechnologyFamily format;
-    uint8_t retry;
-    int32_t messageRef;
+    int written = 0;
+    int numFallback = 0;
 
-    RLOGD("dispatchImsSms");
-    if (status != NO_ERROR) {
-        goto invalid;
+    for (int i = 0; i < count; i++) {
+        if (ril_shm_ring_write(&client->toClient, responses[i].iov_base,
+                responses[i].iov_len)
+            == 0) {
+            written++;
+        } else if (isUnsolicitedResponse(responses[i].iov_base, responses[i].iov_len)) {
+            client->shmDropped++;
+            RLOGW("RIL: shared ring of client %d full, unsolicited response dropped (%u)",
+                client->id, client->shmDropped);
+        } else {
+            fallback[numFallback++] = responses[i];
+        }
     }
-    format = (RIL_RadioTechnologyFamily)t;
 
-    // read retry field
-    status = p.read(&retry, sizeof(retry));
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (written > 0) {
+        ril_shm_ring_notify(&client->toClient);
     }
-    // read messageRef field
-    status = p.read(&messageRef, sizeof(messageRef));
-    if (status != NO_ERROR) {
-        goto invalid;
+
+    return numFallback;
+}
+
+/* must be called with s_writeMutex held */
+static void releaseSharedRing(RilClient* client)
+{
+    if (client->shm == NULL) {
+        return;
     }
 
-    if (RADIO_TECH_3GPP == format) {
-        dispatchImsGsmSms(p, pRI, retry, messageRef);
-    } else {
-        RLOGE("requestImsSendSMS invalid format value = %d", format);
+    if (client->numPassFds > 0) {
+        close(client->passFds[0]);
+        client->numPassFds = 0;
     }
 
-    return;
+    close(client->toClient.eventFd);
+    close(client->toRil.eventFd);
+    munmap(client->shm, client->shmLength);
 
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    client->shm = NULL;
+    client->shmActive = false;
+    client->shmDropped = 0;
 }
+#endif
 
-static void dispatchGsmBrSmsCnf(Parcel& p, RequestInfo* pRI)
+/**
+ * Sends each response in a packet of its own, until the socket stops
+ * taking them.
+ *
+ * Returns the bytes the sent responses take in iov, their headers
+ * included, or -1 on errors other than EAGAIN
+ */
+static ssize_t sendPackets(RilClient* client, const struct iovec* iov, int count)
 {
-    int32_t t;
-    status_t status;
-    int32_t num;
+    ssize_t sent = 0;
 
-    status = p.readInt32(&num);
-    if (status != NO_ERROR) {
-        goto invalid;
+    for (int i = 0; i < count; i++) {
+        ssize_t ret = sendToClient(client, &iov[2 * i + 1], 1);
+
+        if (ret < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? sent : -1;
+        }
+
+        sent += iov[2 * i].iov_len + iov[2 * i + 1].iov_len;
     }
 
-    {
-        RIL_GSM_BroadcastSmsConfigInfo gsmBci[num];
-        RIL_GSM_BroadcastSmsConfigInfo* gsmBciPtrs[num];
+    return sent;
+}
 
-        startRequest;
-        for (int i = 0; i < num; i++) {
-            gsmBciPtrs[i] = &gsmBci[i];
+/**
+ * Queues count responses, each with its length header, for one client.
+ * Never blocks: whatever the socket does not take right away is queued
+ * and written out by the event loop once the socket is writable.
+ * On a SOCK_SEQPACKET socket the headers only frame the queued responses
+ * and are not sent.
+ * must be called with s_writeMutex held
+ */
+static int queueResponses(RilClient* client, const struct iovec* responses, int count)
+{
+    OutputBuffer* ob = &client->output;
+#if RIL_SHM_TRANSPORT
+    struct iovec fallback[MAX_RESPONSE_BATCH];
+#endif
+    uint32_t headers[MAX_RESPONSE_BATCH];
+    struct iovec iov[2 * MAX_RESPONSE_BATCH];
+    size_t total = 0;
+    size_t offset = 0;
+    bool unsolicited = true;
+    bool wasEmpty;
+
+    assert(count > 0 && count <= MAX_RESPONSE_BATCH);
+
+#if RIL_SHM_TRANSPORT
+    if (client->shmActive) {
+        count = writeSharedRing(client, responses, count, fallback);
+        if (count == 0) {
+            return 0;
+        }
+        responses = fallback;
+    }
+#endif
 
-            status = p.readInt32(&t);
-            gsmBci[i].fromServiceId = (int)t;
+    for (int i = 0; i < count; i++) {
+        headers[i] = htonl(responses[i].iov_len);
+        iov[2 * i].iov_base = &headers[i];
+        iov[2 * i].iov_len = sizeof(headers[i]);
+        iov[2 * i + 1] = responses[i];
+        total += sizeof(headers[i]) + responses[i].iov_len;
+
+        if (!isUnsolicitedResponse(responses[i].iov_base, responses[i].iov_len)) {
+            unsolicited = false;
+        }
+    }
 
-            status = p.readInt32(&t);
-            gsmBci[i].toServiceId = (int)t;
+    wasEmpty = (ob->count == 0);
 
-            status = p.readInt32(&t);
-            gsmBci[i].fromCodeScheme = (int)t;
+    if (wasEmpty) {
+        // nothing queued ahead of us, try the socket first
+        ssize_t written;
 
-            status = p.readInt32(&t);
-            gsmBci[i].toCodeScheme = (int)t;
+        if (s_seqPacket) {
+            written = sendPackets(client, iov, count);
+        } else {
+            written = sendToClient(client, iov, 2 * count);
+        }
 
-            status = p.readInt32(&t);
-            gsmBci[i].selected = (uint8_t)t;
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            RLOGE("RIL Response: unexpected error on write to client %d errno: %d",
+                client->id, errno);
+            abortCommandOutput(client);
+            return -1;
+        }
 
-            appendPrintBuf("%s [%d: fromServiceId=%d, toServiceId =%d, \
-                  fromCodeScheme=%d, toCodeScheme=%d, selected =%d]",
-                printBuf, i,
-                gsmBci[i].fromServiceId, gsmBci[i].toServiceId,
-                gsmBci[i].fromCodeScheme, gsmBci[i].toCodeScheme,
-                gsmBci[i].selected);
+        if (written == (ssize_t)total) {
+            return 0;
         }
-        closeRequest;
 
-        if (status != NO_ERROR) {
-            goto invalid;
+        if (written > 0) {
+            offset = written;
         }
+    }
 
-        s_callbacks.onRequest(pRI->pCI->requestNumber,
-            gsmBciPtrs,
-            num * sizeof(RIL_GSM_BroadcastSmsConfigInfo*),
-            pRI);
+    if (outputBufferReserve(ob, ob->count + total - offset) < 0) {
+        // packets are never partly sent
+        if ((offset == 0 || s_seqPacket) && unsolicited) {
+            ob->dropped += count;
+            RLOGW("RIL: output buffer of client %d full, unsolicited response dropped (%u)",
+                client->id, ob->dropped);
+            return -1;
+        }
 
-#ifdef MEMSET_FREED
-        memset(gsmBci, 0, num * sizeof(RIL_GSM_BroadcastSmsConfigInfo));
-        memset(gsmBciPtrs, 0, num * sizeof(RIL_GSM_BroadcastSmsConfigInfo*));
-#endif
+        // a solicited response, or one already partly written, can't be
+        // dropped without stalling or corrupting the stream
+        RLOGE("RIL: client %d is not reading its responses, disconnecting", client->id);
+        abortCommandOutput(client);
+        return -1;
     }
 
-    return;
+    // queue what the socket did not take
+    for (int i = 0; i < 2 * count; i++) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
 
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+        outputBufferAppend(ob, (const uint8_t*)iov[i].iov_base + offset,
+            iov[i].iov_len - offset);
+        offset = 0;
+    }
+
+    if (wasEmpty) {
+        ril_event_set_events(&client->event, RIL_EVENT_READ | RIL_EVENT_WRITE);
+        triggerEvLoop();
+    }
+
+    return 0;
 }
 
-// For backwards compatibility in RIL_REQUEST_SETUP_DATA_CALL.
-// Version 4 of the RIL interface adds a new PDP type parameter to support
-// IPv6 and dual-stack PDP contexts. When dealing with a previous version of
-// RIL, remove the parameter from the request.
-static void dispatchDataCall(Parcel& p, RequestInfo* pRI)
+/* must be called with s_writeMutex held */
+static int queueResponse(RilClient* client, const void* data, size_t dataSize)
 {
-    // In RIL v3, REQUEST_SETUP_DATA_CALL takes 6 parameters.
-    const int numParamsRilV3 = 6;
+    struct iovec response;
 
-    // The first bytes of the RIL parcel contain the request number and the
-    // serial number - see processCommandBuffer(). Copy them over too.
-    int pos = p.dataPosition();
+    response.iov_base = (void*)data;
+    response.iov_len = dataSize;
 
-    int numParams = p.readInt32();
-    if (s_callbacks.version < 4 && numParams > numParamsRilV3) {
-        Parcel p2;
-        p2.appendFrom(&p, 0, pos);
-        p2.writeInt32(numParamsRilV3);
-        p2.setDataPosition(pos);
-        dispatchStrings(p2, pRI);
-    } else {
-        p.setDataPosition(pos);
-        dispatchStrings(p, pRI);
-    }
+    return queueResponses(client, &response, 1);
 }
 
-// For backwards compatibility with RILs that dont support RIL_REQUEST_VOICE_RADIO_TECH.
-// When all RILs handle this request, this function can be removed and
-// the request can be sent directly to the RIL using dispatchVoid.
-static void dispatchVoiceRadioTech(Parcel& p, RequestInfo* pRI)
+/**
+ * Sends a response to one client, as long as the connection the
+ * response belongs to (epoch) is still open.
+ */
+static int sendResponseRaw(RilClient* client, uint32_t epoch,
+    const void* data, size_t dataSize)
 {
-    RIL_RadioState state = s_callbacks.onStateRequest();
+    int ret;
 
-    if ((RADIO_STATE_UNAVAILABLE == state) || (RADIO_STATE_OFF == state)) {
-        RIL_onRequestComplete(pRI, RIL_E_RADIO_NOT_AVAILABLE, NULL, 0);
+    if (dataSize > MAX_COMMAND_BYTES) {
+        RLOGE("RIL: packet larger than %u (%u)",
+            MAX_COMMAND_BYTES, (unsigned int)dataSize);
+
+        return -1;
     }
 
-    // RILs that support RADIO_STATE_ON should support this request.
-    if (RADIO_STATE_ON == state) {
-        dispatchVoid(p, pRI);
-        return;
+    pthread_mutex_lock(&s_writeMutex);
+
+    if (client->fd < 0 || client->epoch != epoch) {
+        pthread_mutex_unlock(&s_writeMutex);
+        RLOGD("RIL: client %d is gone, response dropped", client->id);
+        return -1;
     }
 
-    // For Older RILs, that do not support RADIO_STATE_ON, assume that they
-    // will not support this new request either and decode Voice Radio Technology
-    // from Radio State
-    voiceRadioTech = decodeVoiceRadioTechnology(state);
+    ret = queueResponse(client, data, dataSize);
 
-    if (voiceRadioTech < 0)
-        RIL_onRequestComplete(pRI, RIL_E_GENERIC_FAILURE, NULL, 0);
-    else
-        RIL_onRequestComplete(pRI, RIL_E_SUCCESS, &voiceRadioTech, sizeof(int));
+    pthread_mutex_unlock(&s_writeMutex);
+
+    return ret;
 }
 
-static void dispatchSetInitialAttachApn(Parcel& p, RequestInfo* pRI)
+/**
+ * Sends an unsolicited response to every client subscribed to it.
+ *
+ * Returns -1 if no client got it
+ */
+static int broadcastResponseRaw(int unsolResponseIndex, const void* data, size_t dataSize)
 {
-    RIL_InitialAttachApn pf;
-    int32_t t;
-    status_t status;
+    int delivered = 0;
+    int connected = 0;
 
-    memset(&pf, 0, sizeof(pf));
+    if (dataSize > MAX_COMMAND_BYTES) {
+        RLOGE("RIL: packet larger than %u (%u)",
+            MAX_COMMAND_BYTES, (unsigned int)dataSize);
 
-    pf.apn = strdupReadString(p);
-    pf.protocol = strdupReadString(p);
+        return -1;
+    }
 
-    status = p.readInt32(&t);
-    pf.authtype = (int)t;
+    pthread_mutex_lock(&s_writeMutex);
 
-    pf.username = strdupReadString(p);
-    pf.password = strdupReadString(p);
+    // each client has its own buffer, a slow one only fills its own
+    for (int i = 0; i < MAX_COMMAND_CLIENTS; i++) {
+        RilClient* client = &s_clients[i];
 
-    startRequest;
-    appendPrintBuf("%sapn=%s, protocol=%s, authtype=%d, username=%s, password=%s",
-        printBuf, pf.apn, pf.protocol, pf.authtype, pf.username, pf.password);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+        if (client->fd < 0) {
+            continue;
+        }
 
-    if (status != NO_ERROR) {
-        goto invalid;
+        connected++;
+        if (isUnsolWanted(client->unsolFilter, unsolResponseIndex)
+            && queueResponse(client, data, dataSize) == 0) {
+            delivered++;
+        }
     }
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &pf, sizeof(pf), pRI);
 
-#ifdef MEMSET_FREED
-    memsetString(pf.apn);
-    memsetString(pf.protocol);
-    memsetString(pf.username);
-    memsetString(pf.password);
-#endif
-
-    free(pf.apn);
-    free(pf.protocol);
-    free(pf.username);
-    free(pf.password);
+    pthread_mutex_unlock(&s_writeMutex);
 
-#ifdef MEMSET_FREED
-    memset(&pf, 0, sizeof(pf));
-#endif
+    if (delivered == 0) {
+        // clients filtering it out is no error
+        if (connected == 0) {
+            RLOGE("RIL: no valid fd for URC channel");
+        }
+        return -1;
+    }
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    return 0;
 }
 
-static void dispatchManualSelection(Parcel& p, RequestInfo* pRI)
+/* Called on the event loop once the client socket is writable */
+static void flushCommandOutput(RilClient* client)
 {
-    int32_t t;
-    status_t status;
-    RIL_NetworkOperator op;
-
-    RLOGD("dispatchManualSelection");
-    memset(&op, 0, sizeof(op));
-
-    op.operatorNumeric = strdupReadString(p);
-
-    status = p.readInt32(&t);
-    op.act = (RIL_RadioAccessNetworks)t;
-
-    startRequest;
-    appendPrintBuf("op=%s,act=%d", op.operatorNumeric, op.act);
-    closeRequest;
-    printRequest(pRI->token, pRI->pCI->requestNumber);
+    pthread_mutex_lock(&s_writeMutex);
 
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (outputBufferFlush(client) < 0) {
+        RLOGE("RIL Response: unexpected error on write to client %d errno: %d",
+            client->id, errno);
+        abortCommandOutput(client);
     }
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &op, sizeof(RIL_NetworkOperator), pRI);
+    if (client->output.count == 0) {
+        ril_event_set_events(&client->event, RIL_EVENT_READ);
+    }
 
-#ifdef MEMSET_FREED
-    memsetString(op.operatorNumeric);
-#endif
-    free(op.operatorNumeric);
+    pthread_mutex_unlock(&s_writeMutex);
+}
 
-#ifdef MEMSET_FREED
-    memset(&op, 0, sizeof(op));
-#endif
+static int sendResponse(RilClient* client, uint32_t epoch, Parcel& p)
+{
+    return sendResponseRaw(client, epoch, p.data(), p.dataSize());
+}
 
-    return;
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+static int broadcastResponse(int unsolResponseIndex, Parcel& p)
+{
+    return broadcastResponseRaw(unsolResponseIndex, p.data(), p.dataSize());
 }
 
-static void dispatchDataProfile(Parcel& p, RequestInfo* pRI)
+/* Keeps the encoded response for clients that connect later */
+static void storeStickyResponse(int unsolResponseIndex, Parcel& p)
 {
-    int32_t t;
-    status_t status;
-    int32_t num;
+    StickyResponse* sticky = &s_stickyResponses[unsolResponseIndex];
 
-    status = p.readInt32(&num);
-    if (status != NO_ERROR || num < 0) {
-        goto invalid;
+    pthread_mutex_lock(&s_writeMutex);
+
+    // the last subscriber went away while it was built
+    if (sticky->sticky == STICKY_LAST && !isUnsolWanted(s_unsolWanted, unsolResponseIndex)) {
+        pthread_mutex_unlock(&s_writeMutex);
+        return;
     }
 
-    {
-        RIL_DataProfileInfo* dataProfiles = (RIL_DataProfileInfo*)calloc(num, sizeof(RIL_DataProfileInfo));
-        if (dataProfiles == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            return;
-        }
-        RIL_DataProfileInfo** dataProfilePtrs = (RIL_DataProfileInfo**)calloc(num, sizeof(RIL_DataProfileInfo*));
-        if (dataProfilePtrs == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                requestToString(pRI->pCI->requestNumber));
-            free(dataProfiles);
+    if (p.dataSize() > sticky->capacity) {
+        uint8_t* data = (uint8_t*)realloc(sticky->data, p.dataSize());
+
+        if (data == NULL) {
+            // better nothing than a stale state
+            free(sticky->data);
+            sticky->data = NULL;
+            sticky->size = 0;
+            sticky->capacity = 0;
+            pthread_mutex_unlock(&s_writeMutex);
+            RLOGE("Memory allocation failed in storeStickyResponse");
             return;
         }
 
-        startRequest;
-        for (int i = 0; i < num; i++) {
-            dataProfilePtrs[i] = &dataProfiles[i];
-
-            status = p.readInt32(&t);
-            dataProfiles[i].profileId = (int)t;
+        sticky->data = data;
+        sticky->capacity = p.dataSize();
+    }
 
-            dataProfiles[i].apn = strdupReadString(p);
-            dataProfiles[i].protocol = strdupReadString(p);
-            status = p.readInt32(&t);
-            dataProfiles[i].authType = (int)t;
+    memcpy(sticky->data, p.data(), p.dataSize());
+    sticky->size = p.dataSize();
 
-            dataProfiles[i].user = strdupReadString(p);
-            dataProfiles[i].password = strdupReadString(p);
+    pthread_mutex_unlock(&s_writeMutex);
+}
 
-            status = p.readInt32(&t);
-            dataProfiles[i].type = (int)t;
+/* Drops an undelivered response once a newer one got through */
+static void clearStickyResponse(int unsolResponseIndex)
+{
+    pthread_mutex_lock(&s_writeMutex);
+    s_stickyResponses[unsolResponseIndex].size = 0;
+    pthread_mutex_unlock(&s_writeMutex);
+}
 
-            status = p.readInt32(&t);
-            dataProfiles[i].maxConnsTime = (int)t;
-            status = p.readInt32(&t);
-            dataProfiles[i].maxConns = (int)t;
-            status = p.readInt32(&t);
-            dataProfiles[i].waitTime = (int)t;
+/* Sends a newly connected client the stored sticky responses at once */
+static void replayStickyResponses(RilClient* client)
+{
+    struct iovec responses[MAX_RESPONSE_BATCH];
+    int count = 0;
 
-            status = p.readInt32(&t);
-            dataProfiles[i].enabled = (int)t;
+    pthread_mutex_lock(&s_writeMutex);
 
-            appendPrintBuf("%s [%d: profileId=%d, apn =%s, protocol =%s, authType =%d, \
-                    user =%s, password =%s, type =%d, maxConnsTime =%d, maxConns =%d, \
-                    waitTime =%d, enabled =%d]",
-                printBuf, i, dataProfiles[i].profileId,
-                dataProfiles[i].apn, dataProfiles[i].protocol, dataProfiles[i].authType,
-                dataProfiles[i].user, dataProfiles[i].password, dataProfiles[i].type,
-                dataProfiles[i].maxConnsTime, dataProfiles[i].maxConns,
-                dataProfiles[i].waitTime, dataProfiles[i].enabled);
-        }
-        closeRequest;
-        printRequest(pRI->token, pRI->pCI->requestNumber);
-        clearPrintBuf;
-        if (status != NO_ERROR) {
-            for (int i = 0; i < num; i++) {
-                free(dataProfiles[i].apn);
-                free(dataProfiles[i].protocol);
-                free(dataProfiles[i].user);
-                free(dataProfiles[i].password);
-            }
-            free(dataProfiles);
-            free(dataProfilePtrs);
-            goto invalid;
+    for (int i = 0; i < (int)NUM_ELEMS(s_stickyResponses) && client->fd >= 0; i++) {
+        if (s_stickyResponses[i].size == 0) {
+            continue;
         }
 
-        s_callbacks.onRequest(pRI->pCI->requestNumber,
-            dataProfilePtrs,
-            num * sizeof(RIL_DataProfileInfo*),
-            pRI);
+        responses[count].iov_base = s_stickyResponses[i].data;
+        responses[count].iov_len = s_stickyResponses[i].size;
 
-#ifdef MEMSET_FREED
-        memset(dataProfiles, 0, num * sizeof(RIL_DataProfileInfo));
-        memset(dataProfilePtrs, 0, num * sizeof(RIL_DataProfileInfo*));
-#endif
-        for (int i = 0; i < num; i++) {
-            free(dataProfiles[i].apn);
-            free(dataProfiles[i].protocol);
-            free(dataProfiles[i].user);
-            free(dataProfiles[i].password);
+        // queueResponses copies it, it is gone by the time the lock drops
+        if (s_stickyResponses[i].sticky == STICKY_UNDELIVERED) {
+            s_stickyResponses[i].size = 0;
+        }
+
+        if (++count == MAX_RESPONSE_BATCH) {
+            queueResponses(client, responses, count);
+            count = 0;
         }
-        free(dataProfiles);
-        free(dataProfilePtrs);
     }
 
-    return;
+    if (count > 0 && client->fd >= 0) {
+        queueResponses(client, responses, count);
+    }
 
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    pthread_mutex_unlock(&s_writeMutex);
 }
 
-static void dispatchConferenceInvite(Parcel& p, RequestInfo* pRI)
+static int64_t monotonicMs(void)
 {
-    RIL_ConferenceInvite cinfo;
-    int32_t t;
-    status_t status;
+    struct timespec ts;
 
-    RLOGD("dispatchConferenceInvite");
-    memset(&cinfo, 0, sizeof(RIL_ConferenceInvite));
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    status = p.readInt32(&t);
-    cinfo.nparticipants = (int)t;
+/**
+ * Returns true if no int of data moved by policy->hysteresis or more
+ * since the last accepted value.
+ * must be called with s_unsolThrottleMutex held
+ */
+static bool isWithinHysteresis(UnsolThrottle* t, const void* data, size_t datalen)
+{
+    const int* values = (const int*)data;
 
-    if (status != NO_ERROR) {
-        goto invalid;
+    if (data == NULL || t->baseline == NULL || datalen != t->baselineSize
+        || datalen % sizeof(int) != 0) {
+        return false;
     }
 
-    cinfo.numbers = strdupReadString(p);
-
-    if (!cinfo.numbers) {
-        goto invalid;
+    for (size_t i = 0; i < datalen / sizeof(int); i++) {
+        // INT_MAX is "unknown", moving from or to it is always a change
+        if ((values[i] == INT_MAX) != (t->baseline[i] == INT_MAX)
+            || llabs((int64_t)values[i] - t->baseline[i]) >= t->policy->hysteresis) {
+            return false;
+        }
     }
 
-    s_callbacks.onRequest(pRI->pCI->requestNumber, &cinfo, sizeof(RIL_ConferenceInvite), pRI);
+    return true;
+}
 
-#ifdef MEMSET_FREED
-    memsetString(cinfo.numbers);
-#endif
+/* must be called with s_unsolThrottleMutex held */
+static void setHysteresisBaseline(UnsolThrottle* t, const void* data, size_t datalen)
+{
+    if (datalen != t->baselineSize) {
+        free(t->baseline);
+        t->baseline = NULL;
+        t->baselineSize = 0;
+    }
 
-    free(cinfo.numbers);
-    return;
+    if (data == NULL || datalen == 0) {
+        return;
+    }
 
-invalid:
-    invalidCommandBlock(pRI);
-    return;
+    if (t->baseline == NULL) {
+        t->baseline = (int*)malloc(datalen);
+        if (t->baseline == NULL) {
+            return;
+        }
+        t->baselineSize = datalen;
+    }
+
+    memcpy(t->baseline, data, datalen);
 }
 
-static int blockingWrite(int fd, const void* buffer, size_t len)
+static void flushThrottledResponse(void* param)
 {
-    size_t writeOffset = 0;
-    const uint8_t* toWrite;
+    UnsolThrottle* t = (UnsolThrottle*)param;
 
-    toWrite = (const uint8_t*)buffer;
+    pthread_mutex_lock(&s_unsolThrottleMutex);
 
-    while (writeOffset < len) {
-        ssize_t written;
-        do {
-            written = write(fd, toWrite + writeOffset,
-                len - writeOffset);
-        } while (written < 0 && ((errno == EINTR) || (errno == EAGAIN)));
-
-        if (written >= 0) {
-            writeOffset += written;
-        } else { // written < 0
-            RLOGE("RIL Response: unexpected error on write errno: %d", errno);
-            close(fd);
-            return -1;
-        }
+    if (t->pending != NULL) {
+        broadcastResponseRaw(t->index, t->pending, t->pendingSize);
+        free(t->pending);
+        t->pending = NULL;
+        t->lastSent = monotonicMs();
     }
+    t->scheduled = false;
 
-    RLOGD("RIL Response bytes written: %zu", writeOffset);
-
-    return 0;
+    pthread_mutex_unlock(&s_unsolThrottleMutex);
 }
 
-static int sendResponseRaw(const void* data, size_t dataSize)
+/**
+ * Applies the s_unsolPolicies entry of an unsolicited response: it goes
+ * out right away, replaces the one already waiting (last value wins), is
+ * held until its window ends, or is dropped by the hysteresis.
+ *
+ * Returns -1 if it was sent right away and no client got it
+ */
+static int throttleUnsolicitedResponse(int unsolResponseIndex,
+    const void* data, size_t datalen, Parcel& p)
 {
-    int fd = s_fdCommand;
-    int ret;
-    uint32_t header;
+    UnsolThrottle* t = &s_unsolThrottles[unsolResponseIndex];
+    const UnsolPolicyInfo* policy = t->policy;
+    int64_t now = monotonicMs();
+    int64_t due;
+    int ret = 0;
 
-    if (s_fdCommand < 0) {
-        RLOGE("RIL: no valid fd for URC channel");
-        return -1;
+    pthread_mutex_lock(&s_unsolThrottleMutex);
+
+    if (policy->hysteresis > 0) {
+        if (isWithinHysteresis(t, data, datalen)) {
+            t->suppressed++;
+            pthread_mutex_unlock(&s_unsolThrottleMutex);
+            return 0;
+        }
+        setHysteresisBaseline(t, data, datalen);
     }
 
-    if (dataSize > MAX_COMMAND_BYTES) {
-        RLOGE("RIL: packet larger than %u (%u)",
-            MAX_COMMAND_BYTES, (unsigned int)dataSize);
+    if (t->scheduled) {
+        // the flush already scheduled sends whatever is latest
+        void* copy = malloc(p.dataSize());
 
-        return -1;
+        if (copy == NULL) {
+            // send this one now, the stale one must not follow it
+            free(t->pending);
+            t->pending = NULL;
+        } else {
+            memcpy(copy, p.data(), p.dataSize());
+            if (t->pending != NULL) {
+                t->coalesced++;
+            }
+            free(t->pending);
+            t->pending = copy;
+            t->pendingSize = p.dataSize();
+            pthread_mutex_unlock(&s_unsolThrottleMutex);
+            return 0;
+        }
     }
 
-    pthread_mutex_lock(&s_writeMutex);
-
-    header = htonl(dataSize);
+    due = now + policy->coalesceMs;
+    if (t->lastSent != 0 && t->lastSent + policy->minIntervalMs > due) {
+        due = t->lastSent + policy->minIntervalMs;
+    }
 
-    ret = blockingWrite(fd, (void*)&header, sizeof(header));
+    if (due > now && !t->scheduled) {
+        struct timeval delay;
 
-    if (ret < 0) {
-        pthread_mutex_unlock(&s_writeMutex);
-        return ret;
-    }
+        t->pending = malloc(p.dataSize());
+        if (t->pending != NULL) {
+            memcpy(t->pending, p.data(), p.dataSize());
+            t->pendingSize = p.dataSize();
 
-    ret = blockingWrite(fd, data, dataSize);
+            delay.tv_sec = (due - now) / 1000;
+            delay.tv_usec = ((due - now) % 1000) * 1000;
+            if (internalRequestTimedCallback(flushThrottledResponse, t, &delay, NULL) == 0) {
+                t->scheduled = true;
+                pthread_mutex_unlock(&s_unsolThrottleMutex);
+                return 0;
+            }
 
-    if (ret < 0) {
-        pthread_mutex_unlock(&s_writeMutex);
-        return ret;
+            free(t->pending);
+            t->pending = NULL;
+        }
     }
 
-    pthread_mutex_unlock(&s_writeMutex);
+    // nothing to wait for, or out of memory: send it now
+    ret = broadcastResponse(unsolResponseIndex, p);
+    t->lastSent = now;
 
-    return 0;
-}
+    pthread_mutex_unlock(&s_unsolThrottleMutex);
 
-static int sendResponse(Parcel& p)
-{
-    printResponse;
-    return sendResponseRaw(p.data(), p.dataSize());
+    return ret;
 }
 
 static int responseInts(Parcel& p, void* response, size_t responselen)
@@ -1565,13 +3966,9 @@ static int responseInts(Parcel& p, void* response, size_t responselen)
     p.writeInt32(numInts);
 
     /* each int*/
-    startResponse;
     for (int i = 0; i < numInts; i++) {
-        appendPrintBuf("%s%d,", printBuf, p_int[i]);
         p.writeInt32(p_int[i]);
     }
-    removeLastChar;
-    closeResponse;
 
     return 0;
 }
@@ -1609,13 +4006,9 @@ static int responseStrings(Parcel& p, void* response, size_t responselen)
         p.writeInt32(numStrings);
 
         /* each string*/
-        startResponse;
         for (int i = 0; i < numStrings; i++) {
-            appendPrintBuf("%s%s,", printBuf, (char*)p_cur[i]);
             writeStringToParcel(p, p_cur[i]);
         }
-        removeLastChar;
-        closeResponse;
     }
     return 0;
 }
@@ -1627,10 +4020,6 @@ static int responseStrings(Parcel& p, void* response, size_t responselen)
 static int responseString(Parcel& p, void* response, size_t responselen)
 {
     /* one string only */
-    startResponse;
-    appendPrintBuf("%s%s", printBuf, (char*)response);
-    closeResponse;
-
     writeStringToParcel(p, (const char*)response);
 
     return 0;
@@ -1638,8 +4027,6 @@ static int responseString(Parcel& p, void* response, size_t responselen)
 
 static int responseVoid(Parcel& p, void* response, size_t responselen)
 {
-    startResponse;
-    removeLastChar;
     return 0;
 }
 
@@ -1658,7 +4045,6 @@ static int responseCallList(Parcel& p, void* response, size_t responselen)
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    startResponse;
     /* number of call info's */
     num = responselen / sizeof(RIL_Call*);
     p.writeInt32(num);
@@ -1689,27 +4075,7 @@ static int responseCallList(Parcel& p, void* response, size_t responselen)
             p.writeInt32(uusInfo->uusLength);
             p.write(uusInfo->uusData, uusInfo->uusLength);
         }
-        appendPrintBuf("%s[id=%d,%s,toa=%d,",
-            printBuf,
-            p_cur->index,
-            callStateToString(p_cur->state),
-            p_cur->toa);
-        appendPrintBuf("%s%s,%s,als=%d,%s,%s,",
-            printBuf,
-            (p_cur->isMpty) ? "conf" : "norm",
-            (p_cur->isMT) ? "mt" : "mo",
-            p_cur->als,
-            (p_cur->isVoice) ? "voc" : "nonvoc",
-            (p_cur->isVoicePrivacy) ? "evp" : "noevp");
-        appendPrintBuf("%s%s,cli=%d,name='%s',%d]",
-            printBuf,
-            p_cur->number,
-            p_cur->numberPresentation,
-            p_cur->name,
-            p_cur->namePresentation);
-    }
-    removeLastChar;
-    closeResponse;
+    }
 
     return 0;
 }
@@ -1733,11 +4099,6 @@ static int responseSMS(Parcel& p, void* response, size_t responselen)
     writeStringToParcel(p, p_cur->ackPDU);
     p.writeInt32(p_cur->errorCode);
 
-    startResponse;
-    appendPrintBuf("%s%d,%s,%d", printBuf, p_cur->messageRef,
-        (char*)p_cur->ackPDU, p_cur->errorCode);
-    closeResponse;
-
     return 0;
 }
 
@@ -1758,7 +4119,6 @@ static int responseDataCallListV4(Parcel& p, void* response, size_t responselen)
     p.writeInt32(num);
 
     RIL_Data_Call_Response_v4* p_cur = (RIL_Data_Call_Response_v4*)response;
-    startResponse;
     int i;
     for (i = 0; i < num; i++) {
         p.writeInt32(p_cur[i].cid);
@@ -1766,14 +4126,7 @@ static int responseDataCallListV4(Parcel& p, void* response, size_t responselen)
         writeStringToParcel(p, p_cur[i].type);
         // apn is not used, so don't send.
         writeStringToParcel(p, p_cur[i].address);
-        appendPrintBuf("%s[cid=%d,%s,%s,%s],", printBuf,
-            p_cur[i].cid,
-            (p_cur[i].active == 0) ? "down" : "up",
-            (char*)p_cur[i].type,
-            (char*)p_cur[i].address);
     }
-    removeLastChar;
-    closeResponse;
 
     return 0;
 }
@@ -1801,7 +4154,6 @@ static int responseDataCallList(Parcel& p, void* response, size_t responselen)
         p.writeInt32(num);
 
         RIL_Data_Call_Response_v11* p_cur = (RIL_Data_Call_Response_v11*)response;
-        startResponse;
         int i;
         for (i = 0; i < num; i++) {
             p.writeInt32((int)p_cur[i].status);
@@ -1815,21 +4167,7 @@ static int responseDataCallList(Parcel& p, void* response, size_t responselen)
             writeStringToParcel(p, p_cur[i].gateways);
             writeStringToParcel(p, p_cur[i].pcscf);
             p.writeInt32(p_cur[i].mtu);
-            appendPrintBuf("%s[status=%d,retry=%d,cid=%d,%s,%s,%s,%s,%s,%s],", printBuf,
-                p_cur[i].status,
-                p_cur[i].suggestedRetryTime,
-                p_cur[i].cid,
-                (p_cur[i].active == 0) ? "down" : "up",
-                (char*)p_cur[i].type,
-                (char*)p_cur[i].ifname,
-                (char*)p_cur[i].addresses,
-                (char*)p_cur[i].dnses,
-                (char*)p_cur[i].gateways,
-                (char*)p_cur[i].pcscf,
-                p_cur[i].mtu);
-        }
-        removeLastChar;
-        closeResponse;
+        }
     }
 
     return 0;
@@ -1880,11 +4218,6 @@ static int responseSIM_IO(Parcel& p, void* response, size_t responselen)
     p.writeInt32(p_cur->sw2);
     writeStringToParcel(p, p_cur->simResponse);
 
-    startResponse;
-    appendPrintBuf("%ssw1=0x%X,sw2=0x%X,%s", printBuf, p_cur->sw1, p_cur->sw2,
-        (char*)p_cur->simResponse);
-    closeResponse;
-
     return 0;
 }
 
@@ -1907,7 +4240,6 @@ static int responseCallForwards(Parcel& p, void* response, size_t responselen)
     num = responselen / sizeof(RIL_CallForwardInfo*);
     p.writeInt32(num);
 
-    startResponse;
     for (int i = 0; i < num; i++) {
         RIL_CallForwardInfo* p_cur = ((RIL_CallForwardInfo**)response)[i];
 
@@ -1917,14 +4249,7 @@ static int responseCallForwards(Parcel& p, void* response, size_t responselen)
         p.writeInt32(p_cur->toa);
         writeStringToParcel(p, p_cur->number);
         p.writeInt32(p_cur->timeSeconds);
-        appendPrintBuf("%s[%s,reason=%d,cls=%d,toa=%d,%s,tout=%d],", printBuf,
-            (p_cur->status == 1) ? "enable" : "disable",
-            p_cur->reason, p_cur->serviceClass, p_cur->toa,
-            (char*)p_cur->number,
-            p_cur->timeSeconds);
     }
-    removeLastChar;
-    closeResponse;
 
     return 0;
 }
@@ -1949,13 +4274,6 @@ static int responseSsn(Parcel& p, void* response, size_t responselen)
     p.writeInt32(p_cur->type);
     writeStringToParcel(p, p_cur->number);
 
-    startResponse;
-    appendPrintBuf("%s%s,code=%d,id=%d,type=%d,%s", printBuf,
-        (p_cur->notificationType == 0) ? "mo" : "mt",
-        p_cur->code, p_cur->index, p_cur->type,
-        (char*)p_cur->number);
-    closeResponse;
-
     return 0;
 }
 
@@ -1974,7 +4292,6 @@ static int responseCellList(Parcel& p, void* response, size_t responselen)
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    startResponse;
     /* number of records */
     num = responselen / sizeof(RIL_NeighboringCell*);
     p.writeInt32(num);
@@ -1984,12 +4301,7 @@ static int responseCellList(Parcel& p, void* response, size_t responselen)
 
         p.writeInt32(p_cur->rssi);
         writeStringToParcel(p, p_cur->cid);
-
-        appendPrintBuf("%s[cid=%s,rssi=%d],", printBuf,
-            p_cur->cid, p_cur->rssi);
     }
-    removeLastChar;
-    closeResponse;
 
     return 0;
 }
@@ -2049,54 +4361,23 @@ static int responseRilSignalStrength(Parcel& p,
             p.writeInt32(INT_MAX);
             p.writeInt32(INT_MAX);
         }
-
-        startResponse;
-        appendPrintBuf("%s[signalStrength=%d,bitErrorRate=%d,\
-                CDMA_SS.dbm=%d,CDMA_SSecio=%d,\
-                EVDO_SS.dbm=%d,EVDO_SS.ecio=%d,\
-                EVDO_SS.signalNoiseRatio=%d,\
-                LTE_SS.signalStrength=%d,LTE_SS.rsrp=%d,LTE_SS.rsrq=%d,\
-                LTE_SS.rssnr=%d,LTE_SS.cqi=%d]",
-            printBuf,
-            p_cur->GW_SignalStrength.signalStrength,
-            p_cur->GW_SignalStrength.bitErrorRate,
-            p_cur->CDMA_SignalStrength.dbm,
-            p_cur->CDMA_SignalStrength.ecio,
-            p_cur->EVDO_SignalStrength.dbm,
-            p_cur->EVDO_SignalStrength.ecio,
-            p_cur->EVDO_SignalStrength.signalNoiseRatio,
-            p_cur->LTE_SignalStrength.signalStrength,
-            p_cur->LTE_SignalStrength.rsrp,
-            p_cur->LTE_SignalStrength.rsrq,
-            p_cur->LTE_SignalStrength.rssnr,
-            p_cur->LTE_SignalStrength.cqi);
-        closeResponse;
-
     } else if (responselen % sizeof(int) == 0) {
         // Old RIL deprecated
         int* p_cur = (int*)response;
 
-        startResponse;
-
         // With the Old RIL we see one or 2 integers.
         size_t num = responselen / sizeof(int); // Number of integers from ril
         size_t totalIntegers = 7; // Number of integers in RIL_SignalStrength
         size_t i;
 
-        appendPrintBuf("%s[", printBuf);
         for (i = 0; i < num; i++) {
-            appendPrintBuf("%s %d", printBuf, *p_cur);
             p.writeInt32(*p_cur++);
         }
-        appendPrintBuf("%s]", printBuf);
 
         // Fill the remainder with zero's.
         for (; i < totalIntegers; i++) {
             p.writeInt32(0);
         }
-
-        closeResponse;
-
     } else {
         RLOGE("invalid response length \n");
         return RIL_ERRNO_INVALID_RESPONSE;
@@ -2117,30 +4398,17 @@ static int responseSimRefresh(Parcel& p, void* response, size_t responselen)
         return 0;
     }
 
-    startResponse;
     if (s_callbacks.version == 7) {
         RIL_SimRefreshResponse_v7* p_cur = ((RIL_SimRefreshResponse_v7*)response);
         p.writeInt32(p_cur->result);
         p.writeInt32(p_cur->ef_id);
         writeStringToParcel(p, p_cur->aid);
-
-        appendPrintBuf("%sresult=%d, ef_id=%d, aid=%s",
-            printBuf,
-            p_cur->result,
-            p_cur->ef_id,
-            p_cur->aid);
     } else {
         int* p_cur = ((int*)response);
         p.writeInt32(p_cur[0]);
         p.writeInt32(p_cur[1]);
         writeStringToParcel(p, NULL);
-
-        appendPrintBuf("%sresult=%d, ef_id=%d",
-            printBuf,
-            p_cur[0],
-            p_cur[1]);
     }
-    closeResponse;
 
     return 0;
 }
@@ -2162,26 +4430,14 @@ static int responseCellInfoList(Parcel& p, void* response, size_t responselen)
     p.writeInt32(num);
 
     RIL_CellInfo* p_cur = (RIL_CellInfo*)response;
-    startResponse;
     int i;
     for (i = 0; i < num; i++) {
-        appendPrintBuf("%s[%d: type=%d,registered=%d,timeStampType=%d,timeStamp=%lld", printBuf, i,
-            p_cur->cellInfoType, p_cur->registered, p_cur->timeStampType, p_cur->timeStamp);
         p.writeInt32((int)p_cur->cellInfoType);
         p.writeInt32(p_cur->registered);
         p.writeInt32(p_cur->timeStampType);
         p.writeInt64(p_cur->timeStamp);
         switch (p_cur->cellInfoType) {
         case RIL_CELL_INFO_TYPE_GSM: {
-            appendPrintBuf("%s GSM id: mcc=%d,mnc=%d,lac=%d,cid=%d,", printBuf,
-                p_cur->CellInfo.gsm.cellIdentityGsm.mcc,
-                p_cur->CellInfo.gsm.cellIdentityGsm.mnc,
-                p_cur->CellInfo.gsm.cellIdentityGsm.lac,
-                p_cur->CellInfo.gsm.cellIdentityGsm.cid);
-            appendPrintBuf("%s gsmSS: ss=%d,ber=%d],", printBuf,
-                p_cur->CellInfo.gsm.signalStrengthGsm.signalStrength,
-                p_cur->CellInfo.gsm.signalStrengthGsm.bitErrorRate);
-
             p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mcc);
             p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mnc);
             p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.lac);
@@ -2191,16 +4447,6 @@ static int responseCellInfoList(Parcel& p, void* response, size_t responselen)
             break;
         }
         case RIL_CELL_INFO_TYPE_WCDMA: {
-            appendPrintBuf("%s WCDMA id: mcc=%d,mnc=%d,lac=%d,cid=%d,psc=%d,", printBuf,
-                p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc,
-                p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc,
-                p_cur->CellInfo.wcdma.cellIdentityWcdma.lac,
-                p_cur->CellInfo.wcdma.cellIdentityWcdma.cid,
-                p_cur->CellInfo.wcdma.cellIdentityWcdma.psc);
-            appendPrintBuf("%s wcdmaSS: ss=%d,ber=%d],", printBuf,
-                p_cur->CellInfo.wcdma.signalStrengthWcdma.signalStrength,
-                p_cur->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate);
-
             p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc);
             p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc);
             p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.lac);
@@ -2211,26 +4457,12 @@ static int responseCellInfoList(Parcel& p, void* response, size_t responselen)
             break;
         }
         case RIL_CELL_INFO_TYPE_LTE: {
-            appendPrintBuf("%s LTE id: mcc=%d,mnc=%d,ci=%d,pci=%d,tac=%d", printBuf,
-                p_cur->CellInfo.lte.cellIdentityLte.mcc,
-                p_cur->CellInfo.lte.cellIdentityLte.mnc,
-                p_cur->CellInfo.lte.cellIdentityLte.ci,
-                p_cur->CellInfo.lte.cellIdentityLte.pci,
-                p_cur->CellInfo.lte.cellIdentityLte.tac);
-
             p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mcc);
             p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mnc);
             p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.ci);
             p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.pci);
             p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.tac);
 
-            appendPrintBuf("%s lteSS: ss=%d,rsrp=%d,rsrq=%d,rssnr=%d,cqi=%d,ta=%d", printBuf,
-                p_cur->CellInfo.lte.signalStrengthLte.signalStrength,
-                p_cur->CellInfo.lte.signalStrengthLte.rsrp,
-                p_cur->CellInfo.lte.signalStrengthLte.rsrq,
-                p_cur->CellInfo.lte.signalStrengthLte.rssnr,
-                p_cur->CellInfo.lte.signalStrengthLte.cqi,
-                p_cur->CellInfo.lte.signalStrengthLte.timingAdvance);
             p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.signalStrength);
             p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrp);
             p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrq);
@@ -2244,8 +4476,6 @@ static int responseCellInfoList(Parcel& p, void* response, size_t responselen)
         }
         p_cur += 1;
     }
-    removeLastChar;
-    closeResponse;
 
     return 0;
 }
@@ -2256,9 +4486,21 @@ static void triggerEvLoop(void)
     /* trigger event loop to wakeup. No reason to do this,
      * if we're in the event loop thread */
     if (!pthread_equal(pthread_self(), s_tid_dispatch)) {
+        if (__atomic_exchange_n(&s_wakeupPending, true, __ATOMIC_ACQ_REL)) {
+            // the loop has not consumed the previous wakeup yet
+            return;
+        }
+#if RIL_EVENT_USE_EVENTFD
+        uint64_t one = 1;
+
+        do {
+            ret = write(s_fdWakeupWrite, &one, sizeof(one));
+        } while (ret < 0 && errno == EINTR);
+#else
         do {
             ret = write(s_fdWakeupWrite, " ", 1);
         } while (ret < 0 && errno == EINTR);
+#endif
     }
 }
 
@@ -2271,7 +4513,6 @@ static void rilEventAddWakeup(struct ril_event* ev)
 static void sendSimStatusAppInfo(Parcel& p, int num_apps, RIL_AppStatus appStatus[])
 {
     p.writeInt32(num_apps);
-    startResponse;
     for (int i = 0; i < num_apps; i++) {
         p.writeInt32(appStatus[i].app_type);
         p.writeInt32(appStatus[i].app_state);
@@ -2281,19 +4522,7 @@ static void sendSimStatusAppInfo(Parcel& p, int num_apps, RIL_AppStatus appStatu
         p.writeInt32(appStatus[i].pin1_replaced);
         p.writeInt32(appStatus[i].pin1);
         p.writeInt32(appStatus[i].pin2);
-        appendPrintBuf("%s[app_type=%d,app_state=%d,perso_substate=%d,\
-                    aid_ptr=%s,app_label_ptr=%s,pin1_replaced=%d,pin1=%d,pin2=%d],",
-            printBuf,
-            appStatus[i].app_type,
-            appStatus[i].app_state,
-            appStatus[i].perso_substate,
-            appStatus[i].aid_ptr,
-            appStatus[i].app_label_ptr,
-            appStatus[i].pin1_replaced,
-            appStatus[i].pin1,
-            appStatus[i].pin2);
     }
-    closeResponse;
 }
 
 static int responseSimStatus(Parcel& p, void* response, size_t responselen)
@@ -2339,7 +4568,6 @@ static int responseGsmBrSmsCnf(Parcel& p, void* response, size_t responselen)
     int num = responselen / sizeof(RIL_GSM_BroadcastSmsConfigInfo*);
     p.writeInt32(num);
 
-    startResponse;
     RIL_GSM_BroadcastSmsConfigInfo** p_cur = (RIL_GSM_BroadcastSmsConfigInfo**)response;
     for (int i = 0; i < num; i++) {
         p.writeInt32(p_cur[i]->fromServiceId);
@@ -2347,14 +4575,7 @@ static int responseGsmBrSmsCnf(Parcel& p, void* response, size_t responselen)
         p.writeInt32(p_cur[i]->fromCodeScheme);
         p.writeInt32(p_cur[i]->toCodeScheme);
         p.writeInt32(p_cur[i]->selected);
-
-        appendPrintBuf("%s [%d: fromServiceId=%d, toServiceId=%d, \
-                fromCodeScheme=%d, toCodeScheme=%d, selected =%d]",
-            printBuf, i, p_cur[i]->fromServiceId, p_cur[i]->toServiceId,
-            p_cur[i]->fromCodeScheme, p_cur[i]->toCodeScheme,
-            p_cur[i]->selected);
     }
-    closeResponse;
 
     return 0;
 }
@@ -2379,14 +4600,6 @@ static int responseActivityData(Parcel& p, void* response, size_t responselen)
     }
     p.writeInt32(p_cur->rx_mode_time_ms);
 
-    startResponse;
-    appendPrintBuf("Modem activity info received: sleep_mode_time_ms %d idle_mode_time_ms %d \
-                  tx_mode_time_ms %d %d %d %d %d and rx_mode_time_ms %d",
-        p_cur->sleep_mode_time_ms, p_cur->idle_mode_time_ms, p_cur->tx_mode_time_ms[0],
-        p_cur->tx_mode_time_ms[1], p_cur->tx_mode_time_ms[2], p_cur->tx_mode_time_ms[3],
-        p_cur->tx_mode_time_ms[4], p_cur->rx_mode_time_ms);
-    closeResponse;
-
     return 0;
 }
 
@@ -2397,117 +4610,601 @@ static int responseActivityData(Parcel& p, void* response, size_t responselen)
  */
 static void processWakeupCallback(int fd, short flags, void* param)
 {
-    char buff[16];
     int ret;
 
+    /* re-enable wakeups before draining, so none are lost */
+    __atomic_store_n(&s_wakeupPending, false, __ATOMIC_RELEASE);
+
+#if RIL_EVENT_USE_EVENTFD
+    uint64_t count;
+
+    /* a single read resets the eventfd counter */
+    do {
+        ret = read(s_fdWakeupRead, &count, sizeof(count));
+    } while (ret < 0 && errno == EINTR);
+#else
+    char buff[16];
+
     /* empty our wakeup socket out */
     do {
         ret = read(s_fdWakeupRead, &buff, sizeof(buff));
     } while (ret > 0 || (ret < 0 && errno == EINTR));
+#endif
 }
 
-static void onCommandsSocketClosed(void)
+static void onCommandsSocketClosed(RilClient* client)
 {
     int ret = 0;
-    RequestInfo* p_cur;
 
     (void)ret;
 
-    /* mark pending requests as "cancelled" so we dont report responses */
     ret = pthread_mutex_lock(&s_pendingRequestsMutex);
     assert(ret == 0);
 
-    p_cur = s_pendingRequests;
-
-    for (p_cur = s_pendingRequests; p_cur != NULL; p_cur = p_cur->p_next) {
-        p_cur->cancelled = 1;
-    }
+    RLOGD("client %d closed, %d clients left", client->id, s_numClients);
+    RLOGD("requests in flight: %d queued, %d dispatched, %d attached, %d expired",
+        s_requestStateCounts[REQUEST_QUEUED],
+        s_requestStateCounts[REQUEST_DISPATCHED],
+        s_requestStateCounts[REQUEST_ATTACHED],
+        s_requestStateCounts[REQUEST_EXPIRED]);
+    RLOGD("request pool: %u hits, %u misses, peak %d",
+        s_requestPoolStats.hits, s_requestPoolStats.misses,
+        s_requestPoolStats.peak);
 
     ret = pthread_mutex_unlock(&s_pendingRequestsMutex);
     assert(ret == 0);
+
+    pthread_mutex_lock(&s_timedCallbackMutex);
+    RLOGD("timed callback pool: %u hits, %u misses, peak %d",
+        s_timedCallbackPoolStats.hits, s_timedCallbackPoolStats.misses,
+        s_timedCallbackPoolStats.peak);
+    pthread_mutex_unlock(&s_timedCallbackMutex);
+
+#if RIL_DISPATCH_WORKERS > 0
+    pthread_mutex_lock(&s_requestPayloadMutex);
+    RLOGD("request payload pool: %u hits, %u misses, peak %d",
+        s_requestPayloadPoolStats.hits, s_requestPayloadPoolStats.misses,
+        s_requestPayloadPoolStats.peak);
+    pthread_mutex_unlock(&s_requestPayloadMutex);
+#endif
+
+    pthread_mutex_lock(&s_unsolThrottleMutex);
+    for (int i = 0; i < (int)NUM_ELEMS(s_unsolThrottles); i++) {
+        UnsolThrottle* t = &s_unsolThrottles[i];
+
+        if (t->policy != NULL) {
+            RLOGD("%s: %u coalesced, %u suppressed",
+                requestToString(t->policy->requestNumber), t->coalesced, t->suppressed);
+        }
+    }
+    pthread_mutex_unlock(&s_unsolThrottleMutex);
+}
+
+#if RIL_SHM_TRANSPORT
+/**
+ * Stops using the shared ring of a client that corrupted it and hangs up
+ * its socket, processCommandsCallback() then cleans up the connection
+ */
+static void failSharedRing(RilClient* client)
+{
+    RLOGE("RIL: client %d corrupted its shared ring, disconnecting", client->id);
+
+    ril_event_del(&client->shmEvent);
+
+    pthread_mutex_lock(&s_writeMutex);
+    releaseSharedRing(client);
+    pthread_mutex_unlock(&s_writeMutex);
+
+    shutdown(client->fd, SHUT_RDWR);
+}
+
+/* Runs the requests a client wrote to its toRil ring */
+static void processSharedRingCallback(int fd, short flags, void* param)
+{
+    RilClient* client = (RilClient*)param;
+    uint64_t counter;
+    int processed = 0;
+    int ret;
+
+    /* a single read resets the eventfd counter */
+    if (read(fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+        RLOGE("error on reading the shared ring eventfd errno: %d", errno);
+    }
+
+    do {
+        void* record;
+        size_t len;
+
+        while ((ret = ril_shm_ring_peek(&client->toRil, &record, &len)) > 0) {
+            if (len > sizeof(s_packetBuffer)) {
+                RLOGE("request larger than %u", MAX_COMMAND_BYTES);
+                ril_shm_ring_consume(&client->toRil, len);
+            } else {
+                // the client can still write to the ring, parse a copy
+                memcpy(s_packetBuffer, record, len);
+                ril_shm_ring_consume(&client->toRil, len);
+                processCommandBuffer(client, s_packetBuffer, len);
+            }
+
+            if (++processed == MAX_COMMAND_BATCH) {
+                // let the other events in, the eventfd brings us back
+                counter = 1;
+                if (write(fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+                    RLOGE("error on rearming the shared ring eventfd errno: %d", errno);
+                }
+                return;
+            }
+        }
+
+        if (ret < 0) {
+            failSharedRing(client);
+            return;
+        }
+    } while (!ril_shm_ring_prepare_wait(&client->toRil));
+}
+#endif
+
+/**
+ * Receives one request from a SOCK_SEQPACKET socket, the kernel keeps
+ * the boundaries so no reassembly is needed.
+ *
+ * Returns 1 with p_record set, 0 on end of stream, -1 on error
+ */
+static int recvCommandPacket(int fd, struct iovec* p_record)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t len;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = s_packetBuffer;
+    iov.iov_len = sizeof(s_packetBuffer);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    // requests are never empty, 0 is the end of stream
+    len = recvmsg(fd, &msg, 0);
+    if (len <= 0) {
+        return len;
+    }
+
+    if (msg.msg_flags & MSG_TRUNC) {
+        RLOGE("request larger than %u", MAX_COMMAND_BYTES);
+        errno = EFBIG;
+        return -1;
+    }
+
+    p_record->iov_base = s_packetBuffer;
+    p_record->iov_len = len;
+
+    return 1;
 }
 
 static void processCommandsCallback(int fd, short flags, void* param)
 {
-    RecordStream* p_rs;
-    void* p_record;
-    size_t recordlen;
+    RilClient* client;
+    struct iovec records[MAX_COMMAND_BATCH];
     int ret;
 
-    assert(fd == s_fdCommand);
+    client = (RilClient*)param;
+
+    assert(fd == client->fd);
+
+    if (flags & RIL_EVENT_WRITE) {
+        flushCommandOutput(client);
+    }
+
+    if (!(flags & RIL_EVENT_READ)) {
+        return;
+    }
+
+    for (;;) {
+        /* loop until EAGAIN/EINTR, end of stream, or other error */
+        if (s_seqPacket) {
+            ret = recvCommandPacket(fd, records);
+        } else {
+            ret = record_stream_get_batch(client->p_rs, records, NUM_ELEMS(records));
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        for (int i = 0; i < ret; i++) {
+            processCommandBuffer(client, records[i].iov_base, records[i].iov_len);
+        }
+    }
+
+    if (ret == 0 || !(errno == EAGAIN || errno == EINTR)) {
+        /* fatal error or end-of-stream */
+        if (ret != 0) {
+            RLOGE("error on reading command socket errno: %d\n", errno);
+        } else {
+            RLOGW("EOS.  Closing command socket.");
+        }
+
+#if RIL_SHM_TRANSPORT
+        if (client->shm != NULL) {
+            ril_event_del(&client->shmEvent);
+        }
+#endif
+
+        /* pending requests of this connection are now "cancelled",
+         * so we dont report responses, and responses still queued
+         * have nowhere to go */
+        pthread_mutex_lock(&s_pendingRequestsMutex);
+        pthread_mutex_lock(&s_writeMutex);
+        outputBufferReset(&client->output);
+#if RIL_SHM_TRANSPORT
+        releaseSharedRing(client);
+#endif
+        client->fd = -1;
+        client->epoch++;
+        updateUnsolWanted();
+        pthread_mutex_unlock(&s_writeMutex);
+        pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+        ril_event_del(&client->event);
+        close(fd);
+
+        if (client->p_rs != NULL) {
+            record_stream_free(client->p_rs);
+            client->p_rs = NULL;
+        }
+
+        /* start listening for new connections again */
+        if (s_numClients-- == MAX_COMMAND_CLIENTS) {
+            rilEventAddWakeup(&s_listen_event);
+        }
+
+        onCommandsSocketClosed(client);
+    }
+}
+
+static void onNewCommandConnect(RilClient* client)
+{
+    // Inform we are connected and the ril version
+    int rilVer = s_callbacks.version;
+    RLOGD("RIL_UNSOL_RIL_CONNECTED message send");
+    sendUnsolicitedResponse(client, RIL_UNSOL_RIL_CONNECTED, &rilVer, sizeof(rilVer));
+
+    // implicit radio state changed
+    RLOGD("RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED message send");
+    sendUnsolicitedResponse(client, RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0);
+
+    // the last state the client would otherwise have to poll for
+    replayStickyResponses(client);
+}
+
+/* Text dumped on the debug socket, built before anything is written */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} DebugText;
+
+static void debugAppend(DebugText* t, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(t->data + t->len, t->capacity - t->len, fmt, ap);
+        va_end(ap);
+
+        if (n < 0) {
+            return;
+        }
+
+        if (t->len + n < t->capacity) {
+            t->len += n;
+            return;
+        }
+
+        size_t capacity = t->capacity ? t->capacity * 2 : 4096;
+        while (capacity <= t->len + n) {
+            capacity *= 2;
+        }
+
+        char* data = (char*)realloc(t->data, capacity);
+        if (data == NULL) {
+            return;
+        }
+        t->data = data;
+        t->capacity = capacity;
+    }
+}
+
+static const char* requestStateToString(RequestState state)
+{
+    switch (state) {
+    case REQUEST_QUEUED:
+        return "queued";
+    case REQUEST_DISPATCHED:
+        return "dispatched";
+    case REQUEST_COMPLETING:
+        return "completing";
+    case REQUEST_ATTACHED:
+        return "attached";
+    case REQUEST_EXPIRED:
+        return "expired";
+    default:
+        return "free";
+    }
+}
+
+/* must be called with s_pendingRequestsMutex held */
+static void dumpPendingRequest(DebugText* t, RequestInfo* pRI, uint64_t now)
+{
+    if (pRI->state == REQUEST_FREE) {
+        return;
+    }
+
+    debugAppend(t, "[%04d] client %d %-40s %-10s",
+        pRI->token, pRI->client != NULL ? pRI->client->id : -1,
+        requestToString(pRI->pCI->requestNumber), requestStateToString(pRI->state));
+#if RIL_LATENCY_TRACE_SIZE > 0
+    if (pRI->enqueueNs != 0) {
+        debugAppend(t, " age %llums", (unsigned long long)((now - pRI->enqueueNs) / 1000000));
+    }
+    if (pRI->dispatchNs != 0) {
+        debugAppend(t, " in vendor RIL %llums",
+            (unsigned long long)((now - pRI->dispatchNs) / 1000000));
+    }
+#endif
+    debugAppend(t, "\n");
+}
+
+static void dumpPendingRequests(DebugText* t)
+{
+    uint64_t now = ril_nano_time();
+
+    debugAppend(t, "requests in flight:\n");
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+
+    for (int i = 0; i < s_pendingRequestSlots; i++) {
+        dumpPendingRequest(t, &s_pendingRequestChunks[i / PENDING_REQUESTS_CHUNK]
+                                                     [i % PENDING_REQUESTS_CHUNK],
+            now);
+    }
+
+    for (int i = 0; i < s_usedOverflowRequests; i++) {
+        if (s_overflowRequests[i].pRI != NULL) {
+            dumpPendingRequest(t, s_overflowRequests[i].pRI, now);
+        }
+    }
+
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+}
+
+#if RIL_LATENCY_TRACE_SIZE > 0
+static int compareLatencyRecords(const void* a, const void* b)
+{
+    return ((const LatencyRecord*)a)->requestNumber - ((const LatencyRecord*)b)->requestNumber;
+}
+
+static int compareUint32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Appends p50/p99/max of the n samples, sorting them */
+static void dumpPercentiles(DebugText* t, uint32_t* samples, size_t n)
+{
+    qsort(samples, n, sizeof(uint32_t), compareUint32);
+    debugAppend(t, " %8u %8u %8u", samples[(n - 1) * 50 / 100],
+        samples[(n - 1) * 99 / 100], samples[n - 1]);
+}
+
+/**
+ * Summarizes the requests in the latency ring by request type, in us:
+ * queue is the wait for a dispatch worker, call the time spent inside
+ * onRequest and vendor the time until RIL_onRequestComplete.
+ */
+static void dumpLatencyStats(DebugText* t)
+{
+    LatencyRecord* records;
+    uint32_t* samples;
+    uint32_t head;
+    size_t count = 0;
+
+    records = (LatencyRecord*)malloc(RIL_LATENCY_TRACE_SIZE * sizeof(LatencyRecord));
+    samples = (uint32_t*)malloc(RIL_LATENCY_TRACE_SIZE * sizeof(uint32_t));
+    if (records == NULL || samples == NULL) {
+        free(records);
+        free(samples);
+        return;
+    }
+
+    head = __atomic_load_n(&s_latencyHead, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < RIL_LATENCY_TRACE_SIZE; i++) {
+        LatencyRecord* r = &s_latencyRing[i];
+        uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == 0 || (seq & 1) != 0) {
+            continue;
+        }
+
+        memcpy(&records[count], r, sizeof(LatencyRecord));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        // rewritten while we copied it
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        count++;
+    }
+
+    qsort(records, count, sizeof(LatencyRecord), compareLatencyRecords);
+
+    debugAppend(t, "latency of the last %u of %u requests, us:\n",
+        (unsigned int)count, head);
+    debugAppend(t, "%-40s %6s %6s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+        "request", "count", "errors", "queue50", "queue99", "queueMax",
+        "call50", "call99", "callMax", "vendor50", "vendor99", "vendorMax");
+
+    for (size_t first = 0, last; first < count; first = last) {
+        unsigned int errors = 0;
+        size_t n;
+
+        for (last = first; last < count
+             && records[last].requestNumber == records[first].requestNumber;
+             last++) {
+            if (records[last].error != RIL_E_SUCCESS) {
+                errors++;
+            }
+        }
+        n = last - first;
+
+        debugAppend(t, "%-40s %6u %6u", requestToString(records[first].requestNumber),
+            (unsigned int)n, errors);
+
+        for (size_t i = 0; i < n; i++) {
+            LatencyRecord* r = &records[first + i];
+            samples[i] = r->dispatchNs > r->enqueueNs ? (r->dispatchNs - r->enqueueNs) / 1000 : 0;
+        }
+        dumpPercentiles(t, samples, n);
+
+        for (size_t i = 0; i < n; i++) {
+            LatencyRecord* r = &records[first + i];
+            // completed before onRequest returned
+            uint64_t end = r->returnNs != 0 ? r->returnNs : r->completeNs;
+            samples[i] = (end - r->dispatchNs) / 1000;
+        }
+        dumpPercentiles(t, samples, n);
+
+        for (size_t i = 0; i < n; i++) {
+            LatencyRecord* r = &records[first + i];
+            samples[i] = (r->completeNs - r->dispatchNs) / 1000;
+        }
+        dumpPercentiles(t, samples, n);
+
+        debugAppend(t, "\n");
+    }
+
+    free(records);
+    free(samples);
+}
+#endif
+
+/**
+ * Dumps the request state to a debug socket client, off the event loop.
+ * A client that sends "trace" first gets the binary trace instead, see
+ * ril_trace.h, one that sends "id <request name>" gets its number.
+ */
+static void* debugSessionLoop(void* param)
+{
+    DebugText text = { NULL, 0, 0 };
+    struct timeval timeout = { 1, 0 };
+    struct pollfd pfd;
+    char command[64] = "";
+    int fdDebug = (int)(intptr_t)param;
+    size_t offset = 0;
 
-    p_rs = (RecordStream*)param;
+    // a stuck reader only holds up this thread, and not for long
+    setsockopt(fdDebug, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
 
-    for (;;) {
-        /* loop until EAGAIN/EINTR, end of stream, or other error */
-        ret = record_stream_get_next(p_rs, &p_record, &recordlen);
+    pfd.fd = fdDebug;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, DEBUG_COMMAND_TIMEOUT_MS) > 0) {
+        ssize_t len = read(fdDebug, command, sizeof(command) - 1);
 
-        if (ret == 0 && p_record == NULL) {
-            /* end-of-stream */
-            break;
-        } else if (ret < 0) {
-            break;
-        } else if (ret == 0) { /* && p_record != NULL */
-            processCommandBuffer(p_record, recordlen);
-        }
+        command[len > 0 ? len : 0] = '\0';
     }
 
-    if (ret == 0 || !(errno == EAGAIN || errno == EINTR)) {
-        /* fatal error or end-of-stream */
-        if (ret != 0) {
-            RLOGE("error on reading command socket errno: %d\n", errno);
-        } else {
-            RLOGW("EOS.  Closing command socket.");
+    if (strncmp(command, "trace", 5) == 0) {
+        if (ril_trace_dump(fdDebug) < 0) {
+            RLOGE("Error writing the trace dump errno: %d", errno);
         }
+        close(fdDebug);
+        __atomic_store_n(&s_debugSessionBusy, false, __ATOMIC_RELEASE);
+        return NULL;
+    }
 
-        close(s_fdCommand);
-        s_fdCommand = -1;
-
-        ril_event_del(&s_commands_event);
+    if (strncmp(command, "id ", 3) == 0) {
+        char* name = command + 3;
 
-        record_stream_free(p_rs);
+        name[strcspn(name, " \r\n")] = '\0';
+        debugAppend(&text, "%s %d\n", name, requestFromString(name));
+    } else {
+        dumpPendingRequests(&text);
+#if RIL_LATENCY_TRACE_SIZE > 0
+        dumpLatencyStats(&text);
+#endif
+    }
 
-        /* start listening for new connections again */
-        rilEventAddWakeup(&s_listen_event);
+    while (offset < text.len) {
+        ssize_t written = write(fdDebug, text.data + offset, text.len - offset);
 
-        onCommandsSocketClosed();
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            RLOGE("Error writing the debug dump errno: %d", errno);
+            break;
+        }
+        offset += written;
     }
+
+    free(text.data);
+    close(fdDebug);
+    __atomic_store_n(&s_debugSessionBusy, false, __ATOMIC_RELEASE);
+    return NULL;
 }
 
-static void onNewCommandConnect(void)
+/* Hands a debug socket client to a thread of its own, one at a time */
+static void debugCallback(int fd, short flags, void* param)
 {
-    // Inform we are connected and the ril version
-    int rilVer = s_callbacks.version;
-    RLOGD("RIL_UNSOL_RIL_CONNECTED message send");
-    RIL_onUnsolicitedResponse(RIL_UNSOL_RIL_CONNECTED, &rilVer, sizeof(rilVer));
+    pthread_attr_t attr;
+    pthread_t tid;
+    int fdDebug;
 
-    // implicit radio state changed
-    RLOGD("RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED message send");
-    RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0);
+    fdDebug = accept(fd, NULL, NULL);
+
+    if (fdDebug < 0) {
+        RLOGE("Error on accept() errno: %d", errno);
+        return;
+    }
+
+    if (__atomic_exchange_n(&s_debugSessionBusy, true, __ATOMIC_ACQUIRE)) {
+        RLOGW("debug socket busy, closing the new connection");
+        close(fdDebug);
+        return;
+    }
 
-    // Send last NITZ time data, in case it was missed
-    if (s_lastNITZTimeData != NULL) {
-        sendResponseRaw(s_lastNITZTimeData, s_lastNITZTimeDataSize);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-        free(s_lastNITZTimeData);
-        s_lastNITZTimeData = NULL;
+    if (pthread_create(&tid, &attr, debugSessionLoop, (void*)(intptr_t)fdDebug) != 0) {
+        RLOGE("Failed to start the debug session thread");
+        close(fdDebug);
+        __atomic_store_n(&s_debugSessionBusy, false, __ATOMIC_RELEASE);
     }
+
+    pthread_attr_destroy(&attr);
 }
 
 static void listenCallback(int fd, short flags, void* param)
 {
     int ret;
-    RecordStream* p_rs;
+    int fdCommand;
+    RilClient* client = NULL;
 
     struct sockaddr_un peeraddr;
     socklen_t socklen = sizeof(peeraddr);
 
-    assert(s_fdCommand < 0);
+    assert(s_numClients < MAX_COMMAND_CLIENTS);
     assert(fd == s_fdListen);
 
-    s_fdCommand = accept(s_fdListen, (struct sockaddr*)&peeraddr, &socklen);
+    fdCommand = accept(s_fdListen, (struct sockaddr*)&peeraddr, &socklen);
 
-    if (s_fdCommand < 0) {
+    if (fdCommand < 0) {
         RLOGE("Error on accept() errno: %d", errno);
         /* start listening for new connections again */
         rilEventAddWakeup(&s_listen_event);
@@ -2518,37 +5215,84 @@ static void listenCallback(int fd, short flags, void* param)
      * phone process */
     errno = 0;
 
-    ret = fcntl(s_fdCommand, F_SETFL, O_NONBLOCK);
+    ret = fcntl(fdCommand, F_SETFL, O_NONBLOCK);
 
     if (ret < 0) {
         RLOGE("Error setting O_NONBLOCK errno: %d", errno);
     }
 
-    RLOGI("new client connect");
-    p_rs = record_stream_new(s_fdCommand, MAX_COMMAND_BYTES);
+    for (int i = 0; i < MAX_COMMAND_CLIENTS; i++) {
+        if (s_clients[i].fd < 0) {
+            client = &s_clients[i];
+            break;
+        }
+    }
+
+    assert(client != NULL);
+
+    RLOGI("new client %d connect", client->id);
+    if (!s_seqPacket) {
+        client->p_rs = record_stream_new(fdCommand, MAX_COMMAND_BYTES);
+    }
+
+    ril_event_set(&client->event, fdCommand, 1,
+        processCommandsCallback, client);
+
+    // publish the fd only once its event is set up, responses sent from
+    // other threads may start queueing right away
+    pthread_mutex_lock(&s_writeMutex);
+    client->fd = fdCommand;
+    // everything until the client subscribes to something narrower
+    memset(client->unsolFilter, 0xff, sizeof(client->unsolFilter));
+    updateUnsolWanted();
+    pthread_mutex_unlock(&s_writeMutex);
+
+    rilEventAddWakeup(&client->event);
+
+    /* keep accepting until every client slot is taken */
+    if (++s_numClients < MAX_COMMAND_CLIENTS) {
+        rilEventAddWakeup(&s_listen_event);
+    }
+
+    onNewCommandConnect(client);
+}
 
-    ril_event_set(&s_commands_event, s_fdCommand, 1,
-        processCommandsCallback, p_rs);
+/* must be called with s_timedCallbackMutex held */
+static void releaseTimedCallback(UserCallbackInfo* p_info)
+{
+    s_timedCallbackPoolStats.inUse--;
 
-    rilEventAddWakeup(&s_commands_event);
+    if (p_info->slot < 0) {
+        free(p_info);
+        return;
+    }
 
-    onNewCommandConnect();
+    // stale handles to this slot no longer match
+    p_info->generation++;
+    p_info->p_next = s_freeTimedCallbacks;
+    s_freeTimedCallbacks = p_info;
+    s_availableTimedCallbacks++;
 }
 
 static void userTimerCallback(int fd, short flags, void* param)
 {
     UserCallbackInfo* p_info;
+    bool cancelled;
 
     p_info = (UserCallbackInfo*)param;
 
-    p_info->p_callback(p_info->userParam);
+    pthread_mutex_lock(&s_timedCallbackMutex);
+    cancelled = (p_info->state == TIMED_CALLBACK_CANCELLED);
+    p_info->state = TIMED_CALLBACK_RUNNING;
+    pthread_mutex_unlock(&s_timedCallbackMutex);
 
-    // FIXME generalize this...there should be a cancel mechanism
-    if (s_last_wake_timeout_info != NULL && s_last_wake_timeout_info == p_info) {
-        s_last_wake_timeout_info = NULL;
+    if (!cancelled) {
+        p_info->p_callback(p_info->userParam);
     }
 
-    free(p_info);
+    pthread_mutex_lock(&s_timedCallbackMutex);
+    releaseTimedCallback(p_info);
+    pthread_mutex_unlock(&s_timedCallbackMutex);
 }
 
 static void eventLoop(void* param)
@@ -2563,7 +5307,11 @@ static void eventLoop(void* param)
 extern "C" void RIL_startEventLoop(void)
 {
     int ret = 0;
+    int socketType = SOCK_STREAM;
+    socklen_t optlen = sizeof(socketType);
+#if !RIL_EVENT_USE_EVENTFD
     int filedes[2] = { 0 };
+#endif
 
     s_fdListen = local_get_control_socket(SOCKET_NAME_RIL);
     if (s_fdListen < 0) {
@@ -2579,7 +5327,39 @@ extern "C" void RIL_startEventLoop(void)
         exit(-1);
     }
 
+    // rild picks the transport when it creates the socket
+    if (getsockopt(s_fdListen, SOL_SOCKET, SO_TYPE, &socketType, &optlen) == 0) {
+        s_seqPacket = (socketType == SOCK_SEQPACKET);
+    }
+    RLOGI("command socket is %s", s_seqPacket ? "SOCK_SEQPACKET" : "SOCK_STREAM");
+
+    // optional, only used for dumps
+    s_fdDebug = local_get_control_socket(SOCKET_NAME_RIL_DEBUG);
+    if (s_fdDebug >= 0 && listen(s_fdDebug, 4) < 0) {
+        RLOGE("Failed to listen on debug socket '%d': %s", s_fdDebug, strerror(errno));
+        s_fdDebug = -1;
+    }
+
     ril_event_init();
+    requestArenaInit(&s_loopArena);
+    ril_event_set(&s_deadline_event, -1, false, checkRequestDeadlines, NULL);
+
+    for (int i = 0; i < MAX_COMMAND_CLIENTS; i++) {
+        s_clients[i].id = i;
+        s_clients[i].fd = -1;
+    }
+#if RIL_EVENT_USE_EVENTFD
+    ret = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (ret < 0) {
+        RLOGE("Error in eventfd() errno: %d", errno);
+        return;
+    }
+
+    s_fdWakeupRead = ret;
+    s_fdWakeupWrite = ret;
+    RLOGD("start eventLoop EVENTFD SUCCESS");
+#else
     ret = pipe(filedes);
 
     if (ret < 0) {
@@ -2590,6 +5370,7 @@ extern "C" void RIL_startEventLoop(void)
     s_fdWakeupRead = filedes[0];
     s_fdWakeupWrite = filedes[1];
     RLOGD("start eventLoop PIPE SUCCESS");
+#endif
 
     fcntl(s_fdWakeupRead, F_SETFL, O_NONBLOCK);
     ril_event_set(&s_wakeupfd_event, s_fdWakeupRead, true,
@@ -2599,6 +5380,13 @@ extern "C" void RIL_startEventLoop(void)
     ril_event_set(&s_listen_event, s_fdListen, false,
         listenCallback, NULL);
     rilEventAddWakeup(&s_listen_event);
+
+    if (s_fdDebug >= 0) {
+        ril_event_set(&s_debug_event, s_fdDebug, true,
+            debugCallback, NULL);
+        rilEventAddWakeup(&s_debug_event);
+    }
+
     eventLoop(NULL);
 }
 
@@ -2634,76 +5422,121 @@ extern "C" void RIL_register(const RIL_RadioFunctions* callbacks)
 
     RLOGI("s_registerCalled flag set, %d", s_started);
 
-    // Little self-check
-    for (int i = 0; i < (int)NUM_ELEMS(s_commands); i++) {
-        assert(i == s_commands[i].requestNumber);
-    }
-
-    for (int i = 1; i < (int)NUM_ELEMS(s_second_commands); i++) {
-        assert(i == (s_second_commands[i].requestNumber - RIL_SECOND_REQUEST_BASE));
-    }
-
-    // check ims
-    for (int i = 1; i < (int)NUM_ELEMS(s_ims_commands); i++) {
-        assert(i == (s_ims_commands[i].requestNumber - RIL_IMS_REQUEST_BASE));
-    }
-
-    for (int i = 1; i < (int)NUM_ELEMS(s_cus_commands); i++) {
-        assert(i == (s_cus_commands[i].requestNumber - RIL_CUS_REQUEST_BASE));
-    }
-
+    // Little self-check, the command tables are checked at compile time
     for (int i = 0; i < (int)NUM_ELEMS(s_unsolResponses); i++) {
         assert(i + RIL_UNSOL_RESPONSE_BASE
             == s_unsolResponses[i].requestNumber);
     }
 
+    for (int i = 0; i < (int)NUM_ELEMS(s_unsolPolicies); i++) {
+        const UnsolPolicyInfo* policy = &s_unsolPolicies[i];
+        int index = policy->requestNumber - RIL_UNSOL_RESPONSE_BASE;
+
+        if (policy->coalesceMs > 0 || policy->minIntervalMs > 0 || policy->hysteresis > 0) {
+            s_unsolThrottles[index].policy = policy;
+            s_unsolThrottles[index].index = index;
+        }
+        s_stickyResponses[index].sticky = policy->sticky;
+    }
+
     // start listen socket
     RLOGI("RIL_register s_starte %d", s_started);
 
+#if RIL_DISPATCH_WORKERS > 0
+    if (s_dispatchWorkersStarted == 0) {
+        startDispatchWorkers();
+    }
+#endif
+
     if (s_started == 0) {
         RIL_startEventLoop();
     }
 }
 
-static int checkAndDequeueRequestInfo(struct RequestInfo* pRI)
+/* Returns the request of t if it is pending, it is then completing */
+static RequestInfo* checkAndDequeueRequestInfo(RIL_Token t)
 {
-    int ret = 0;
-
-    if (pRI == NULL) {
-        return 0;
-    }
+    RequestInfo* pRI;
 
     pthread_mutex_lock(&s_pendingRequestsMutex);
 
-    for (RequestInfo** ppCur = &s_pendingRequests; *ppCur != NULL;
-         ppCur = &((*ppCur)->p_next)) {
-        if (pRI == *ppCur) {
-            ret = 1;
+    pRI = findRequest(t);
+    if (pRI != NULL && pRI->state != REQUEST_QUEUED && pRI->state != REQUEST_DISPATCHED) {
+        pRI = NULL;
+    }
 
-            *ppCur = (*ppCur)->p_next;
-            break;
+    if (pRI != NULL) {
+        if (pRI->client != NULL && pRI->epoch != pRI->client->epoch) {
+            pRI->cancelled = 1;
         }
+        clearInFlightRequest(pRI);
+        setRequestState(pRI, REQUEST_COMPLETING);
     }
 
     pthread_mutex_unlock(&s_pendingRequestsMutex);
 
-    return ret;
+    return pRI;
+}
+
+/**
+ * Frees the request of t if its deadline expired while the vendor RIL had
+ * it, the client already got its error response.
+ *
+ * Returns true if it was such a request
+ */
+static bool releaseExpiredRequest(RIL_Token t, RIL_Errno e)
+{
+    RequestInfo* pRI;
+    bool expired;
+    char deferFree = 0;
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    pRI = findRequest(t);
+    expired = pRI != NULL && pRI->state == REQUEST_EXPIRED;
+    if (expired) {
+        setRequestState(pRI, REQUEST_COMPLETING);
+        // checkRequestDeadlines frees it once done with it
+        deferFree = pRI->expiring;
+    }
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+    if (expired) {
+        RLOGD("late completion of expired request %s",
+            requestToString(pRI->pCI->requestNumber));
+        // still worth a record, it tells how late the modem was
+        traceRequestComplete(pRI, e);
+        if (!deferFree) {
+            freeRequestInfo(pRI);
+        }
+    }
+
+    return expired;
 }
 
 extern "C" void RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void* response,
     size_t responselen)
 {
     RequestInfo* pRI;
+    RequestInfo* p_followers;
     int ret;
     size_t errorOffset;
     Parcel p;
-    pRI = (RequestInfo*)t;
 
-    if (!checkAndDequeueRequestInfo(pRI)) {
-        RLOGE("RIL_onRequestComplete: invalid RIL_Token");
+    pRI = checkAndDequeueRequestInfo(t);
+    if (pRI == NULL) {
+        if (!releaseExpiredRequest(t, e)) {
+            RLOGE("RIL_onRequestComplete: invalid RIL_Token");
+        }
         return;
     }
 
+    // no request attaches once pRI is completing
+    p_followers = pRI->p_followers;
+    pRI->p_followers = NULL;
+
+    traceRequestComplete(pRI, e);
+    ril_trace(RIL_TRACE_RESPONSE, pRI->token, pRI->pCI->requestNumber, e, responselen);
+
     RLOGD("RequestComplete");
 
     if (pRI->local > 0) {
@@ -2714,7 +5547,7 @@ extern "C" void RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void* response,
         goto done;
     }
 
-    if (pRI->cancelled == 0) {
+    if (pRI->cancelled == 0 || p_followers != NULL) {
         p.writeInt32(RESPONSE_SOLICITED);
         p.writeInt32(pRI->token);
         errorOffset = p.dataPosition();
@@ -2730,24 +5563,30 @@ extern "C" void RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void* response,
                 RLOGE("responseFunction error, ret: %d", ret);
                 p.setDataPosition(errorOffset);
                 p.writeInt32(ret);
+            } else if (e == RIL_E_SUCCESS && pRI->pCI->caching == CACHE_STATIC) {
+                storeCachedResponse(pRI, p, errorOffset);
             }
         }
 
-        if (e != RIL_E_SUCCESS) {
-            appendPrintBuf("%s fails by %s", printBuf, failCauseToString(e));
+        if (pRI->cancelled == 0 && sendResponse(pRI->client, pRI->epoch, p) < 0) {
+            RLOGE("failed to send solicited command response");
         }
 
-        if (s_fdCommand < 0) {
-            RLOGD("RIL onRequestComplete: Command channel closed");
-        }
+        // same payload, only the token differs
+        while (p_followers != NULL) {
+            RequestInfo* pFollower = p_followers;
 
-        if (sendResponse(p) < 0) {
-            RLOGE("failed to send solicited command response");
+            p_followers = pFollower->p_nextFollower;
+
+            p.setDataPosition(sizeof(int32_t));
+            p.writeInt32(pFollower->token);
+            sendResponse(pFollower->client, pFollower->epoch, p);
+            freeRequestInfo(pFollower);
         }
     }
 
 done:
-    free(pRI);
+    freeRequestInfo(pRI);
 }
 
 static void grabPartialWakeLock()
@@ -2762,10 +5601,7 @@ static void releaseWakeLock()
 
 static void wakeTimeoutCallback(void* param)
 {
-    // We're using "param != NULL" as a cancellation mechanism
-    if (param == NULL) {
-        releaseWakeLock();
-    }
+    releaseWakeLock();
 }
 
 static int decodeVoiceRadioTechnology(RIL_RadioState radioState)
@@ -2814,6 +5650,9 @@ static int decodeSimStatus(RIL_RadioState radioState)
  */
 static RIL_RadioState processRadioState(RIL_RadioState newRadioState)
 {
+    if (newRadioState == RADIO_STATE_UNAVAILABLE) {
+        invalidateResponseCache();
+    }
 
     if ((newRadioState > RADIO_STATE_UNAVAILABLE) && (newRadioState < RADIO_STATE_ON)) {
         int newVoiceRadioTech;
@@ -2840,8 +5679,12 @@ static RIL_RadioState processRadioState(RIL_RadioState newRadioState)
     return newRadioState;
 }
 
-extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
-    size_t datalen)
+/**
+ * Builds an unsolicited response and sends it to client, or to every
+ * connected client when client is NULL.
+ */
+static void sendUnsolicitedResponse(RilClient* client, int unsolResponse,
+    const void* data, size_t datalen)
 {
     int unsolResponseIndex;
     int ret;
@@ -2855,6 +5698,8 @@ extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
         return;
     }
 
+    ril_trace(RIL_TRACE_UNSOL, 0, unsolResponse, 0, datalen);
+
     unsolResponseIndex = unsolResponse - RIL_UNSOL_RESPONSE_BASE;
 
     if ((unsolResponseIndex < 0)
@@ -2863,6 +5708,21 @@ extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
         return;
     }
 
+    if (unsolResponse == RIL_UNSOL_MODEM_RESTART) {
+        invalidateResponseCache();
+    }
+
+    // nobody subscribed, don't even build the parcel. Undelivered ones
+    // are still built so they can be replayed to the next client to connect.
+    if (client == NULL && !isUnsolWanted(s_unsolWanted, unsolResponseIndex)
+        && s_stickyResponses[unsolResponseIndex].sticky != STICKY_UNDELIVERED) {
+        if (unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED) {
+            // the notifications derived from old radio states may have subscribers
+            processRadioState(s_callbacks.onStateRequest());
+        }
+        return;
+    }
+
     // Grab a wake lock if needed for this reponse,
     // as we exit we'll either release it immediately
     // or set a timer to release it later.
@@ -2897,8 +5757,6 @@ extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
         newState = processRadioState(s_callbacks.onStateRequest());
         RLOGD("state change");
         p.writeInt32(newState);
-        appendPrintBuf("%s {%s}", printBuf,
-            radioStateToString(s_callbacks.onStateRequest()));
         break;
 
     case RIL_UNSOL_NITZ_TIME_RECEIVED:
@@ -2913,17 +5771,18 @@ extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
 
     if (s_callbacks.version < 13) {
         if (shouldScheduleTimeout) {
-            UserCallbackInfo* p_info = internalRequestTimedCallback(wakeTimeoutCallback, NULL,
-                &TIMEVAL_WAKE_TIMEOUT);
+            RIL_TimedCallbackHandle handle;
 
-            if (p_info == NULL) {
+            if (internalRequestTimedCallback(wakeTimeoutCallback, NULL,
+                    &TIMEVAL_WAKE_TIMEOUT, &handle)
+                < 0) {
                 goto error_exit;
             } else {
                 // Cancel the previous request
-                if (s_last_wake_timeout_info != NULL) {
-                    s_last_wake_timeout_info->userParam = (void*)1;
+                if (s_last_wake_timeout_handle != 0) {
+                    RIL_cancelTimedCallback(s_last_wake_timeout_handle);
                 }
-                s_last_wake_timeout_info = p_info;
+                s_last_wake_timeout_handle = handle;
             }
         }
     }
@@ -2931,28 +5790,28 @@ extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
 #if VDBG
     RLOGI("%s UNSOLICITED: %s length:%d", rilSocketIdToString(soc_id), requestToString(unsolResponse), p.dataSize());
 #endif
-    ret = sendResponse(p);
-    if (ret != 0 && unsolResponse == RIL_UNSOL_NITZ_TIME_RECEIVED) {
-
-        // Unfortunately, NITZ time is not poll/update like everything
-        // else in the system. So, if the upstream client isn't connected,
-        // keep a copy of the last NITZ response (with receive time noted
-        // above) around so we can deliver it when it is connected
+    if (client == NULL && s_stickyResponses[unsolResponseIndex].sticky == STICKY_LAST) {
+        storeStickyResponse(unsolResponseIndex, p);
+    }
 
-        if (s_lastNITZTimeData != NULL) {
-            free(s_lastNITZTimeData);
-            s_lastNITZTimeData = NULL;
-        }
+    if (client != NULL) {
+        ret = sendResponse(client, client->epoch, p);
+    } else if (s_unsolThrottles[unsolResponseIndex].policy != NULL) {
+        ret = throttleUnsolicitedResponse(unsolResponseIndex, data, datalen, p);
+    } else {
+        ret = broadcastResponse(unsolResponseIndex, p);
+    }
 
-        s_lastNITZTimeData = calloc(p.dataSize(), 1);
-        if (s_lastNITZTimeData == NULL) {
-            RLOGE("Memory allocation failed in RIL_onUnsolicitedResponse");
-            goto error_exit;
+    if (client == NULL && s_stickyResponses[unsolResponseIndex].sticky == STICKY_UNDELIVERED) {
+        if (ret != 0) {
+            // Unfortunately, NITZ time is not poll/update like everything
+            // else in the system. So, if no client got it, keep a copy (with
+            // receive time noted above) for the next one to connect
+            storeStickyResponse(unsolResponseIndex, p);
+        } else {
+            clearStickyResponse(unsolResponseIndex);
         }
-        s_lastNITZTimeDataSize = p.dataSize();
-        memcpy(s_lastNITZTimeData, p.data(), p.dataSize());
     }
-
     // Normal exit
     return;
 
@@ -2962,20 +5821,71 @@ error_exit:
     }
 }
 
-/* FIXME generalize this if you track UserCAllbackInfo, clear it
- * when the callback occurs */
-static UserCallbackInfo* internalRequestTimedCallback(RIL_TimedCallback callback,
-    void* param, const struct timeval* relativeTime)
+extern "C" void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
+    size_t datalen)
+{
+    sendUnsolicitedResponse(NULL, unsolResponse, data, datalen);
+}
+
+static RIL_TimedCallbackHandle timedCallbackHandle(UserCallbackInfo* p_info)
+{
+    return ((RIL_TimedCallbackHandle)p_info->generation << 16) | (p_info->slot + 1);
+}
+
+/**
+ * Schedule a timed callback on the event loop.
+ *
+ * If p_handle is not NULL the callback gets a slot in s_timedCallbacks and
+ * *p_handle is set to a handle that RIL_cancelTimedCallback accepts; this
+ * fails once all slots are in use. Otherwise a heap allocation is used when
+ * only RESERVED_TIMED_CALLBACKS slots are left.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int internalRequestTimedCallback(RIL_TimedCallback callback,
+    void* param, const struct timeval* relativeTime, RIL_TimedCallbackHandle* p_handle)
 {
     struct timeval myRelativeTime;
     UserCallbackInfo* p_info;
 
-    p_info = (UserCallbackInfo*)calloc(1, sizeof(UserCallbackInfo));
+    pthread_mutex_lock(&s_timedCallbackMutex);
+
+    p_info = NULL;
+    if (p_handle != NULL || s_availableTimedCallbacks > RESERVED_TIMED_CALLBACKS) {
+        p_info = s_freeTimedCallbacks;
+        if (p_info != NULL) {
+            s_freeTimedCallbacks = p_info->p_next;
+        } else if (s_usedTimedCallbacks < MAX_TIMED_CALLBACKS) {
+            p_info = &s_timedCallbacks[s_usedTimedCallbacks];
+            p_info->slot = s_usedTimedCallbacks++;
+        }
+        if (p_info != NULL) {
+            s_availableTimedCallbacks--;
+        }
+    }
+
+    if (p_info == NULL && p_handle == NULL) {
+        p_info = (UserCallbackInfo*)calloc(1, sizeof(UserCallbackInfo));
+        if (p_info != NULL) {
+            p_info->slot = -1;
+        }
+    }
+
     if (p_info == NULL) {
-        RLOGE("Memory allocation failed in internalRequestTimedCallback");
-        return p_info;
+        pthread_mutex_unlock(&s_timedCallbackMutex);
+        RLOGE("No timed callback available in internalRequestTimedCallback");
+        return -1;
+    }
+
+    poolStatsAlloc(&s_timedCallbackPoolStats, p_info->slot >= 0);
+
+    p_info->state = TIMED_CALLBACK_ARMED;
+    if (p_handle != NULL) {
+        *p_handle = timedCallbackHandle(p_info);
     }
 
+    pthread_mutex_unlock(&s_timedCallbackMutex);
+
     p_info->p_callback = callback;
     p_info->userParam = param;
 
@@ -2989,221 +5899,254 @@ static UserCallbackInfo* internalRequestTimedCallback(RIL_TimedCallback callback
 
     ril_event_set(&(p_info->event), -1, false, userTimerCallback, p_info);
 
-    ril_timer_add(&(p_info->event), &myRelativeTime);
+    if (ril_timer_add(&(p_info->event), &myRelativeTime) < 0) {
+        // never armed, the handle is not returned to anyone
+        pthread_mutex_lock(&s_timedCallbackMutex);
+        releaseTimedCallback(p_info);
+        pthread_mutex_unlock(&s_timedCallbackMutex);
+        RLOGE("Failed to arm the timer in internalRequestTimedCallback");
+        return -1;
+    }
 
     triggerEvLoop();
-    return p_info;
+    return 0;
 }
 
 extern "C" void RIL_requestTimedCallback(RIL_TimedCallback callback, void* param,
     const struct timeval* relativeTime)
 {
-    internalRequestTimedCallback(callback, param, relativeTime);
+    internalRequestTimedCallback(callback, param, relativeTime, NULL);
+}
+
+extern "C" RIL_TimedCallbackHandle RIL_requestTimedCallbackEx(RIL_TimedCallback callback,
+    void* param, const struct timeval* relativeTime)
+{
+    RIL_TimedCallbackHandle handle;
+
+    if (internalRequestTimedCallback(callback, param, relativeTime, &handle) < 0) {
+        return 0;
+    }
+
+    return handle;
+}
+
+extern "C" int RIL_cancelTimedCallback(RIL_TimedCallbackHandle handle)
+{
+    UserCallbackInfo* p_info;
+    int slot = (int)(handle & 0xffff) - 1;
+    int ret = -1;
+
+    if (slot < 0 || slot >= MAX_TIMED_CALLBACKS) {
+        return -1;
+    }
+
+    p_info = &s_timedCallbacks[slot];
+
+    pthread_mutex_lock(&s_timedCallbackMutex);
+
+    if (slot < s_usedTimedCallbacks && timedCallbackHandle(p_info) == handle
+        && p_info->state == TIMED_CALLBACK_ARMED) {
+        if (ril_timer_del(&p_info->event)) {
+            // disarmed before it expired, the slot is free right away
+            releaseTimedCallback(p_info);
+        } else {
+            // already queued to fire; userTimerCallback skips and frees it
+            p_info->state = TIMED_CALLBACK_CANCELLED;
+        }
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&s_timedCallbackMutex);
+
+    return ret;
+}
+
+typedef struct {
+    int value;
+    const char* name;
+} NamedValue;
+
+/* Names of the values First to Last, NULL for the unnamed ones */
+template <int First, int Last>
+struct NameTable {
+    const char* names[Last - First + 1];
+};
+
+template <int First, int Last, size_t N>
+static constexpr NameTable<First, Last> buildNameTable(const NamedValue (&list)[N])
+{
+    NameTable<First, Last> table = {};
+
+    for (const NamedValue& v : list) {
+        if (v.value >= First && v.value <= Last) {
+            table.names[v.value - First] = v.name;
+        }
+    }
+
+    return table;
+}
+
+template <int First, int Last>
+static constexpr size_t countNames(const NameTable<First, Last>& table)
+{
+    size_t count = 0;
+
+    for (const char* name : table.names) {
+        count += (name != NULL);
+    }
+
+    return count;
+}
+
+template <int First, int Last>
+static inline const char* lookupName(const NameTable<First, Last>& table, int value)
+{
+    return (unsigned int)(value - First) <= (unsigned int)(Last - First)
+        ? table.names[value - First]
+        : NULL;
 }
 
+#define ERRNO_NAME(name) { RIL_E_##name, "E_" #name }
+
+static constexpr NamedValue s_errnoNameList[] = {
+    ERRNO_NAME(SUCCESS),
+    ERRNO_NAME(RADIO_NOT_AVAILABLE),
+    ERRNO_NAME(GENERIC_FAILURE),
+    ERRNO_NAME(PASSWORD_INCORRECT),
+    ERRNO_NAME(SIM_PIN2),
+    ERRNO_NAME(SIM_PUK2),
+    ERRNO_NAME(REQUEST_NOT_SUPPORTED),
+    ERRNO_NAME(CANCELLED),
+    ERRNO_NAME(OP_NOT_ALLOWED_DURING_VOICE_CALL),
+    ERRNO_NAME(OP_NOT_ALLOWED_BEFORE_REG_TO_NW),
+    ERRNO_NAME(SMS_SEND_FAIL_RETRY),
+    ERRNO_NAME(SIM_ABSENT),
+    ERRNO_NAME(SUBSCRIPTION_NOT_AVAILABLE),
+    ERRNO_NAME(MODE_NOT_SUPPORTED),
+    ERRNO_NAME(FDN_CHECK_FAILURE),
+    ERRNO_NAME(ILLEGAL_SIM_OR_ME),
+    ERRNO_NAME(MISSING_RESOURCE),
+    ERRNO_NAME(NO_SUCH_ELEMENT),
+    ERRNO_NAME(DIAL_MODIFIED_TO_USSD),
+    ERRNO_NAME(DIAL_MODIFIED_TO_SS),
+    ERRNO_NAME(DIAL_MODIFIED_TO_DIAL),
+    ERRNO_NAME(USSD_MODIFIED_TO_DIAL),
+    ERRNO_NAME(USSD_MODIFIED_TO_SS),
+    ERRNO_NAME(USSD_MODIFIED_TO_USSD),
+    ERRNO_NAME(SS_MODIFIED_TO_DIAL),
+    ERRNO_NAME(SS_MODIFIED_TO_USSD),
+    ERRNO_NAME(SUBSCRIPTION_NOT_SUPPORTED),
+    ERRNO_NAME(SS_MODIFIED_TO_SS),
+    ERRNO_NAME(LCE_NOT_SUPPORTED),
+    ERRNO_NAME(NO_MEMORY),
+    ERRNO_NAME(INTERNAL_ERR),
+    ERRNO_NAME(SYSTEM_ERR),
+    ERRNO_NAME(MODEM_ERR),
+    ERRNO_NAME(INVALID_STATE),
+    ERRNO_NAME(NO_RESOURCES),
+    ERRNO_NAME(SIM_ERR),
+    ERRNO_NAME(INVALID_ARGUMENTS),
+    ERRNO_NAME(INVALID_SIM_STATE),
+    ERRNO_NAME(INVALID_MODEM_STATE),
+    ERRNO_NAME(INVALID_CALL_ID),
+    ERRNO_NAME(NO_SMS_TO_ACK),
+    ERRNO_NAME(NETWORK_ERR),
+    ERRNO_NAME(REQUEST_RATE_LIMITED),
+    ERRNO_NAME(SIM_BUSY),
+    ERRNO_NAME(SIM_FULL),
+    ERRNO_NAME(NETWORK_REJECT),
+    ERRNO_NAME(OPERATION_NOT_ALLOWED),
+    ERRNO_NAME(EMPTY_RECORD),
+    ERRNO_NAME(INVALID_SMS_FORMAT),
+    ERRNO_NAME(ENCODING_ERR),
+    ERRNO_NAME(INVALID_SMSC_ADDRESS),
+    ERRNO_NAME(NO_SUCH_ENTRY),
+    ERRNO_NAME(NETWORK_NOT_READY),
+    ERRNO_NAME(NOT_PROVISIONED),
+    ERRNO_NAME(NO_SUBSCRIPTION),
+    ERRNO_NAME(NO_NETWORK_FOUND),
+    ERRNO_NAME(DEVICE_IN_USE),
+    ERRNO_NAME(ABORTED),
+    ERRNO_NAME(INVALID_RESPONSE),
+    ERRNO_NAME(OEM_ERROR_1),
+    ERRNO_NAME(OEM_ERROR_2),
+    ERRNO_NAME(OEM_ERROR_3),
+    ERRNO_NAME(OEM_ERROR_4),
+    ERRNO_NAME(OEM_ERROR_5),
+    ERRNO_NAME(OEM_ERROR_6),
+    ERRNO_NAME(OEM_ERROR_7),
+    ERRNO_NAME(OEM_ERROR_8),
+    ERRNO_NAME(OEM_ERROR_9),
+    ERRNO_NAME(OEM_ERROR_10),
+    ERRNO_NAME(OEM_ERROR_11),
+    ERRNO_NAME(OEM_ERROR_12),
+    ERRNO_NAME(OEM_ERROR_13),
+    ERRNO_NAME(OEM_ERROR_14),
+    ERRNO_NAME(OEM_ERROR_15),
+    ERRNO_NAME(OEM_ERROR_16),
+    ERRNO_NAME(OEM_ERROR_17),
+    ERRNO_NAME(OEM_ERROR_18),
+    ERRNO_NAME(OEM_ERROR_19),
+    ERRNO_NAME(OEM_ERROR_20),
+    ERRNO_NAME(OEM_ERROR_21),
+    ERRNO_NAME(OEM_ERROR_22),
+    ERRNO_NAME(OEM_ERROR_23),
+    ERRNO_NAME(OEM_ERROR_24),
+    ERRNO_NAME(OEM_ERROR_25),
+};
+
+#undef ERRNO_NAME
+
+// the standard errors and the OEM ones are two dense ranges
+static constexpr auto s_errnoNames
+    = buildNameTable<RIL_E_SUCCESS, RIL_E_INVALID_RESPONSE>(s_errnoNameList);
+static constexpr auto s_oemErrnoNames
+    = buildNameTable<RIL_E_OEM_ERROR_1, RIL_E_OEM_ERROR_25>(s_errnoNameList);
+
+static_assert(countNames(s_errnoNames) + countNames(s_oemErrnoNames)
+        == NUM_ELEMS(s_errnoNameList),
+    "an error name is out of the ranges of the name tables");
+
+#define RADIO_STATE_NAME(name) { RADIO_STATE_##name, "RADIO_" #name }
+
+static constexpr NamedValue s_radioStateNameList[] = {
+    RADIO_STATE_NAME(OFF),
+    RADIO_STATE_NAME(UNAVAILABLE),
+    RADIO_STATE_NAME(SIM_NOT_READY),
+    RADIO_STATE_NAME(SIM_LOCKED_OR_ABSENT),
+    RADIO_STATE_NAME(SIM_READY),
+    RADIO_STATE_NAME(RUIM_NOT_READY),
+    RADIO_STATE_NAME(RUIM_READY),
+    RADIO_STATE_NAME(RUIM_LOCKED_OR_ABSENT),
+    RADIO_STATE_NAME(NV_NOT_READY),
+    RADIO_STATE_NAME(NV_READY),
+    RADIO_STATE_NAME(ON),
+};
+
+#undef RADIO_STATE_NAME
+
+static constexpr auto s_radioStateNames
+    = buildNameTable<RADIO_STATE_OFF, RADIO_STATE_ON>(s_radioStateNameList);
+
+static_assert(countNames(s_radioStateNames) == NUM_ELEMS(s_radioStateNameList),
+    "a radio state name is out of the range of the name table");
+
 const char* failCauseToString(RIL_Errno e)
 {
-    switch (e) {
-    case RIL_E_SUCCESS:
-        return "E_SUCCESS";
-    case RIL_E_RADIO_NOT_AVAILABLE:
-        return "E_RADIO_NOT_AVAILABLE";
-    case RIL_E_GENERIC_FAILURE:
-        return "E_GENERIC_FAILURE";
-    case RIL_E_PASSWORD_INCORRECT:
-        return "E_PASSWORD_INCORRECT";
-    case RIL_E_SIM_PIN2:
-        return "E_SIM_PIN2";
-    case RIL_E_SIM_PUK2:
-        return "E_SIM_PUK2";
-    case RIL_E_REQUEST_NOT_SUPPORTED:
-        return "E_REQUEST_NOT_SUPPORTED";
-    case RIL_E_CANCELLED:
-        return "E_CANCELLED";
-    case RIL_E_OP_NOT_ALLOWED_DURING_VOICE_CALL:
-        return "E_OP_NOT_ALLOWED_DURING_VOICE_CALL";
-    case RIL_E_OP_NOT_ALLOWED_BEFORE_REG_TO_NW:
-        return "E_OP_NOT_ALLOWED_BEFORE_REG_TO_NW";
-    case RIL_E_SMS_SEND_FAIL_RETRY:
-        return "E_SMS_SEND_FAIL_RETRY";
-    case RIL_E_SIM_ABSENT:
-        return "E_SIM_ABSENT";
-    case RIL_E_ILLEGAL_SIM_OR_ME:
-        return "E_ILLEGAL_SIM_OR_ME";
-#ifdef FEATURE_MULTIMODE_ANDROID
-    case RIL_E_SUBSCRIPTION_NOT_AVAILABLE:
-        return "E_SUBSCRIPTION_NOT_AVAILABLE";
-    case RIL_E_MODE_NOT_SUPPORTED:
-        return "E_MODE_NOT_SUPPORTED";
-#endif
-    case RIL_E_FDN_CHECK_FAILURE:
-        return "E_FDN_CHECK_FAILURE";
-    case RIL_E_MISSING_RESOURCE:
-        return "E_MISSING_RESOURCE";
-    case RIL_E_NO_SUCH_ELEMENT:
-        return "E_NO_SUCH_ELEMENT";
-    case RIL_E_DIAL_MODIFIED_TO_USSD:
-        return "E_DIAL_MODIFIED_TO_USSD";
-    case RIL_E_DIAL_MODIFIED_TO_SS:
-        return "E_DIAL_MODIFIED_TO_SS";
-    case RIL_E_DIAL_MODIFIED_TO_DIAL:
-        return "E_DIAL_MODIFIED_TO_DIAL";
-    case RIL_E_USSD_MODIFIED_TO_DIAL:
-        return "E_USSD_MODIFIED_TO_DIAL";
-    case RIL_E_USSD_MODIFIED_TO_SS:
-        return "E_USSD_MODIFIED_TO_SS";
-    case RIL_E_USSD_MODIFIED_TO_USSD:
-        return "E_USSD_MODIFIED_TO_USSD";
-    case RIL_E_SS_MODIFIED_TO_DIAL:
-        return "E_SS_MODIFIED_TO_DIAL";
-    case RIL_E_SS_MODIFIED_TO_USSD:
-        return "E_SS_MODIFIED_TO_USSD";
-    case RIL_E_SUBSCRIPTION_NOT_SUPPORTED:
-        return "E_SUBSCRIPTION_NOT_SUPPORTED";
-    case RIL_E_SS_MODIFIED_TO_SS:
-        return "E_SS_MODIFIED_TO_SS";
-    case RIL_E_LCE_NOT_SUPPORTED:
-        return "E_LCE_NOT_SUPPORTED";
-    case RIL_E_NO_MEMORY:
-        return "E_NO_MEMORY";
-    case RIL_E_INTERNAL_ERR:
-        return "E_INTERNAL_ERR";
-    case RIL_E_SYSTEM_ERR:
-        return "E_SYSTEM_ERR";
-    case RIL_E_MODEM_ERR:
-        return "E_MODEM_ERR";
-    case RIL_E_INVALID_STATE:
-        return "E_INVALID_STATE";
-    case RIL_E_NO_RESOURCES:
-        return "E_NO_RESOURCES";
-    case RIL_E_SIM_ERR:
-        return "E_SIM_ERR";
-    case RIL_E_INVALID_ARGUMENTS:
-        return "E_INVALID_ARGUMENTS";
-    case RIL_E_INVALID_SIM_STATE:
-        return "E_INVALID_SIM_STATE";
-    case RIL_E_INVALID_MODEM_STATE:
-        return "E_INVALID_MODEM_STATE";
-    case RIL_E_INVALID_CALL_ID:
-        return "E_INVALID_CALL_ID";
-    case RIL_E_NO_SMS_TO_ACK:
-        return "E_NO_SMS_TO_ACK";
-    case RIL_E_NETWORK_ERR:
-        return "E_NETWORK_ERR";
-    case RIL_E_REQUEST_RATE_LIMITED:
-        return "E_REQUEST_RATE_LIMITED";
-    case RIL_E_SIM_BUSY:
-        return "E_SIM_BUSY";
-    case RIL_E_SIM_FULL:
-        return "E_SIM_FULL";
-    case RIL_E_NETWORK_REJECT:
-        return "E_NETWORK_REJECT";
-    case RIL_E_OPERATION_NOT_ALLOWED:
-        return "E_OPERATION_NOT_ALLOWED";
-    // case RIL_E_EMPTY_RECORD: "E_EMPTY_RECORD";
-    case RIL_E_INVALID_SMS_FORMAT:
-        return "E_INVALID_SMS_FORMAT";
-    case RIL_E_ENCODING_ERR:
-        return "E_ENCODING_ERR";
-    case RIL_E_INVALID_SMSC_ADDRESS:
-        return "E_INVALID_SMSC_ADDRESS";
-    case RIL_E_NO_SUCH_ENTRY:
-        return "E_NO_SUCH_ENTRY";
-    case RIL_E_NETWORK_NOT_READY:
-        return "E_NETWORK_NOT_READY";
-    case RIL_E_NOT_PROVISIONED:
-        return "E_NOT_PROVISIONED";
-    case RIL_E_NO_SUBSCRIPTION:
-        return "E_NO_SUBSCRIPTION";
-    case RIL_E_NO_NETWORK_FOUND:
-        return "E_NO_NETWORK_FOUND";
-    case RIL_E_DEVICE_IN_USE:
-        return "E_DEVICE_IN_USE";
-    case RIL_E_ABORTED:
-        return "E_ABORTED";
-    case RIL_E_OEM_ERROR_1:
-        return "E_OEM_ERROR_1";
-    case RIL_E_OEM_ERROR_2:
-        return "E_OEM_ERROR_2";
-    case RIL_E_OEM_ERROR_3:
-        return "E_OEM_ERROR_3";
-    case RIL_E_OEM_ERROR_4:
-        return "E_OEM_ERROR_4";
-    case RIL_E_OEM_ERROR_5:
-        return "E_OEM_ERROR_5";
-    case RIL_E_OEM_ERROR_6:
-        return "E_OEM_ERROR_6";
-    case RIL_E_OEM_ERROR_7:
-        return "E_OEM_ERROR_7";
-    case RIL_E_OEM_ERROR_8:
-        return "E_OEM_ERROR_8";
-    case RIL_E_OEM_ERROR_9:
-        return "E_OEM_ERROR_9";
-    case RIL_E_OEM_ERROR_10:
-        return "E_OEM_ERROR_10";
-    case RIL_E_OEM_ERROR_11:
-        return "E_OEM_ERROR_11";
-    case RIL_E_OEM_ERROR_12:
-        return "E_OEM_ERROR_12";
-    case RIL_E_OEM_ERROR_13:
-        return "E_OEM_ERROR_13";
-    case RIL_E_OEM_ERROR_14:
-        return "E_OEM_ERROR_14";
-    case RIL_E_OEM_ERROR_15:
-        return "E_OEM_ERROR_15";
-    case RIL_E_OEM_ERROR_16:
-        return "E_OEM_ERROR_16";
-    case RIL_E_OEM_ERROR_17:
-        return "E_OEM_ERROR_17";
-    case RIL_E_OEM_ERROR_18:
-        return "E_OEM_ERROR_18";
-    case RIL_E_OEM_ERROR_19:
-        return "E_OEM_ERROR_19";
-    case RIL_E_OEM_ERROR_20:
-        return "E_OEM_ERROR_20";
-    case RIL_E_OEM_ERROR_21:
-        return "E_OEM_ERROR_21";
-    case RIL_E_OEM_ERROR_22:
-        return "E_OEM_ERROR_22";
-    case RIL_E_OEM_ERROR_23:
-        return "E_OEM_ERROR_23";
-    case RIL_E_OEM_ERROR_24:
-        return "E_OEM_ERROR_24";
-    case RIL_E_OEM_ERROR_25:
-        return "E_OEM_ERROR_25";
-    default:
-        return "<unknown error>";
+    const char* name = lookupName(s_errnoNames, e);
+
+    if (name == NULL) {
+        name = lookupName(s_oemErrnoNames, e);
     }
+
+    return name != NULL ? name : "<unknown error>";
 }
 
 const char* radioStateToString(RIL_RadioState s)
 {
-    switch (s) {
-    case RADIO_STATE_OFF:
-        return "RADIO_OFF";
-    case RADIO_STATE_UNAVAILABLE:
-        return "RADIO_UNAVAILABLE";
-    case RADIO_STATE_SIM_NOT_READY:
-        return "RADIO_SIM_NOT_READY";
-    case RADIO_STATE_SIM_LOCKED_OR_ABSENT:
-        return "RADIO_SIM_LOCKED_OR_ABSENT";
-    case RADIO_STATE_SIM_READY:
-        return "RADIO_SIM_READY";
-    case RADIO_STATE_RUIM_NOT_READY:
-        return "RADIO_RUIM_NOT_READY";
-    case RADIO_STATE_RUIM_READY:
-        return "RADIO_RUIM_READY";
-    case RADIO_STATE_RUIM_LOCKED_OR_ABSENT:
-        return "RADIO_RUIM_LOCKED_OR_ABSENT";
-    case RADIO_STATE_NV_NOT_READY:
-        return "RADIO_NV_NOT_READY";
-    case RADIO_STATE_NV_READY:
-        return "RADIO_NV_READY";
-    case RADIO_STATE_ON:
-        return "RADIO_ON";
-    default:
-        return "<unknown state>";
-    }
+    const char* name = lookupName(s_radioStateNames, s);
+
+    return name != NULL ? name : "<unknown state>";
 }
 
 const char* callStateToString(RIL_CallState s)
@@ -3228,291 +6171,47 @@ const char* callStateToString(RIL_CallState s)
 
 extern "C" const char* requestToString(int request)
 {
-    /*
-     cat libs/telephony/ril_commands.h \
-     | egrep "^ *{RIL_" \
-     | sed -re 's/\{RIL_([^,]+),[^,]+,([^}]+).+/case RIL_\1: return "\1";/'
-
-
-     cat libs/telephony/ril_unsol_commands.h \
-     | egrep "^ *{RIL_" \
-     | sed -re 's/\{RIL_([^,]+),([^}]+).+/case RIL_\1: return "\1";/'
-
-    */
-    switch (request) {
-    case RIL_REQUEST_GET_SIM_STATUS:
-        return "GET_SIM_STATUS";
-    case RIL_REQUEST_ENTER_SIM_PIN:
-        return "ENTER_SIM_PIN";
-    case RIL_REQUEST_ENTER_SIM_PUK:
-        return "ENTER_SIM_PUK";
-    case RIL_REQUEST_ENTER_SIM_PIN2:
-        return "ENTER_SIM_PIN2";
-    case RIL_REQUEST_ENTER_SIM_PUK2:
-        return "ENTER_SIM_PUK2";
-    case RIL_REQUEST_CHANGE_SIM_PIN:
-        return "CHANGE_SIM_PIN";
-    case RIL_REQUEST_CHANGE_SIM_PIN2:
-        return "CHANGE_SIM_PIN2";
-    case RIL_REQUEST_ENTER_NETWORK_DEPERSONALIZATION:
-        return "ENTER_NETWORK_DEPERSONALIZATION";
-    case RIL_REQUEST_GET_CURRENT_CALLS:
-        return "GET_CURRENT_CALLS";
-    case RIL_REQUEST_DIAL:
-        return "DIAL";
-    case RIL_REQUEST_GET_IMSI:
-        return "GET_IMSI";
-    case RIL_REQUEST_HANGUP:
-        return "HANGUP";
-    case RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND:
-        return "HANGUP_WAITING_OR_BACKGROUND";
-    case RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND:
-        return "HANGUP_FOREGROUND_RESUME_BACKGROUND";
-    case RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE:
-        return "SWITCH_WAITING_OR_HOLDING_AND_ACTIVE";
-    case RIL_REQUEST_CONFERENCE:
-        return "CONFERENCE";
-    case RIL_REQUEST_UDUB:
-        return "UDUB";
-    case RIL_REQUEST_LAST_CALL_FAIL_CAUSE:
-        return "LAST_CALL_FAIL_CAUSE";
-    case RIL_REQUEST_SIGNAL_STRENGTH:
-        return "SIGNAL_STRENGTH";
-    case RIL_REQUEST_VOICE_REGISTRATION_STATE:
-        return "VOICE_REGISTRATION_STATE";
-    case RIL_REQUEST_DATA_REGISTRATION_STATE:
-        return "DATA_REGISTRATION_STATE";
-    case RIL_REQUEST_OPERATOR:
-        return "OPERATOR";
-    case RIL_REQUEST_RADIO_POWER:
-        return "RADIO_POWER";
-    case RIL_REQUEST_DTMF:
-        return "DTMF";
-    case RIL_REQUEST_SEND_SMS:
-        return "SEND_SMS";
-    case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
-        return "SEND_SMS_EXPECT_MORE";
-    case RIL_REQUEST_SETUP_DATA_CALL:
-        return "SETUP_DATA_CALL";
-    case RIL_REQUEST_SIM_IO:
-        return "SIM_IO";
-    case RIL_REQUEST_SEND_USSD:
-        return "SEND_USSD";
-    case RIL_REQUEST_CANCEL_USSD:
-        return "CANCEL_USSD";
-    case RIL_REQUEST_GET_CLIR:
-        return "GET_CLIR";
-    case RIL_REQUEST_SET_CLIR:
-        return "SET_CLIR";
-    case RIL_REQUEST_QUERY_CALL_FORWARD_STATUS:
-        return "QUERY_CALL_FORWARD_STATUS";
-    case RIL_REQUEST_SET_CALL_FORWARD:
-        return "SET_CALL_FORWARD";
-    case RIL_REQUEST_QUERY_CALL_WAITING:
-        return "QUERY_CALL_WAITING";
-    case RIL_REQUEST_SET_CALL_WAITING:
-        return "SET_CALL_WAITING";
-    case RIL_REQUEST_SMS_ACKNOWLEDGE:
-        return "SMS_ACKNOWLEDGE";
-    case RIL_REQUEST_GET_IMEI:
-        return "GET_IMEI";
-    case RIL_REQUEST_GET_IMEISV:
-        return "GET_IMEISV";
-    case RIL_REQUEST_ANSWER:
-        return "ANSWER";
-    case RIL_REQUEST_DEACTIVATE_DATA_CALL:
-        return "DEACTIVATE_DATA_CALL";
-    case RIL_REQUEST_QUERY_FACILITY_LOCK:
-        return "QUERY_FACILITY_LOCK";
-    case RIL_REQUEST_SET_FACILITY_LOCK:
-        return "SET_FACILITY_LOCK";
-    case RIL_REQUEST_CHANGE_BARRING_PASSWORD:
-        return "CHANGE_BARRING_PASSWORD";
-    case RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE:
-        return "QUERY_NETWORK_SELECTION_MODE";
-    case RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC:
-        return "SET_NETWORK_SELECTION_AUTOMATIC";
-    case RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL:
-        return "SET_NETWORK_SELECTION_MANUAL";
-    case RIL_REQUEST_QUERY_AVAILABLE_NETWORKS:
-        return "QUERY_AVAILABLE_NETWORKS ";
-    case RIL_REQUEST_DTMF_START:
-        return "DTMF_START";
-    case RIL_REQUEST_DTMF_STOP:
-        return "DTMF_STOP";
-    case RIL_REQUEST_BASEBAND_VERSION:
-        return "BASEBAND_VERSION";
-    case RIL_REQUEST_SEPARATE_CONNECTION:
-        return "SEPARATE_CONNECTION";
-    case RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE:
-        return "SET_PREFERRED_NETWORK_TYPE";
-    case RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE:
-        return "GET_PREFERRED_NETWORK_TYPE";
-    case RIL_REQUEST_GET_NEIGHBORING_CELL_IDS:
-        return "GET_NEIGHBORING_CELL_IDS";
-    case RIL_REQUEST_SET_MUTE:
-        return "SET_MUTE";
-    case RIL_REQUEST_GET_MUTE:
-        return "GET_MUTE";
-    case RIL_REQUEST_QUERY_CLIP:
-        return "QUERY_CLIP";
-    case RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE:
-        return "LAST_DATA_CALL_FAIL_CAUSE";
-    case RIL_REQUEST_DATA_CALL_LIST:
-        return "DATA_CALL_LIST";
-    case RIL_REQUEST_RESET_RADIO:
-        return "RESET_RADIO";
-    case RIL_REQUEST_OEM_HOOK_RAW:
-        return "OEM_HOOK_RAW";
-    case RIL_REQUEST_OEM_HOOK_STRINGS:
-        return "OEM_HOOK_STRINGS";
-    case RIL_REQUEST_SET_BAND_MODE:
-        return "SET_BAND_MODE";
-    case RIL_REQUEST_QUERY_AVAILABLE_BAND_MODE:
-        return "QUERY_AVAILABLE_BAND_MODE";
-    case RIL_REQUEST_STK_GET_PROFILE:
-        return "STK_GET_PROFILE";
-    case RIL_REQUEST_STK_SET_PROFILE:
-        return "STK_SET_PROFILE";
-    case RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND:
-        return "STK_SEND_ENVELOPE_COMMAND";
-    case RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE:
-        return "STK_SEND_TERMINAL_RESPONSE";
-    case RIL_REQUEST_STK_HANDLE_CALL_SETUP_REQUESTED_FROM_SIM:
-        return "STK_HANDLE_CALL_SETUP_REQUESTED_FROM_SIM";
-    case RIL_REQUEST_SCREEN_STATE:
-        return "SCREEN_STATE";
-    case RIL_REQUEST_EXPLICIT_CALL_TRANSFER:
-        return "EXPLICIT_CALL_TRANSFER";
-    case RIL_REQUEST_SET_LOCATION_UPDATES:
-        return "SET_LOCATION_UPDATES";
-    case RIL_REQUEST_SET_TTY_MODE:
-        return "SET_TTY_MODE";
-    case RIL_REQUEST_QUERY_TTY_MODE:
-        return "QUERY_TTY_MODE";
-    case RIL_REQUEST_GSM_GET_BROADCAST_SMS_CONFIG:
-        return "GSM_GET_BROADCAST_SMS_CONFIG";
-    case RIL_REQUEST_GSM_SET_BROADCAST_SMS_CONFIG:
-        return "GSM_SET_BROADCAST_SMS_CONFIG";
-    case RIL_REQUEST_DEVICE_IDENTITY:
-        return "DEVICE_IDENTITY";
-    case RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE:
-        return "EXIT_EMERGENCY_CALLBACK_MODE";
-    case RIL_REQUEST_GET_SMSC_ADDRESS:
-        return "GET_SMSC_ADDRESS";
-    case RIL_REQUEST_SET_SMSC_ADDRESS:
-        return "SET_SMSC_ADDRESS";
-    case RIL_REQUEST_REPORT_SMS_MEMORY_STATUS:
-        return "REPORT_SMS_MEMORY_STATUS";
-    case RIL_REQUEST_REPORT_STK_SERVICE_IS_RUNNING:
-        return "REPORT_STK_SERVICE_IS_RUNNING";
-    case RIL_REQUEST_ISIM_AUTHENTICATION:
-        return "ISIM_AUTHENTICATION";
-    case RIL_REQUEST_ACKNOWLEDGE_INCOMING_GSM_SMS_WITH_PDU:
-        return "RIL_REQUEST_ACKNOWLEDGE_INCOMING_GSM_SMS_WITH_PDU";
-    case RIL_REQUEST_STK_SEND_ENVELOPE_WITH_STATUS:
-        return "RIL_REQUEST_STK_SEND_ENVELOPE_WITH_STATUS";
-    case RIL_REQUEST_VOICE_RADIO_TECH:
-        return "VOICE_RADIO_TECH";
-    case RIL_REQUEST_WRITE_SMS_TO_SIM:
-        return "WRITE_SMS_TO_SIM";
-    case RIL_REQUEST_GET_CELL_INFO_LIST:
-        return "GET_CELL_INFO_LIST";
-    case RIL_REQUEST_SET_UNSOL_CELL_INFO_LIST_RATE:
-        return "SET_UNSOL_CELL_INFO_LIST_RATE";
-    case RIL_REQUEST_SET_INITIAL_ATTACH_APN:
-        return "RIL_REQUEST_SET_INITIAL_ATTACH_APN";
-    case RIL_REQUEST_IMS_REGISTRATION_STATE:
-        return "IMS_REGISTRATION_STATE";
-    case RIL_REQUEST_IMS_SEND_SMS:
-        return "IMS_SEND_SMS";
-    case RIL_REQUEST_SIM_TRANSMIT_APDU_BASIC:
-        return "SIM_TRANSMIT_APDU_BASIC";
-    case RIL_REQUEST_SIM_OPEN_CHANNEL:
-        return "SIM_OPEN_CHANNEL";
-    case RIL_REQUEST_SIM_CLOSE_CHANNEL:
-        return "SIM_CLOSE_CHANNEL";
-    case RIL_REQUEST_SIM_TRANSMIT_APDU_CHANNEL:
-        return "SIM_TRANSMIT_APDU_CHANNEL";
-    case RIL_REQUEST_SET_DATA_PROFILE:
-        return "SET_DATA_PROFILE";
-    case RIL_REQUEST_GET_ACTIVITY_INFO:
-        return "RIL_REQUEST_GET_ACTIVITY_INFO";
-    case RIL_REQUEST_GET_MODEM_STATUS:
-        return "GET_MODEM_STATUS";
-    case RIL_REQUEST_EMERGENCY_DIAL:
-        return "EMERGENCY_DIAL";
-    case RIL_REQUEST_ENABLE_MODEM:
-        return "RIL_REQUEST_ENABLE_MODEM";
-    case RIL_REQUEST_IMS_REG_STATE_CHANGE:
-        return "IMS_REG_STATE_CHANGE";
-    case RIL_REQUEST_IMS_SET_SERVICE_STATUS:
-        return "IMS_SET_SERVICE_STATUS";
-    case RIL_REQUEST_DIAL_CONFERENCE:
-        return "DIAL_CONFERENCE";
-    case RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED:
-        return "UNSOL_RESPONSE_RADIO_STATE_CHANGED";
-    case RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED:
-        return "UNSOL_RESPONSE_CALL_STATE_CHANGED";
-    case RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED:
-        return "UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED";
-    case RIL_UNSOL_RESPONSE_NEW_SMS:
-        return "UNSOL_RESPONSE_NEW_SMS";
-    case RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT:
-        return "UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT";
-    case RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM:
-        return "UNSOL_RESPONSE_NEW_SMS_ON_SIM";
-    case RIL_UNSOL_ON_USSD:
-        return "UNSOL_ON_USSD";
-    case RIL_UNSOL_ON_USSD_REQUEST:
-        return "UNSOL_ON_USSD_REQUEST(obsolete)";
-    case RIL_UNSOL_NITZ_TIME_RECEIVED:
-        return "UNSOL_NITZ_TIME_RECEIVED";
-    case RIL_UNSOL_SIGNAL_STRENGTH:
-        return "UNSOL_SIGNAL_STRENGTH";
-    case RIL_UNSOL_SUPP_SVC_NOTIFICATION:
-        return "UNSOL_SUPP_SVC_NOTIFICATION";
-    case RIL_UNSOL_STK_SESSION_END:
-        return "UNSOL_STK_SESSION_END";
-    case RIL_UNSOL_STK_PROACTIVE_COMMAND:
-        return "UNSOL_STK_PROACTIVE_COMMAND";
-    case RIL_UNSOL_STK_EVENT_NOTIFY:
-        return "UNSOL_STK_EVENT_NOTIFY";
-    case RIL_UNSOL_STK_CALL_SETUP:
-        return "UNSOL_STK_CALL_SETUP";
-    case RIL_UNSOL_SIM_SMS_STORAGE_FULL:
-        return "UNSOL_SIM_SMS_STORAGE_FUL";
-    case RIL_UNSOL_SIM_REFRESH:
-        return "UNSOL_SIM_REFRESH";
-    case RIL_UNSOL_DATA_CALL_LIST_CHANGED:
-        return "UNSOL_DATA_CALL_LIST_CHANGED";
-    case RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED:
-        return "UNSOL_RESPONSE_SIM_STATUS_CHANGED";
-    case RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS:
-        return "UNSOL_NEW_BROADCAST_SMS";
-    case RIL_UNSOL_RESTRICTED_STATE_CHANGED:
-        return "UNSOL_RESTRICTED_STATE_CHANGED";
-    case RIL_UNSOL_ENTER_EMERGENCY_CALLBACK_MODE:
-        return "UNSOL_ENTER_EMERGENCY_CALLBACK_MODE";
-    case RIL_UNSOL_OEM_HOOK_RAW:
-        return "UNSOL_OEM_HOOK_RAW";
-    case RIL_UNSOL_RINGBACK_TONE:
-        return "UNSOL_RINGBACK_TONE";
-    case RIL_UNSOL_RESEND_INCALL_MUTE:
-        return "UNSOL_RESEND_INCALL_MUTE";
-    case RIL_UNSOL_EXIT_EMERGENCY_CALLBACK_MODE:
-        return "UNSOL_EXIT_EMERGENCY_CALLBACK_MODE";
-    case RIL_UNSOL_RIL_CONNECTED:
-        return "UNSOL_RIL_CONNECTED";
-    case RIL_UNSOL_VOICE_RADIO_TECH_CHANGED:
-        return "UNSOL_VOICE_RADIO_TECH_CHANGED";
-    case RIL_UNSOL_CELL_INFO_LIST:
-        return "UNSOL_CELL_INFO_LIST";
-    case RIL_UNSOL_RESPONSE_IMS_NETWORK_STATE_CHANGED:
-        return "RESPONSE_IMS_NETWORK_STATE_CHANGED";
-    case RIL_UNSOL_MODEM_RESTART:
-        return "RIL_UNSOL_MODEM_RESTART";
-    default:
-        return "<unknown request>";
+    const CommandInfo* pCI = findCommandInfo(request);
+    unsigned int unsolIndex = request - RIL_UNSOL_RESPONSE_BASE;
+
+    if (pCI != NULL && pCI->name != NULL) {
+        return pCI->name;
+    }
+
+    if (unsolIndex < NUM_ELEMS(s_unsolResponses) && s_unsolResponses[unsolIndex].name != NULL) {
+        return s_unsolResponses[unsolIndex].name;
+    }
+
+    return "<unknown request>";
+}
+
+/**
+ * Reverse of requestToString, for tools and the debug socket. Takes the
+ * name with or without its RIL_REQUEST_ or RIL_ prefix.
+ *
+ * Returns the request or unsolicited response number, -1 if unknown
+ */
+extern "C" int requestFromString(const char* name)
+{
+    if (strncmp(name, "RIL_REQUEST_", 12) == 0) {
+        name += 12;
+    } else if (strncmp(name, "RIL_", 4) == 0) {
+        name += 4;
     }
+
+    for (const CommandRange& range : s_commandRanges) {
+        for (int i = 0; i < range.count; i++) {
+            if (range.commands[i].name != NULL && strcmp(range.commands[i].name, name) == 0) {
+                return range.commands[i].requestNumber;
+            }
+        }
+    }
+
+    for (const UnsolResponseInfo& unsol : s_unsolResponses) {
+        if (unsol.name != NULL && strcmp(unsol.name, name) == 0) {
+            return unsol.requestNumber;
+        }
+    }
+
+    return -1;
 }
@@ -14,151 +14,151 @@
 ** See the License for the specific language governing permissions and
 ** limitations under the License.
 */
-{ 0, NULL, NULL }, // none
-    { RIL_REQUEST_GET_SIM_STATUS, dispatchVoid, responseSimStatus },
-    { RIL_REQUEST_ENTER_SIM_PIN, dispatchStrings, responseInts },
-    { RIL_REQUEST_ENTER_SIM_PUK, dispatchStrings, responseInts },
-    { RIL_REQUEST_ENTER_SIM_PIN2, dispatchStrings, responseInts },
-    { RIL_REQUEST_ENTER_SIM_PUK2, dispatchStrings, responseInts },
-    { RIL_REQUEST_CHANGE_SIM_PIN, dispatchStrings, responseInts },
-    { RIL_REQUEST_CHANGE_SIM_PIN2, dispatchStrings, responseInts },
-    { RIL_REQUEST_ENTER_NETWORK_DEPERSONALIZATION, dispatchStrings, responseInts },
-    { RIL_REQUEST_GET_CURRENT_CALLS, dispatchVoid, responseCallList },
-    { RIL_REQUEST_DIAL, dispatchDial, responseVoid },
-    { RIL_REQUEST_GET_IMSI, dispatchStrings, responseString },
-    { RIL_REQUEST_HANGUP, dispatchInts, responseVoid },
-    { RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND, dispatchVoid, responseVoid },
-    { RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND, dispatchVoid, responseVoid },
-    { RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE, dispatchVoid, responseVoid },
-    { RIL_REQUEST_CONFERENCE, dispatchVoid, responseVoid },
-    { RIL_REQUEST_UDUB, dispatchVoid, responseVoid },
-    { RIL_REQUEST_LAST_CALL_FAIL_CAUSE, dispatchVoid, responseInts },
-    { RIL_REQUEST_SIGNAL_STRENGTH, dispatchVoid, responseRilSignalStrength },
-    { RIL_REQUEST_VOICE_REGISTRATION_STATE, dispatchVoid, responseStrings },
-    { RIL_REQUEST_DATA_REGISTRATION_STATE, dispatchVoid, responseStrings },
-    { RIL_REQUEST_OPERATOR, dispatchVoid, responseStrings },
-    { RIL_REQUEST_RADIO_POWER, dispatchInts, responseVoid },
-    { RIL_REQUEST_DTMF, dispatchString, responseVoid },
-    { RIL_REQUEST_SEND_SMS, dispatchStrings, responseSMS },
-    { RIL_REQUEST_SEND_SMS_EXPECT_MORE, dispatchStrings, responseSMS },
-    { RIL_REQUEST_SETUP_DATA_CALL, dispatchDataCall, responseSetupDataCall },
-    { RIL_REQUEST_SIM_IO, dispatchSIM_IO, responseSIM_IO },
-    { RIL_REQUEST_SEND_USSD, dispatchString, responseVoid },
-    { RIL_REQUEST_CANCEL_USSD, dispatchVoid, responseVoid },
-    { RIL_REQUEST_GET_CLIR, dispatchVoid, responseInts },
-    { RIL_REQUEST_SET_CLIR, dispatchInts, responseVoid },
-    { RIL_REQUEST_QUERY_CALL_FORWARD_STATUS, dispatchCallForward, responseCallForwards },
-    { RIL_REQUEST_SET_CALL_FORWARD, dispatchCallForward, responseVoid },
-    { RIL_REQUEST_QUERY_CALL_WAITING, dispatchInts, responseInts },
-    { RIL_REQUEST_SET_CALL_WAITING, dispatchInts, responseVoid },
-    { RIL_REQUEST_SMS_ACKNOWLEDGE, dispatchInts, responseVoid },
-    { RIL_REQUEST_GET_IMEI, dispatchVoid, responseString },
-    { RIL_REQUEST_GET_IMEISV, dispatchVoid, responseString },
-    { RIL_REQUEST_ANSWER, dispatchVoid, responseVoid },
-    { RIL_REQUEST_DEACTIVATE_DATA_CALL, dispatchStrings, responseVoid },
-    { RIL_REQUEST_QUERY_FACILITY_LOCK, dispatchStrings, responseInts },
-    { RIL_REQUEST_SET_FACILITY_LOCK, dispatchStrings, responseInts },
-    { RIL_REQUEST_CHANGE_BARRING_PASSWORD, dispatchStrings, responseVoid },
-    { RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE, dispatchVoid, responseInts },
-    { RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC, dispatchVoid, responseVoid },
-    { RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL, dispatchManualSelection, responseVoid },
-    { RIL_REQUEST_QUERY_AVAILABLE_NETWORKS, dispatchVoid, responseStrings },
-    { RIL_REQUEST_DTMF_START, dispatchString, responseVoid },
-    { RIL_REQUEST_DTMF_STOP, dispatchVoid, responseVoid },
-    { RIL_REQUEST_BASEBAND_VERSION, dispatchVoid, responseString },
-    { RIL_REQUEST_SEPARATE_CONNECTION, dispatchInts, responseVoid },
-    { RIL_REQUEST_SET_MUTE, dispatchInts, responseVoid },
-    { RIL_REQUEST_GET_MUTE, dispatchVoid, responseInts },
-    { RIL_REQUEST_QUERY_CLIP, dispatchVoid, responseInts },
-    { RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE, dispatchVoid, responseInts },
-    { RIL_REQUEST_DATA_CALL_LIST, dispatchVoid, responseDataCallList },
-    { RIL_REQUEST_RESET_RADIO, dispatchVoid, responseVoid },
-    { RIL_REQUEST_OEM_HOOK_RAW, dispatchRaw, responseRaw },
-    { RIL_REQUEST_OEM_HOOK_STRINGS, dispatchStrings, responseStrings },
-    { RIL_REQUEST_SCREEN_STATE, dispatchInts, responseVoid },
-    { RIL_REQUEST_SET_SUPP_SVC_NOTIFICATION, dispatchInts, responseVoid },
-    { RIL_REQUEST_WRITE_SMS_TO_SIM, dispatchSmsWrite, responseInts },
-    { RIL_REQUEST_DELETE_SMS_ON_SIM, dispatchInts, responseVoid },
-    { RIL_REQUEST_SET_BAND_MODE, dispatchInts, responseVoid },
-    { RIL_REQUEST_QUERY_AVAILABLE_BAND_MODE, dispatchVoid, responseInts },
-    { RIL_REQUEST_STK_GET_PROFILE, dispatchVoid, responseString },
-    { RIL_REQUEST_STK_SET_PROFILE, dispatchString, responseVoid },
-    { RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND, dispatchString, responseString },
-    { RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE, dispatchString, responseVoid },
-    { RIL_REQUEST_STK_HANDLE_CALL_SETUP_REQUESTED_FROM_SIM, dispatchInts, responseVoid },
-    { RIL_REQUEST_EXPLICIT_CALL_TRANSFER, dispatchVoid, responseVoid },
-    { RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE, dispatchInts, responseVoid },
-    { RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE, dispatchVoid, responseInts },
-    { RIL_REQUEST_GET_NEIGHBORING_CELL_IDS, dispatchVoid, responseCellList },
-    { RIL_REQUEST_SET_LOCATION_UPDATES, dispatchInts, responseVoid },
-    { 77, NULL, NULL },
-    { 78, NULL, NULL },
-    { 79, NULL, NULL },
-    { RIL_REQUEST_SET_TTY_MODE, dispatchInts, responseVoid },
-    { RIL_REQUEST_QUERY_TTY_MODE, dispatchVoid, responseInts },
-    { 82, NULL, NULL },
-    { 83, NULL, NULL },
-    { 84, NULL, NULL },
-    { 85, NULL, NULL },
-    { 86, NULL, NULL },
-    { 87, NULL, NULL },
-    { 88, NULL, NULL },
-    { RIL_REQUEST_GSM_GET_BROADCAST_SMS_CONFIG, dispatchVoid, responseGsmBrSmsCnf },
-    { RIL_REQUEST_GSM_SET_BROADCAST_SMS_CONFIG, dispatchGsmBrSmsCnf, responseVoid },
-    { RIL_REQUEST_GSM_SMS_BROADCAST_ACTIVATION, dispatchInts, responseVoid },
-    { 92, NULL, NULL },
-    { 93, NULL, NULL },
-    { 94, NULL, NULL },
-    { 95, NULL, NULL },
-    { 96, NULL, NULL },
-    { 97, NULL, NULL },
-    { RIL_REQUEST_DEVICE_IDENTITY, dispatchVoid, responseStrings },
-    { RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE, dispatchVoid, responseVoid },
-    { RIL_REQUEST_GET_SMSC_ADDRESS, dispatchVoid, responseString },
-    { RIL_REQUEST_SET_SMSC_ADDRESS, dispatchString, responseVoid },
-    { RIL_REQUEST_REPORT_SMS_MEMORY_STATUS, dispatchInts, responseVoid },
-    { RIL_REQUEST_REPORT_STK_SERVICE_IS_RUNNING, dispatchVoid, responseVoid },
-    { 104, NULL, NULL },
-    { RIL_REQUEST_ISIM_AUTHENTICATION, dispatchString, responseString },
-    { RIL_REQUEST_ACKNOWLEDGE_INCOMING_GSM_SMS_WITH_PDU, dispatchStrings, responseVoid },
-    { RIL_REQUEST_STK_SEND_ENVELOPE_WITH_STATUS, dispatchString, responseSIM_IO },
-    { RIL_REQUEST_VOICE_RADIO_TECH, dispatchVoiceRadioTech, responseInts },
-    { RIL_REQUEST_GET_CELL_INFO_LIST, dispatchVoid, responseCellInfoList },
-    { RIL_REQUEST_SET_UNSOL_CELL_INFO_LIST_RATE, dispatchInts, responseVoid },
-    { RIL_REQUEST_SET_INITIAL_ATTACH_APN, dispatchSetInitialAttachApn, responseVoid },
-    { 112, NULL, NULL },
-    { RIL_REQUEST_IMS_SEND_SMS, dispatchImsSms, responseSMS },
-    { RIL_REQUEST_SIM_TRANSMIT_APDU_BASIC, dispatchSIM_APDU, responseSIM_IO },
-    { RIL_REQUEST_SIM_OPEN_CHANNEL, dispatchString, responseInts },
-    { RIL_REQUEST_SIM_CLOSE_CHANNEL, dispatchInts, responseVoid },
-    { RIL_REQUEST_SIM_TRANSMIT_APDU_CHANNEL, dispatchSIM_APDU, responseSIM_IO },
-    { 118, NULL, NULL },
-    { 119, NULL, NULL },
-    { 120, NULL, NULL },
-    { 121, NULL, NULL },
-    { 122, NULL, NULL },
-    { RIL_REQUEST_ALLOW_DATA, dispatchInts, responseVoid },
-    { 124, NULL, NULL },
-    { 125, NULL, NULL },
-    { 126, NULL, NULL },
-    { 127, NULL, NULL },
-    { RIL_REQUEST_SET_DATA_PROFILE, dispatchDataProfile, responseVoid },
-    { 129, dispatchVoid, responseVoid },
-    { 130, NULL, NULL },
-    { 131, NULL, NULL },
-    { 132, dispatchInts, NULL },
-    { 133, dispatchVoid, NULL },
-    { 134, NULL, NULL },
-    { RIL_REQUEST_GET_ACTIVITY_INFO, dispatchVoid, responseActivityData },
-    { 136, NULL, NULL },
-    { 137, NULL, NULL },
-    { 138, NULL, NULL },
-    { 139, NULL, NULL },
-    { 140, NULL, NULL },
-    { 141, NULL, NULL },
-    { 142, NULL, NULL },
-    { 143, NULL, NULL },
-    { 144, NULL, NULL },
-    { 145, NULL, NULL },
-    { RIL_REQUEST_ENABLE_MODEM, dispatchInts, responseVoid },
-    { RIL_REQUEST_GET_MODEM_STATUS, dispatchVoid, responseInts },
\ No newline at end of file
+UNUSED_COMMAND(0), // none
+    COMMAND(GET_SIM_STATUS, dispatchVoid, responseSimStatus, QUEUE_SIM, CACHE_IN_FLIGHT, 30),
+    COMMAND(ENTER_SIM_PIN, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(ENTER_SIM_PUK, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(ENTER_SIM_PIN2, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(ENTER_SIM_PUK2, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(CHANGE_SIM_PIN, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(CHANGE_SIM_PIN2, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(ENTER_NETWORK_DEPERSONALIZATION, dispatchStrings, responseInts, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(GET_CURRENT_CALLS, dispatchVoid, responseCallList, QUEUE_CALL, CACHE_IN_FLIGHT, 30),
+    COMMAND(DIAL, dispatchDial, responseVoid, QUEUE_CALL, CACHE_NONE, 60),
+    COMMAND(GET_IMSI, dispatchStrings, responseString, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(HANGUP, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(HANGUP_WAITING_OR_BACKGROUND, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(HANGUP_FOREGROUND_RESUME_BACKGROUND, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SWITCH_WAITING_OR_HOLDING_AND_ACTIVE, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(CONFERENCE, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(UDUB, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(LAST_CALL_FAIL_CAUSE, dispatchVoid, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SIGNAL_STRENGTH, dispatchVoid, responseRilSignalStrength, QUEUE_NETWORK, CACHE_IN_FLIGHT, 30),
+    COMMAND(VOICE_REGISTRATION_STATE, dispatchVoid, responseStrings, QUEUE_NETWORK, CACHE_IN_FLIGHT, 30),
+    COMMAND(DATA_REGISTRATION_STATE, dispatchVoid, responseStrings, QUEUE_DATA, CACHE_IN_FLIGHT, 30),
+    COMMAND(OPERATOR, dispatchVoid, responseStrings, QUEUE_SIM, CACHE_IN_FLIGHT, 30),
+    COMMAND(RADIO_POWER, dispatchInts, responseVoid, QUEUE_MODEM, CACHE_NONE, 60),
+    COMMAND(DTMF, dispatchString, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SEND_SMS, dispatchStrings, responseSMS, QUEUE_SMS, CACHE_NONE, 60),
+    COMMAND(SEND_SMS_EXPECT_MORE, dispatchStrings, responseSMS, QUEUE_SMS, CACHE_NONE, 60),
+    COMMAND(SETUP_DATA_CALL, dispatchDataCall, responseSetupDataCall, QUEUE_DATA, CACHE_NONE, 120),
+    COMMAND(SIM_IO, dispatchSIM_IO, responseSIM_IO, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(SEND_USSD, dispatchString, responseVoid, QUEUE_SIM, CACHE_NONE, 60),
+    COMMAND(CANCEL_USSD, dispatchVoid, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(GET_CLIR, dispatchVoid, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SET_CLIR, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(QUERY_CALL_FORWARD_STATUS, dispatchCallForward, responseCallForwards, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SET_CALL_FORWARD, dispatchCallForward, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(QUERY_CALL_WAITING, dispatchInts, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SET_CALL_WAITING, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SMS_ACKNOWLEDGE, dispatchInts, responseVoid, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(GET_IMEI, dispatchVoid, responseString, QUEUE_MODEM, CACHE_STATIC, 30),
+    COMMAND(GET_IMEISV, dispatchVoid, responseString, QUEUE_MODEM, CACHE_STATIC, 30),
+    COMMAND(ANSWER, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(DEACTIVATE_DATA_CALL, dispatchStrings, responseVoid, QUEUE_DATA, CACHE_NONE, 60),
+    COMMAND(QUERY_FACILITY_LOCK, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(SET_FACILITY_LOCK, dispatchStrings, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(CHANGE_BARRING_PASSWORD, dispatchStrings, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(QUERY_NETWORK_SELECTION_MODE, dispatchVoid, responseInts, QUEUE_NETWORK, CACHE_IN_FLIGHT, 30),
+    COMMAND(SET_NETWORK_SELECTION_AUTOMATIC, dispatchVoid, responseVoid, QUEUE_NETWORK, CACHE_NONE, 120),
+    COMMAND(SET_NETWORK_SELECTION_MANUAL, dispatchManualSelection, responseVoid, QUEUE_NETWORK, CACHE_NONE, 120),
+    COMMAND(QUERY_AVAILABLE_NETWORKS, dispatchVoid, responseStrings, QUEUE_NETWORK, CACHE_NONE, 180),
+    COMMAND(DTMF_START, dispatchString, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(DTMF_STOP, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(BASEBAND_VERSION, dispatchVoid, responseString, QUEUE_MODEM, CACHE_STATIC, 30),
+    COMMAND(SEPARATE_CONNECTION, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(SET_MUTE, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(GET_MUTE, dispatchVoid, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(QUERY_CLIP, dispatchVoid, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(LAST_DATA_CALL_FAIL_CAUSE, dispatchVoid, responseInts, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(DATA_CALL_LIST, dispatchVoid, responseDataCallList, QUEUE_DATA, CACHE_IN_FLIGHT, 30),
+    COMMAND(RESET_RADIO, dispatchVoid, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(OEM_HOOK_RAW, dispatchRaw, responseRaw, QUEUE_MODEM, CACHE_NONE, 30),
+    COMMAND(OEM_HOOK_STRINGS, dispatchStrings, responseStrings, QUEUE_MODEM, CACHE_NONE, 30),
+    COMMAND(SCREEN_STATE, dispatchInts, responseVoid, QUEUE_MODEM, CACHE_NONE, 30),
+    COMMAND(SET_SUPP_SVC_NOTIFICATION, dispatchInts, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(WRITE_SMS_TO_SIM, dispatchSmsWrite, responseInts, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(DELETE_SMS_ON_SIM, dispatchInts, responseVoid, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(SET_BAND_MODE, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(QUERY_AVAILABLE_BAND_MODE, dispatchVoid, responseInts, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(STK_GET_PROFILE, dispatchVoid, responseString, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(STK_SET_PROFILE, dispatchString, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(STK_SEND_ENVELOPE_COMMAND, dispatchString, responseString, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(STK_SEND_TERMINAL_RESPONSE, dispatchString, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(STK_HANDLE_CALL_SETUP_REQUESTED_FROM_SIM, dispatchInts, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(EXPLICIT_CALL_TRANSFER, dispatchVoid, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(SET_PREFERRED_NETWORK_TYPE, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(GET_PREFERRED_NETWORK_TYPE, dispatchVoid, responseInts, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(GET_NEIGHBORING_CELL_IDS, dispatchVoid, responseCellList, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(SET_LOCATION_UPDATES, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    UNUSED_COMMAND(77),
+    UNUSED_COMMAND(78),
+    UNUSED_COMMAND(79),
+    COMMAND(SET_TTY_MODE, dispatchInts, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(QUERY_TTY_MODE, dispatchVoid, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    UNUSED_COMMAND(82),
+    UNUSED_COMMAND(83),
+    UNUSED_COMMAND(84),
+    UNUSED_COMMAND(85),
+    UNUSED_COMMAND(86),
+    UNUSED_COMMAND(87),
+    UNUSED_COMMAND(88),
+    COMMAND(GSM_GET_BROADCAST_SMS_CONFIG, dispatchVoid, responseGsmBrSmsCnf, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(GSM_SET_BROADCAST_SMS_CONFIG, dispatchGsmBrSmsCnf, responseVoid, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(GSM_SMS_BROADCAST_ACTIVATION, dispatchInts, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    UNUSED_COMMAND(92),
+    UNUSED_COMMAND(93),
+    UNUSED_COMMAND(94),
+    UNUSED_COMMAND(95),
+    UNUSED_COMMAND(96),
+    UNUSED_COMMAND(97),
+    COMMAND(DEVICE_IDENTITY, dispatchVoid, responseStrings, QUEUE_MODEM, CACHE_STATIC, 30),
+    COMMAND(EXIT_EMERGENCY_CALLBACK_MODE, dispatchVoid, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(GET_SMSC_ADDRESS, dispatchVoid, responseString, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(SET_SMSC_ADDRESS, dispatchString, responseVoid, QUEUE_SMS, CACHE_NONE, 30),
+    COMMAND(REPORT_SMS_MEMORY_STATUS, dispatchInts, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(REPORT_STK_SERVICE_IS_RUNNING, dispatchVoid, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    UNUSED_COMMAND(104),
+    COMMAND(ISIM_AUTHENTICATION, dispatchString, responseString, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(ACKNOWLEDGE_INCOMING_GSM_SMS_WITH_PDU, dispatchStrings, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(STK_SEND_ENVELOPE_WITH_STATUS, dispatchString, responseSIM_IO, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(VOICE_RADIO_TECH, dispatchVoiceRadioTech, responseInts, QUEUE_CALL, CACHE_NONE, 30),
+    COMMAND(GET_CELL_INFO_LIST, dispatchVoid, responseCellInfoList, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(SET_UNSOL_CELL_INFO_LIST_RATE, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(SET_INITIAL_ATTACH_APN, dispatchSetInitialAttachApn, responseVoid, QUEUE_DATA, CACHE_NONE, 30),
+    UNUSED_COMMAND(112),
+    COMMAND(IMS_SEND_SMS, dispatchImsSms, responseSMS, QUEUE_SMS, CACHE_NONE, 60),
+    COMMAND(SIM_TRANSMIT_APDU_BASIC, dispatchSIM_APDU, responseSIM_IO, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(SIM_OPEN_CHANNEL, dispatchString, responseInts, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(SIM_CLOSE_CHANNEL, dispatchInts, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(SIM_TRANSMIT_APDU_CHANNEL, dispatchSIM_APDU, responseSIM_IO, QUEUE_SIM, CACHE_NONE, 30),
+    UNUSED_COMMAND(118),
+    UNUSED_COMMAND(119),
+    UNUSED_COMMAND(120),
+    UNUSED_COMMAND(121),
+    UNUSED_COMMAND(122),
+    COMMAND(ALLOW_DATA, dispatchInts, responseVoid, QUEUE_DATA, CACHE_NONE, 30),
+    UNUSED_COMMAND(124),
+    UNUSED_COMMAND(125),
+    UNUSED_COMMAND(126),
+    UNUSED_COMMAND(127),
+    COMMAND(SET_DATA_PROFILE, dispatchDataProfile, responseVoid, QUEUE_DATA, CACHE_NONE, 30),
+    UNNAMED_COMMAND(129, dispatchVoid, responseVoid),
+    UNUSED_COMMAND(130),
+    UNUSED_COMMAND(131),
+    UNNAMED_COMMAND(132, dispatchInts, NULL),
+    UNNAMED_COMMAND(133, dispatchVoid, NULL),
+    UNUSED_COMMAND(134),
+    COMMAND(GET_ACTIVITY_INFO, dispatchVoid, responseActivityData, QUEUE_MODEM, CACHE_NONE, 30),
+    UNUSED_COMMAND(136),
+    UNUSED_COMMAND(137),
+    UNUSED_COMMAND(138),
+    UNUSED_COMMAND(139),
+    UNUSED_COMMAND(140),
+    UNUSED_COMMAND(141),
+    UNUSED_COMMAND(142),
+    UNUSED_COMMAND(143),
+    UNUSED_COMMAND(144),
+    UNUSED_COMMAND(145),
+    COMMAND(ENABLE_MODEM, dispatchInts, responseVoid, QUEUE_MODEM, CACHE_NONE, 30),
+    COMMAND(GET_MODEM_STATUS, dispatchVoid, responseInts, QUEUE_MODEM, CACHE_NONE, 30),
\ No newline at end of file
@@ -14,6 +14,10 @@
 ** See the License for the specific language governing permissions and
 ** limitations under the License.
 */
-{ 0, NULL, NULL }, // none
+UNUSED_COMMAND(0), // none
                    // 2000
-    { RIL_REQUEST_SET_EMERGENCY_NUMBER, NULL, NULL },
+    COMMAND(SET_EMERGENCY_NUMBER, NULL, NULL, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(SET_UNSOL_SUBSCRIPTIONS, dispatchSetUnsolSubscriptions, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 30),
+    COMMAND(WITH_DEADLINE, NULL, NULL, QUEUE_DEFAULT, CACHE_NONE, 0),
+    COMMAND(CANCEL_REQUEST, dispatchCancelRequest, responseVoid, QUEUE_DEFAULT, CACHE_NONE, 0),
+    COMMAND(SETUP_SHARED_RING, dispatchSetupSharedRing, responseInts, QUEUE_DEFAULT, CACHE_NONE, 0),
@@ -28,6 +28,14 @@
 #include <ril_event.h>
 #include <telephony/ril.h>
 
+#if RIL_EVENT_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#if RIL_EVENT_USE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+
 static pthread_mutex_t listMutex;
 #define MUTEX_ACQUIRE() pthread_mutex_lock(&listMutex)
 #define MUTEX_RELEASE() pthread_mutex_unlock(&listMutex)
@@ -53,6 +61,10 @@ static pthread_mutex_t listMutex;
             : (a)->tv_sec op(b)->tv_sec)
 #endif
 
+#ifndef timerclear
+#define timerclear(tvp) ((tvp)->tv_sec = (tvp)->tv_usec = 0)
+#endif
+
 #ifndef timersub
 #define timersub(a, b, res)                           \
     do {                                              \
@@ -65,13 +77,52 @@ static pthread_mutex_t listMutex;
     } while (0);
 #endif
 
+#if RIL_EVENT_USE_EPOLL
+// Max number of ready fd's collected by a single epoll_wait(). Watches are
+// level triggered, so anything left over is reported again next iteration.
+#define MAX_READY_EVENTS 16
+
+// ev->index is 0 while ev is registered with epollFd and -1 otherwise
+static int epollFd = -1;
+
+// Registered watches by fd. epoll hands back the fd and the generation of
+// the registration, not ev, so a watch removed, and maybe freed, since
+// epoll_wait() returned is never touched.
+typedef struct {
+    struct ril_event* ev; // NULL if fd is not watched
+    uint32_t generation;
+} FdWatch;
+
+static FdWatch* fd_watches = NULL;
+static int fd_watch_capacity = 0;
+static uint32_t watch_generation = 0;
+#else
 static fd_set readFds;
+static fd_set writeFds;
 static int nfds = 0;
 
 static struct ril_event* watch_table[MAX_FD_EVENTS];
-static struct ril_event timer_list;
+#endif
+// Armed timers form a binary min-heap ordered on ev->timeout, so arming
+// and cancelling a timer is O(log n) regardless of how many are armed.
+// ev->index holds the heap slot of an armed timer and -1 otherwise.
+#define TIMER_HEAP_INIT_SIZE 16
+
+static struct ril_event** timer_heap = NULL;
+static int timer_count = 0;
+static int timer_capacity = 0;
+
 static struct ril_event pending_list;
 
+#if RIL_EVENT_USE_TIMERFD
+// Armed for the root of timer_heap, so the loop can block with no timeout.
+// timerFd stays -1 if timerfd_create() fails, and the loop falls back to
+// computing its timeout from the heap.
+static int timerFd = -1;
+static struct ril_event timerfd_event;
+static struct timeval timerfd_deadline;
+#endif
+
 #define DEBUG 0
 
 #if DEBUG
@@ -134,6 +185,146 @@ static void removeFromList(struct ril_event* ev)
     dlog("~~~~ -removeFromList ~~~~");
 }
 
+static void heapSet(int index, struct ril_event* ev)
+{
+    timer_heap[index] = ev;
+    ev->index = index;
+}
+
+static void heapSiftUp(int index)
+{
+    struct ril_event* ev = timer_heap[index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+
+        if (!timercmp(&ev->timeout, &timer_heap[parent]->timeout, <)) {
+            break;
+        }
+        heapSet(index, timer_heap[parent]);
+        index = parent;
+    }
+    heapSet(index, ev);
+}
+
+static void heapSiftDown(int index)
+{
+    struct ril_event* ev = timer_heap[index];
+
+    for (;;) {
+        int child = 2 * index + 1;
+
+        if (child >= timer_count) {
+            break;
+        }
+        if (child + 1 < timer_count
+            && timercmp(&timer_heap[child + 1]->timeout, &timer_heap[child]->timeout, <)) {
+            child++;
+        }
+        if (!timercmp(&timer_heap[child]->timeout, &ev->timeout, <)) {
+            break;
+        }
+        heapSet(index, timer_heap[child]);
+        index = child;
+    }
+    heapSet(index, ev);
+}
+
+static int heapInsert(struct ril_event* ev)
+{
+    if (timer_count == timer_capacity) {
+        int capacity = timer_capacity ? timer_capacity * 2 : TIMER_HEAP_INIT_SIZE;
+        struct ril_event** heap;
+
+        heap = (struct ril_event**)realloc(timer_heap, capacity * sizeof(*heap));
+        if (heap == NULL) {
+            RLOGE("ril_event: no memory for %d timers", capacity);
+            return -1;
+        }
+        timer_heap = heap;
+        timer_capacity = capacity;
+    }
+
+    heapSet(timer_count++, ev);
+    heapSiftUp(ev->index);
+    return 0;
+}
+
+static void heapRemove(struct ril_event* ev)
+{
+    int index = ev->index;
+    struct ril_event* last = timer_heap[--timer_count];
+
+    ev->index = -1;
+    if (last == ev) {
+        return;
+    }
+
+    heapSet(index, last);
+    if (index > 0 && timercmp(&last->timeout, &timer_heap[(index - 1) / 2]->timeout, <)) {
+        heapSiftUp(index);
+    } else {
+        heapSiftDown(index);
+    }
+}
+
+#if RIL_EVENT_USE_EPOLL
+static uint64_t watchData(int fd)
+{
+    return ((uint64_t)fd_watches[fd].generation << 32) | (uint32_t)fd;
+}
+
+/* Returns the watch an epoll event was reported for, NULL if it is gone */
+static struct ril_event* findWatch(uint64_t data)
+{
+    int fd = (int)(uint32_t)data;
+
+    if (fd < 0 || fd >= fd_watch_capacity
+        || fd_watches[fd].generation != (uint32_t)(data >> 32)) {
+        return NULL;
+    }
+
+    return fd_watches[fd].ev;
+}
+
+static int reserveWatch(int fd)
+{
+    if (fd >= fd_watch_capacity) {
+        int capacity = fd_watch_capacity ? fd_watch_capacity : MAX_READY_EVENTS;
+        FdWatch* watches;
+
+        while (capacity <= fd) {
+            capacity *= 2;
+        }
+
+        watches = (FdWatch*)realloc(fd_watches, capacity * sizeof(*watches));
+        if (watches == NULL) {
+            RLOGE("ril_event: no memory to watch fd %d", fd);
+            return -1;
+        }
+        memset(watches + fd_watch_capacity, 0,
+            (capacity - fd_watch_capacity) * sizeof(*watches));
+        fd_watches = watches;
+        fd_watch_capacity = capacity;
+    }
+
+    return 0;
+}
+
+static void removeWatch(struct ril_event* ev, int index)
+{
+    dlog("~~~~ +removeWatch ~~~~");
+    ev->index = -1;
+    if (ev->fd < fd_watch_capacity && fd_watches[ev->fd].ev == ev) {
+        fd_watches[ev->fd].ev = NULL;
+    }
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_DEL, ev->fd, NULL) < 0) {
+        RLOGE("ril_event: epoll_ctl del fd %d error (%d)", ev->fd, errno);
+    }
+    dlog("~~~~ -removeWatch ~~~~");
+}
+#else
 static void removeWatch(struct ril_event* ev, int index)
 {
     dlog("~~~~ +removeWatch ~~~~");
@@ -141,6 +332,7 @@ static void removeWatch(struct ril_event* ev, int index)
     ev->index = -1;
 
     FD_CLR(ev->fd, &readFds);
+    FD_CLR(ev->fd, &writeFds);
 
     if (ev->fd + 1 == nfds) {
         int n = 0;
@@ -157,50 +349,217 @@ static void removeWatch(struct ril_event* ev, int index)
     }
     dlog("~~~~ -removeWatch ~~~~");
 }
+#endif
+
+#if RIL_EVENT_USE_TIMERFD
+/* must be called with listMutex held */
+static void updateTimerFd(void)
+{
+    struct itimerspec its;
+    struct timeval deadline;
+
+    if (timerFd < 0) {
+        return;
+    }
+
+    if (timer_count > 0) {
+        deadline = timer_heap[0]->timeout;
+    } else {
+        timerclear(&deadline);
+    }
+
+    // only touch the timerfd when the earliest deadline moved
+    if (timercmp(&deadline, &timerfd_deadline, ==)) {
+        return;
+    }
+
+    // an all-zero it_value disarms the timer
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline.tv_sec;
+    its.it_value.tv_nsec = deadline.tv_usec * 1000;
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        // the loop would block past the deadline, compute its timeout
+        // from the heap from now on, as if timerfd_create() had failed
+        RLOGE("ril_event: timerfd_settime error (%d), dropping the timerfd", errno);
+        if (timerfd_event.index >= 0) {
+            removeWatch(&timerfd_event, timerfd_event.index);
+        }
+        close(timerFd);
+        timerFd = -1;
+        return;
+    }
+    timerfd_deadline = deadline;
+}
+
+/**
+ * Resets the timerfd before the expired timers are collected, an expiry
+ * of the deadline armed afterwards is then never lost.
+ * must be called with listMutex held
+ */
+static void drainTimerFd(void)
+{
+    uint64_t expirations;
+    ssize_t ret;
+
+    if (timerFd < 0) {
+        return;
+    }
+
+    do {
+        ret = read(timerFd, &expirations, sizeof(expirations));
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0) {
+        // it is disarmed now, even if the heap root kept its deadline
+        timerclear(&timerfd_deadline);
+    }
+}
+
+#if RIL_EVENT_USE_EPOLL
+static bool isTimerFdReady(const struct epoll_event* events, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (timerFd >= 0 && (int)(uint32_t)events[i].data.u64 == timerFd) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#else
+static bool isTimerFdReady(const fd_set* rfds)
+{
+    return timerFd >= 0 && FD_ISSET(timerFd, rfds);
+}
+#endif
+
+static void processTimerFd(int fd, short flags, void* param)
+{
+    // only there to wake the loop, processTimeouts() drains the timerfd
+}
+#else
+#define isTimerFdReady(...) false
+#define drainTimerFd() \
+    do {               \
+    } while (0)
+#define updateTimerFd() \
+    do {                \
+    } while (0)
+#endif
 
-static void processTimeouts(void)
+static void processTimeouts(bool timerFdReady)
 {
     dlog("~~~~ +processTimeouts ~~~~");
     MUTEX_ACQUIRE();
     struct timeval now;
-    struct ril_event* tev = timer_list.next;
-    struct ril_event* next;
 
+    // reading it on other wakeups would only cost a syscall for EAGAIN
+    if (timerFdReady) {
+        drainTimerFd();
+    }
     getNow(&now);
-    // walk list, see if now >= ev->timeout for any events
+    // pop the heap until the earliest timer is still in the future
 
     dlog("~~~~ Looking for timers <= %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
-    while ((tev != &timer_list) && (timercmp(&now, &tev->timeout, >))) {
+    while ((timer_count > 0) && !(timercmp(&timer_heap[0]->timeout, &now, >))) {
+        struct ril_event* tev = timer_heap[0];
+
         // Timer expired
         dlog("~~~~ firing timer ~~~~");
-        next = tev->next;
-        removeFromList(tev);
+        heapRemove(tev);
+        tev->revents = 0;
         addToList(tev, &pending_list);
-        tev = next;
     }
+    updateTimerFd();
     MUTEX_RELEASE();
     dlog("~~~~ -processTimeouts ~~~~");
 }
 
-static void processReadReadies(fd_set* rfds, int n)
+#if RIL_EVENT_USE_EPOLL
+static uint32_t toEpollEvents(short events)
+{
+    uint32_t ret = 0;
+
+    if (events & RIL_EVENT_READ) {
+        ret |= EPOLLIN;
+    }
+    if (events & RIL_EVENT_WRITE) {
+        ret |= EPOLLOUT;
+    }
+    return ret;
+}
+
+static void processReadReadies(struct epoll_event* events, int n)
+{
+    dlog("~~~~ +processReadReadies (%d) ~~~~", n);
+    MUTEX_ACQUIRE();
+
+    for (int i = 0; i < n; i++) {
+        struct ril_event* rev = findWatch(events[i].data.u64);
+
+        // skip watches removed since epoll_wait() returned
+        if (rev == NULL || rev->index < 0) {
+            continue;
+        }
+
+        // errors and hangups surface through the next read or write
+        rev->revents = 0;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            rev->revents |= RIL_EVENT_READ;
+        }
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            rev->revents |= RIL_EVENT_WRITE;
+        }
+        rev->revents &= rev->events;
+        if (rev->revents == 0) {
+            continue;
+        }
+
+        addToList(rev, &pending_list);
+        if (rev->persist == false) {
+            removeWatch(rev, rev->index);
+        }
+    }
+
+    MUTEX_RELEASE();
+    dlog("~~~~ -processReadReadies ~~~~");
+}
+#else
+static void processReadReadies(fd_set* rfds, fd_set* wfds, int n)
 {
     dlog("~~~~ +processReadReadies (%d) ~~~~", n);
     MUTEX_ACQUIRE();
 
     for (int i = 0; (i < MAX_FD_EVENTS) && (n > 0); i++) {
         struct ril_event* rev = watch_table[i];
-        if (rev != NULL && FD_ISSET(rev->fd, rfds)) {
+
+        if (rev == NULL) {
+            continue;
+        }
+
+        rev->revents = 0;
+        if (FD_ISSET(rev->fd, rfds)) {
+            rev->revents |= RIL_EVENT_READ;
+            n--;
+        }
+        if (FD_ISSET(rev->fd, wfds)) {
+            rev->revents |= RIL_EVENT_WRITE;
+            n--;
+        }
+        // interest may have changed since select() returned
+        rev->revents &= rev->events;
+        if (rev->revents != 0) {
             addToList(rev, &pending_list);
             if (rev->persist == false) {
                 removeWatch(rev, i);
             }
-            n--;
         }
     }
 
     MUTEX_RELEASE();
     dlog("~~~~ -processReadReadies (%d) ~~~~", n);
 }
+#endif
 
 static void firePending(void)
 {
@@ -209,7 +568,7 @@ static void firePending(void)
     while (ev != &pending_list) {
         struct ril_event* next = ev->next;
         removeFromList(ev);
-        ev->func(ev->fd, 0, ev->param);
+        ev->func(ev->fd, ev->revents, ev->param);
         ev = next;
     }
     dlog("~~~~ -firePending ~~~~");
@@ -217,22 +576,39 @@ static void firePending(void)
 
 static int calcNextTimeout(struct timeval* tv)
 {
-    struct ril_event* tev = timer_list.next;
+    struct ril_event* tev;
     struct timeval now;
+    struct timeval timeout;
 
-    getNow(&now);
+    // other threads arm timers, and heapInsert() may move the heap
+    MUTEX_ACQUIRE();
 
-    // Sorted list, so calc based on first node
-    if (tev == &timer_list) {
+#if RIL_EVENT_USE_TIMERFD
+    if (timerFd >= 0) {
+        // timerFd wakes the loop for the next timer, block indefinitely
+        MUTEX_RELEASE();
+        return -1;
+    }
+#endif
+
+    // Min-heap, so calc based on the root
+    if (timer_count == 0) {
         // no pending timers
+        MUTEX_RELEASE();
         return -1;
     }
 
+    tev = timer_heap[0];
+    timeout = tev->timeout;
+    MUTEX_RELEASE();
+
+    getNow(&now);
+
     dlog("~~~~ now = %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
     dlog("~~~~ next = %ds + %dus ~~~~",
-        (int)tev->timeout.tv_sec, (int)tev->timeout.tv_usec);
-    if (timercmp(&tev->timeout, &now, >)) {
-        timersub(&tev->timeout, &now, tv);
+        (int)timeout.tv_sec, (int)timeout.tv_usec);
+    if (timercmp(&timeout, &now, >)) {
+        timersub(&timeout, &now, tv);
     } else {
         // timer already expired.
         tv->tv_sec = tv->tv_usec = 0;
@@ -245,10 +621,28 @@ void ril_event_init(void)
 {
     MUTEX_INIT();
 
+#if RIL_EVENT_USE_EPOLL
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        RLOGE("ril_event: epoll_create1 error (%d)", errno);
+    }
+#else
     FD_ZERO(&readFds);
-    init_list(&timer_list);
-    init_list(&pending_list);
+    FD_ZERO(&writeFds);
     memset(watch_table, 0, sizeof(watch_table));
+#endif
+    init_list(&pending_list);
+
+#if RIL_EVENT_USE_TIMERFD
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd < 0) {
+        RLOGE("ril_event: timerfd_create error (%d)", errno);
+        return;
+    }
+    timerclear(&timerfd_deadline);
+    ril_event_set(&timerfd_event, timerFd, true, processTimerFd, NULL);
+    ril_event_add(&timerfd_event);
+#endif
 }
 
 // Initialize an event
@@ -259,61 +653,125 @@ void ril_event_set(struct ril_event* ev, int fd, bool persist, ril_event_cb func
     ev->fd = fd;
     ev->index = -1;
     ev->persist = persist;
+    ev->events = RIL_EVENT_READ;
     ev->func = func;
     ev->param = param;
     if (fd >= 0)
         fcntl(fd, F_SETFL, O_NONBLOCK);
 }
 
+// Change the flags watched for ev
+void ril_event_set_events(struct ril_event* ev, short events)
+{
+    dlog("~~~~ +ril_event_set_events ~~~~");
+    MUTEX_ACQUIRE();
+
+    if (ev->events != events) {
+        ev->events = events;
+#if RIL_EVENT_USE_EPOLL
+        if (ev->index >= 0) {
+            struct epoll_event eev;
+
+            memset(&eev, 0, sizeof(eev));
+            eev.events = toEpollEvents(events);
+            eev.data.u64 = watchData(ev->fd);
+            if (epoll_ctl(epollFd, EPOLL_CTL_MOD, ev->fd, &eev) < 0) {
+                RLOGE("ril_event: epoll_ctl mod fd %d error (%d)", ev->fd, errno);
+            }
+        }
+#else
+        if (ev->index >= 0) {
+            FD_CLR(ev->fd, &readFds);
+            FD_CLR(ev->fd, &writeFds);
+            if (events & RIL_EVENT_READ) {
+                FD_SET(ev->fd, &readFds);
+            }
+            if (events & RIL_EVENT_WRITE) {
+                FD_SET(ev->fd, &writeFds);
+            }
+        }
+#endif
+    }
+
+    MUTEX_RELEASE();
+    dlog("~~~~ -ril_event_set_events ~~~~");
+}
+
 // Add event to watch list
 void ril_event_add(struct ril_event* ev)
 {
     dlog("~~~~ +ril_event_add ~~~~");
     MUTEX_ACQUIRE();
+#if RIL_EVENT_USE_EPOLL
+    struct epoll_event eev;
+
+    if (reserveWatch(ev->fd) < 0) {
+        MUTEX_RELEASE();
+        return;
+    }
+
+    memset(&eev, 0, sizeof(eev));
+    eev.events = toEpollEvents(ev->events);
+    eev.data.u64 = ((uint64_t)(watch_generation + 1) << 32) | (uint32_t)ev->fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, ev->fd, &eev) == 0) {
+        fd_watches[ev->fd].ev = ev;
+        fd_watches[ev->fd].generation = ++watch_generation;
+        ev->index = 0;
+        dump_event(ev);
+    } else {
+        RLOGE("ril_event: epoll_ctl add fd %d error (%d)", ev->fd, errno);
+    }
+#else
     for (int i = 0; i < MAX_FD_EVENTS; i++) {
         if (watch_table[i] == NULL) {
             watch_table[i] = ev;
             ev->index = i;
             dlog("~~~~ added at %d ~~~~", i);
             dump_event(ev);
-            FD_SET(ev->fd, &readFds);
+            if (ev->events & RIL_EVENT_READ) {
+                FD_SET(ev->fd, &readFds);
+            }
+            if (ev->events & RIL_EVENT_WRITE) {
+                FD_SET(ev->fd, &writeFds);
+            }
             if (ev->fd >= nfds)
                 nfds = ev->fd + 1;
             dlog("~~~~ nfds = %d ~~~~", nfds);
             break;
         }
     }
+#endif
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_add ~~~~");
 }
 
 // Add timer event
-void ril_timer_add(struct ril_event* ev, struct timeval* tv)
+int ril_timer_add(struct ril_event* ev, struct timeval* tv)
 {
+    int ret = 0;
+
     dlog("~~~~ +ril_timer_add ~~~~");
     MUTEX_ACQUIRE();
 
-    struct ril_event* list;
     if (tv != NULL) {
-        // add to timer list
-        list = timer_list.next;
+        struct timeval now;
+
+        // re-arming a timer reschedules it
+        if (ev->fd < 0 && ev->index >= 0) {
+            heapRemove(ev);
+        }
         ev->fd = -1; // make sure fd is invalid
 
-        struct timeval now;
         getNow(&now);
         timeradd(&now, tv, &ev->timeout);
 
-        // keep list sorted
-        while (timercmp(&list->timeout, &ev->timeout, <)
-            && (list != &timer_list)) {
-            list = list->next;
-        }
-        // list now points to the first event older than ev
-        addToList(ev, list);
+        ret = heapInsert(ev);
+        updateTimerFd();
     }
 
     MUTEX_RELEASE();
     dlog("~~~~ -ril_timer_add ~~~~");
+    return ret;
 }
 
 // Remove event from watch or timer list
@@ -322,7 +780,21 @@ void ril_event_del(struct ril_event* ev)
     dlog("~~~~ +ril_event_del ~~~~");
     MUTEX_ACQUIRE();
 
+    if (ev->fd < 0) {
+        // timer; a no-op once it has expired
+        if (ev->index >= 0) {
+            heapRemove(ev);
+            updateTimerFd();
+        }
+        MUTEX_RELEASE();
+        return;
+    }
+
+#if RIL_EVENT_USE_EPOLL
+    if (ev->index < 0) {
+#else
     if (ev->index < 0 || ev->index >= MAX_FD_EVENTS) {
+#endif
         MUTEX_RELEASE();
         return;
     }
@@ -333,7 +805,26 @@ void ril_event_del(struct ril_event* ev)
     dlog("~~~~ -ril_event_del ~~~~");
 }
 
-#if DEBUG
+// Cancel an armed timer
+bool ril_timer_del(struct ril_event* ev)
+{
+    bool armed;
+
+    dlog("~~~~ +ril_timer_del ~~~~");
+    MUTEX_ACQUIRE();
+
+    armed = (ev->fd < 0 && ev->index >= 0);
+    if (armed) {
+        heapRemove(ev);
+        updateTimerFd();
+    }
+
+    MUTEX_RELEASE();
+    dlog("~~~~ -ril_timer_del ~~~~");
+    return armed;
+}
+
+#if DEBUG && !RIL_EVENT_USE_EPOLL
 static void printReadies(fd_set* rfds)
 {
     for (int i = 0; (i < MAX_FD_EVENTS); i++) {
@@ -349,16 +840,56 @@ static void printReadies(fd_set* rfds)
     } while (0)
 #endif
 
+#if RIL_EVENT_USE_EPOLL
+void ril_event_loop(void)
+{
+    int n;
+    int timeout;
+    struct timeval tv;
+    struct epoll_event events[MAX_READY_EVENTS];
+
+    for (;;) {
+        if (-1 == calcNextTimeout(&tv)) {
+            // no pending timers; block indefinitely
+            dlog("~~~~ no timers; blocking indefinitely ~~~~");
+            timeout = -1;
+        } else {
+            dlog("~~~~ blocking for %ds + %dus ~~~~", (int)tv.tv_sec, (int)tv.tv_usec);
+            // round up so we don't wake just before the timer expires
+            timeout = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+        }
+        n = epoll_wait(epollFd, events, MAX_READY_EVENTS, timeout);
+        dlog("~~~~ %d events fired ~~~~", n);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            RLOGE("ril_event: epoll_wait error (%d)", errno);
+            // bail?
+            return;
+        }
+
+        // Check for timeouts
+        processTimeouts(isTimerFdReady(events, n));
+        // Check for read-ready
+        processReadReadies(events, n);
+        // Fire away
+        firePending();
+    }
+}
+#else
 void ril_event_loop(void)
 {
     int n;
     fd_set rfds;
+    fd_set wfds;
     struct timeval tv;
     struct timeval* ptv;
 
     for (;;) {
-        // make local copy of read fd_set
+        // make local copies of the fd_sets
         memcpy(&rfds, &readFds, sizeof(fd_set));
+        memcpy(&wfds, &writeFds, sizeof(fd_set));
         if (-1 == calcNextTimeout(&tv)) {
             // no pending timers; block indefinitely
             dlog("~~~~ no timers; blocking indefinitely ~~~~");
@@ -368,7 +899,7 @@ void ril_event_loop(void)
             ptv = &tv;
         }
         printReadies(&rfds);
-        n = select(nfds, &rfds, NULL, NULL, ptv);
+        n = select(nfds, &rfds, &wfds, NULL, ptv);
         printReadies(&rfds);
         dlog("~~~~ %d events fired ~~~~", n);
         if (n < 0) {
@@ -381,10 +912,11 @@ void ril_event_loop(void)
         }
 
         // Check for timeouts
-        processTimeouts();
+        processTimeouts(isTimerFdReady(&rfds));
         // Check for read-ready
-        processReadReadies(&rfds, n);
+        processReadReadies(&rfds, &wfds, n);
         // Fire away
         firePending();
     }
 }
+#endif
\ No newline at end of file
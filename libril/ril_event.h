@@ -15,12 +15,43 @@
 ** limitations under the License.
 */
 
-// Max number of fd's we watch at any one time.  Increase if necessary.
-
 #include <sys/time.h>
 
+// Watch fd's with epoll instead of select. The epoll backend has no limit
+// on the number of watched fd's and dispatches only the ones that are ready.
+#ifndef RIL_EVENT_USE_EPOLL
+#define RIL_EVENT_USE_EPOLL 1
+#endif
+
+// Arm a timerfd for the earliest timer deadline instead of recomputing the
+// select/epoll timeout on every loop iteration.
+#ifndef RIL_EVENT_USE_TIMERFD
+#if defined(__linux__)
+#define RIL_EVENT_USE_TIMERFD 1
+#else
+#define RIL_EVENT_USE_TIMERFD 0
+#endif
+#endif
+
+// Wake the event loop from other threads through an eventfd instead of a
+// pipe.
+#ifndef RIL_EVENT_USE_EVENTFD
+#if defined(__linux__)
+#define RIL_EVENT_USE_EVENTFD 1
+#else
+#define RIL_EVENT_USE_EVENTFD 0
+#endif
+#endif
+
+// Max number of fd's we watch at any one time with the select backend.
+// Increase if necessary.
 #define MAX_FD_EVENTS 8
 
+// Readiness flags, for ril_event_set_events() and the events argument of
+// ril_event_cb. Timers are fired with no flag set.
+#define RIL_EVENT_READ 0x1
+#define RIL_EVENT_WRITE 0x2
+
 typedef void (*ril_event_cb)(int fd, short events, void* userdata);
 
 struct ril_event {
@@ -30,6 +61,8 @@ struct ril_event {
     int fd;
     int index;
     bool persist;
+    short events; // RIL_EVENT_* flags watched
+    short revents; // RIL_EVENT_* flags ready when fired
     struct timeval timeout;
     ril_event_cb func;
     void* param;
@@ -38,17 +71,26 @@ struct ril_event {
 // Initialize internal data structs
 void ril_event_init(void);
 
-// Initialize an event
+// Initialize an event, watching fd for RIL_EVENT_READ
 void ril_event_set(struct ril_event* ev, int fd, bool persist, ril_event_cb func, void* param);
 
+// Change the RIL_EVENT_* flags watched for ev, whether or not it has been
+// added yet. The select backend only picks this up on its next iteration.
+void ril_event_set_events(struct ril_event* ev, short events);
+
 // Add event to watch list
 void ril_event_add(struct ril_event* ev);
 
-// Add timer event
-void ril_timer_add(struct ril_event* ev, struct timeval* tv);
+// Add timer event, or reschedule it if it is armed. Returns 0, or -1 if
+// there is no memory to arm it (a rescheduled timer is then disarmed).
+int ril_timer_add(struct ril_event* ev, struct timeval* tv);
 
-// Remove event from watch list
+// Remove event from watch list, or cancel an armed timer
 void ril_event_del(struct ril_event* ev);
 
+// Cancel an armed timer. Returns true if it was disarmed before expiring,
+// false if it has already expired (it may still be about to fire).
+bool ril_timer_del(struct ril_event* ev);
+
 // Event loop
 void ril_event_loop(void);
\ No newline at end of file
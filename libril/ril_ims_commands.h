@@ -15,11 +15,11 @@
 ** limitations under the License.
 */
 // none
-{ 0, NULL, NULL },
+UNUSED_COMMAND(0),
     // 500
-    { RIL_REQUEST_IMS_REG_STATE_CHANGE, dispatchInts, responseVoid },
-    { RIL_REQUEST_IMS_REGISTRATION_STATE, dispatchVoid, responseImsStatus },
-    { RIL_REQUEST_IMS_SET_SERVICE_STATUS, dispatchInts, responseVoid },
-    { RIL_REQUEST_ADD_PARTICIPANT, dispatchConferenceInvite, responseVoid },
-    { 505, NULL, NULL },
-    { RIL_REQUEST_DIAL_CONFERENCE, dispatchConferenceInvite, responseVoid },
+    COMMAND(IMS_REG_STATE_CHANGE, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(IMS_REGISTRATION_STATE, dispatchVoid, responseImsStatus, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(IMS_SET_SERVICE_STATUS, dispatchInts, responseVoid, QUEUE_NETWORK, CACHE_NONE, 30),
+    COMMAND(ADD_PARTICIPANT, dispatchConferenceInvite, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    UNUSED_COMMAND(505),
+    COMMAND(DIAL_CONFERENCE, dispatchConferenceInvite, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
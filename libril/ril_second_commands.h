@@ -15,14 +15,14 @@
 ** limitations under the License.
 */
 // none
-{ 0, NULL, NULL },
+UNUSED_COMMAND(0),
     // 200
-    { 201, NULL, NULL },
-    { 202, NULL, NULL },
-    { 203, NULL, NULL },
-    { 204, NULL, NULL },
-    { RIL_REQUEST_EMERGENCY_DIAL, dispatchDial, responseVoid },
-    { 206, NULL, NULL },
-    { 207, NULL, NULL },
-    { RIL_REQUEST_ENABLE_UICC_APPLICATIONS, dispatchInts, responseVoid },
-    { RIL_REQUEST_GET_UICC_APPLICATIONS_ENABLEMENT, dispatchVoid, responseInts },
+    UNUSED_COMMAND(201),
+    UNUSED_COMMAND(202),
+    UNUSED_COMMAND(203),
+    UNUSED_COMMAND(204),
+    COMMAND(EMERGENCY_DIAL, dispatchDial, responseVoid, QUEUE_CALL, CACHE_NONE, 30),
+    UNUSED_COMMAND(206),
+    UNUSED_COMMAND(207),
+    COMMAND(ENABLE_UICC_APPLICATIONS, dispatchInts, responseVoid, QUEUE_SIM, CACHE_NONE, 30),
+    COMMAND(GET_UICC_APPLICATIONS_ENABLEMENT, dispatchVoid, responseInts, QUEUE_SIM, CACHE_NONE, 30),
@@ -14,53 +14,53 @@
 ** See the License for the specific language governing permissions and
 ** limitations under the License.
 */
-{ RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_NEW_SMS, responseString, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT, responseString, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_ON_USSD, responseStrings, WAKE_PARTIAL },
-    { RIL_UNSOL_ON_USSD_REQUEST, responseVoid, DONT_WAKE },
-    { RIL_UNSOL_NITZ_TIME_RECEIVED, responseString, WAKE_PARTIAL },
-    { RIL_UNSOL_SIGNAL_STRENGTH, responseRilSignalStrength, DONT_WAKE },
-    { RIL_UNSOL_DATA_CALL_LIST_CHANGED, responseDataCallList, WAKE_PARTIAL },
-    { RIL_UNSOL_SUPP_SVC_NOTIFICATION, responseSsn, WAKE_PARTIAL },
-    { RIL_UNSOL_STK_SESSION_END, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_STK_PROACTIVE_COMMAND, responseString, WAKE_PARTIAL },
-    { RIL_UNSOL_STK_EVENT_NOTIFY, responseString, WAKE_PARTIAL },
-    { RIL_UNSOL_STK_CALL_SETUP, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_SIM_SMS_STORAGE_FULL, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_SIM_REFRESH, responseSimRefresh, WAKE_PARTIAL },
-    { 1018, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, responseVoid, WAKE_PARTIAL },
-    { 1020, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS, responseRaw, WAKE_PARTIAL },
-    { 1022, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RESTRICTED_STATE_CHANGED, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_ENTER_EMERGENCY_CALLBACK_MODE, responseVoid, WAKE_PARTIAL },
-    { 1025, responseVoid, WAKE_PARTIAL },
-    { 1026, responseVoid, WAKE_PARTIAL },
-    { 1027, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_OEM_HOOK_RAW, responseRaw, WAKE_PARTIAL },
-    { RIL_UNSOL_RINGBACK_TONE, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_RESEND_INCALL_MUTE, responseVoid, WAKE_PARTIAL },
-    { 1031, responseVoid, WAKE_PARTIAL },
-    { 1032, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_EXIT_EMERGENCY_CALLBACK_MODE, responseVoid, WAKE_PARTIAL },
-    { RIL_UNSOL_RIL_CONNECTED, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_VOICE_RADIO_TECH_CHANGED, responseInts, WAKE_PARTIAL },
-    { RIL_UNSOL_CELL_INFO_LIST, responseCellInfoList, WAKE_PARTIAL },
+UNSOL(RESPONSE_RADIO_STATE_CHANGED, responseVoid, WAKE_PARTIAL),
+    UNSOL(RESPONSE_CALL_STATE_CHANGED, responseVoid, WAKE_PARTIAL),
+    UNSOL(RESPONSE_VOICE_NETWORK_STATE_CHANGED, responseVoid, WAKE_PARTIAL),
+    UNSOL(RESPONSE_NEW_SMS, responseString, WAKE_PARTIAL),
+    UNSOL(RESPONSE_NEW_SMS_STATUS_REPORT, responseString, WAKE_PARTIAL),
+    UNSOL(RESPONSE_NEW_SMS_ON_SIM, responseInts, WAKE_PARTIAL),
+    UNSOL(ON_USSD, responseStrings, WAKE_PARTIAL),
+    UNSOL(ON_USSD_REQUEST, responseVoid, DONT_WAKE),
+    UNSOL(NITZ_TIME_RECEIVED, responseString, WAKE_PARTIAL),
+    UNSOL(SIGNAL_STRENGTH, responseRilSignalStrength, DONT_WAKE),
+    UNSOL(DATA_CALL_LIST_CHANGED, responseDataCallList, WAKE_PARTIAL),
+    UNSOL(SUPP_SVC_NOTIFICATION, responseSsn, WAKE_PARTIAL),
+    UNSOL(STK_SESSION_END, responseVoid, WAKE_PARTIAL),
+    UNSOL(STK_PROACTIVE_COMMAND, responseString, WAKE_PARTIAL),
+    UNSOL(STK_EVENT_NOTIFY, responseString, WAKE_PARTIAL),
+    UNSOL(STK_CALL_SETUP, responseInts, WAKE_PARTIAL),
+    UNSOL(SIM_SMS_STORAGE_FULL, responseVoid, WAKE_PARTIAL),
+    UNSOL(SIM_REFRESH, responseSimRefresh, WAKE_PARTIAL),
+    UNUSED_UNSOL(1018),
+    UNSOL(RESPONSE_SIM_STATUS_CHANGED, responseVoid, WAKE_PARTIAL),
+    UNUSED_UNSOL(1020),
+    UNSOL(RESPONSE_NEW_BROADCAST_SMS, responseRaw, WAKE_PARTIAL),
+    UNUSED_UNSOL(1022),
+    UNSOL(RESTRICTED_STATE_CHANGED, responseInts, WAKE_PARTIAL),
+    UNSOL(ENTER_EMERGENCY_CALLBACK_MODE, responseVoid, WAKE_PARTIAL),
+    UNUSED_UNSOL(1025),
+    UNUSED_UNSOL(1026),
+    UNUSED_UNSOL(1027),
+    UNSOL(OEM_HOOK_RAW, responseRaw, WAKE_PARTIAL),
+    UNSOL(RINGBACK_TONE, responseInts, WAKE_PARTIAL),
+    UNSOL(RESEND_INCALL_MUTE, responseVoid, WAKE_PARTIAL),
+    UNUSED_UNSOL(1031),
+    UNUSED_UNSOL(1032),
+    UNSOL(EXIT_EMERGENCY_CALLBACK_MODE, responseVoid, WAKE_PARTIAL),
+    UNSOL(RIL_CONNECTED, responseInts, WAKE_PARTIAL),
+    UNSOL(VOICE_RADIO_TECH_CHANGED, responseInts, WAKE_PARTIAL),
+    UNSOL(CELL_INFO_LIST, responseCellInfoList, WAKE_PARTIAL),
     // 1037
-    { RIL_UNSOL_RESPONSE_IMS_NETWORK_STATE_CHANGED, responseVoid, WAKE_PARTIAL },
-    { 1038, responseVoid, WAKE_PARTIAL },
-    { 1039, responseVoid, WAKE_PARTIAL },
-    { 1040, responseVoid, WAKE_PARTIAL },
-    { 1041, responseVoid, WAKE_PARTIAL },
-    { 1042, responseVoid, WAKE_PARTIAL },
-    { 1043, responseVoid, WAKE_PARTIAL },
-    { 1044, responseVoid, WAKE_PARTIAL },
-    { 1045, responseVoid, WAKE_PARTIAL },
-    { 1046, responseVoid, WAKE_PARTIAL },
+    UNSOL(RESPONSE_IMS_NETWORK_STATE_CHANGED, responseVoid, WAKE_PARTIAL),
+    UNUSED_UNSOL(1038),
+    UNUSED_UNSOL(1039),
+    UNUSED_UNSOL(1040),
+    UNUSED_UNSOL(1041),
+    UNUSED_UNSOL(1042),
+    UNUSED_UNSOL(1043),
+    UNUSED_UNSOL(1044),
+    UNUSED_UNSOL(1045),
+    UNUSED_UNSOL(1046),
     // 1047 responseVoid
-    { RIL_UNSOL_MODEM_RESTART, responseVoid, WAKE_PARTIAL },
\ No newline at end of file
+    UNSOL(MODEM_RESTART, responseVoid, WAKE_PARTIAL),
\ No newline at end of file
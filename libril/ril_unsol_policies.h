@@ -0,0 +1,29 @@
+/* //device/libs/telephony/ril_unsol_policies.h
+**
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+    // request, coalesce ms, min interval ms, hysteresis, sticky mode
+    { RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, 200, 1000, 0, STICKY_LAST },
+    // NITZ is only kept if no client got it, then replayed once, as is, to
+    // the next client to connect. Its receive time is not filled in, so the
+    // client can't tell how old a replayed one is.
+    { RIL_UNSOL_NITZ_TIME_RECEIVED, 0, 0, 0, STICKY_UNDELIVERED },
+    { RIL_UNSOL_SIGNAL_STRENGTH, 0, 1000, 2, STICKY_LAST },
+    { RIL_UNSOL_DATA_CALL_LIST_CHANGED, 0, 0, 0, STICKY_LAST },
+    { RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, 0, 0, 0, STICKY_LAST },
+    { RIL_UNSOL_RESTRICTED_STATE_CHANGED, 0, 0, 0, STICKY_LAST },
+    { RIL_UNSOL_VOICE_RADIO_TECH_CHANGED, 0, 0, 0, STICKY_LAST },
+    { RIL_UNSOL_CELL_INFO_LIST, 0, 1000, 0, STICKY_LAST },
+    { RIL_UNSOL_RESPONSE_IMS_NETWORK_STATE_CHANGED, 200, 1000, 0, STICKY_LAST },
@@ -19,6 +19,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,9 +29,14 @@ extern "C" {
 typedef unsigned short char16_t;
 #endif
 
+size_t strnlen16to8(const char16_t* s, size_t n);
+char* strncpy16to8(char* dest, const char16_t* s, size_t n);
 char* strndup16to8(const char16_t* s, size_t n);
 char16_t* strdup8to16(const char* s, size_t* out_len);
 
+/* Transcode into a caller buffer, return -1 if it is too small */
+ssize_t strcpy8to16_buf(char16_t* dest, size_t destLen, const char* s);
+
 #ifdef __cplusplus
 }
 #endif
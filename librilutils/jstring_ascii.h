@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2006 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ASCII fast paths shared by strdup8to16.c and strdup16to8.c.
+ *
+ * Every helper handles the longest leading run of ASCII and returns its
+ * length, so the callers only fall back to the per-character decoders
+ * once real multi-byte data shows up. A UTF-16 0 is not ASCII here,
+ * since it is encoded as the two bytes 0xc0 0x80.
+ */
+
+#ifndef __CUTILS_JSTRING_ASCII_H
+#define __CUTILS_JSTRING_ASCII_H
+
+#include <jstring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Set to 0 to force the scalar code
+#ifndef JSTRING_USE_SIMD
+#define JSTRING_USE_SIMD 1
+#endif
+
+#if JSTRING_USE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSTRING_USE_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+// AVX2 is picked at runtime, the rest of the build stays baseline
+#define JSTRING_USE_AVX2 1
+#endif
+#elif JSTRING_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define JSTRING_USE_NEON 1
+#endif
+
+#ifndef JSTRING_USE_SSE2
+#define JSTRING_USE_SSE2 0
+#endif
+#ifndef JSTRING_USE_AVX2
+#define JSTRING_USE_AVX2 0
+#endif
+#ifndef JSTRING_USE_NEON
+#define JSTRING_USE_NEON 0
+#endif
+
+#if JSTRING_USE_AVX2
+#define JSTRING_AVX2 __attribute__((target("avx2")))
+
+static inline int jstringHasAvx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+JSTRING_AVX2 static size_t asciiPrefix8Avx2(const char* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+
+        if (_mm256_movemask_epi8(v) != 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+JSTRING_AVX2 static size_t asciiWiden8to16Avx2(char16_t* d, const char* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+
+        if (_mm256_movemask_epi8(v) != 0) {
+            break;
+        }
+
+        _mm256_storeu_si256((__m256i*)(d + i),
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*)(d + i + 16),
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+
+    return i;
+}
+
+/* all 0xffff if every unit is in 1..0x7f */
+JSTRING_AVX2 static inline __m256i asciiMask16Avx2(__m256i v)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i high = _mm256_set1_epi16((short)0xff80);
+
+    return _mm256_andnot_si256(_mm256_cmpeq_epi16(v, zero),
+        _mm256_cmpeq_epi16(_mm256_and_si256(v, high), zero));
+}
+
+JSTRING_AVX2 static size_t asciiPrefix16Avx2(const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+
+        if (_mm256_movemask_epi8(asciiMask16Avx2(v)) != -1) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+JSTRING_AVX2 static size_t asciiNarrow16to8Avx2(char* d, const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(s + i + 16));
+        __m256i ok = _mm256_and_si256(asciiMask16Avx2(v0), asciiMask16Avx2(v1));
+
+        if (_mm256_movemask_epi8(ok) != -1) {
+            break;
+        }
+
+        // packus works per 128-bit lane, put the quadwords back in order
+        _mm256_storeu_si256((__m256i*)(d + i),
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xd8));
+    }
+
+    return i;
+}
+#endif /* JSTRING_USE_AVX2 */
+
+#if JSTRING_USE_SSE2
+static inline size_t asciiPrefix8Simd(const char* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static inline size_t asciiWiden8to16Simd(char16_t* d, const char* s, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+
+        _mm_storeu_si128((__m128i*)(d + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(d + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+
+    return i;
+}
+
+/* all 0xffff if every unit is in 1..0x7f */
+static inline __m128i asciiMask16Sse2(__m128i v)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i high = _mm_set1_epi16((short)0xff80);
+
+    return _mm_andnot_si128(_mm_cmpeq_epi16(v, zero),
+        _mm_cmpeq_epi16(_mm_and_si128(v, high), zero));
+}
+
+static inline size_t asciiPrefix16Simd(const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+        if (_mm_movemask_epi8(asciiMask16Sse2(v)) != 0xffff) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static inline size_t asciiNarrow16to8Simd(char* d, const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(s + i + 8));
+        __m128i ok = _mm_and_si128(asciiMask16Sse2(v0), asciiMask16Sse2(v1));
+
+        if (_mm_movemask_epi8(ok) != 0xffff) {
+            break;
+        }
+
+        _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(v0, v1));
+    }
+
+    return i;
+}
+#elif JSTRING_USE_NEON
+static inline int neonAny8(uint8x16_t v)
+{
+    uint8x8_t m = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+
+    return vget_lane_u64(vreinterpret_u64_u8(m), 0) != 0;
+}
+
+static inline size_t asciiPrefix8Simd(const char* s, size_t n)
+{
+    const uint8x16_t high = vdupq_n_u8(0x80);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(s + i));
+
+        if (neonAny8(vandq_u8(v, high))) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static inline size_t asciiWiden8to16Simd(char16_t* d, const char* s, size_t n)
+{
+    const uint8x16_t high = vdupq_n_u8(0x80);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(s + i));
+
+        if (neonAny8(vandq_u8(v, high))) {
+            break;
+        }
+
+        vst1q_u16((uint16_t*)(d + i), vmovl_u8(vget_low_u8(v)));
+        vst1q_u16((uint16_t*)(d + i + 8), vmovl_u8(vget_high_u8(v)));
+    }
+
+    return i;
+}
+
+/* non-zero lanes for units outside 1..0x7f */
+static inline uint16x8_t asciiBad16Neon(uint16x8_t v)
+{
+    return vorrq_u16(vcgtq_u16(v, vdupq_n_u16(0x7f)), vceqq_u16(v, vdupq_n_u16(0)));
+}
+
+static inline size_t asciiPrefix16Simd(const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t v = vld1q_u16((const uint16_t*)(s + i));
+
+        if (neonAny8(vreinterpretq_u8_u16(asciiBad16Neon(v)))) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static inline size_t asciiNarrow16to8Simd(char* d, const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t v = vld1q_u16((const uint16_t*)(s + i));
+
+        if (neonAny8(vreinterpretq_u8_u16(asciiBad16Neon(v)))) {
+            break;
+        }
+
+        vst1_u8((uint8_t*)(d + i), vmovn_u16(v));
+    }
+
+    return i;
+}
+#endif /* JSTRING_USE_NEON */
+
+/* Length of the leading run of 7-bit bytes in s[0..n) */
+static inline size_t asciiPrefix8(const char* s, size_t n)
+{
+    size_t i = 0;
+
+#if JSTRING_USE_AVX2
+    if (n >= 32 && jstringHasAvx2()) {
+        i = asciiPrefix8Avx2(s, n);
+    }
+#endif
+#if JSTRING_USE_SSE2 || JSTRING_USE_NEON
+    i += asciiPrefix8Simd(s + i, n - i);
+#endif
+    while (i < n && (unsigned char)s[i] < 0x80) {
+        i++;
+    }
+
+    return i;
+}
+
+/* Widens the leading 7-bit run of s[0..n) into d, returns its length */
+static inline size_t asciiWiden8to16(char16_t* d, const char* s, size_t n)
+{
+    size_t i = 0;
+
+#if JSTRING_USE_AVX2
+    if (n >= 32 && jstringHasAvx2()) {
+        i = asciiWiden8to16Avx2(d, s, n);
+    }
+#endif
+#if JSTRING_USE_SSE2 || JSTRING_USE_NEON
+    i += asciiWiden8to16Simd(d + i, s + i, n - i);
+#endif
+    while (i < n && (unsigned char)s[i] < 0x80) {
+        d[i] = (unsigned char)s[i];
+        i++;
+    }
+
+    return i;
+}
+
+/* Length of the leading run of units in 1..0x7f in s[0..n) */
+static inline size_t asciiPrefix16(const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+#if JSTRING_USE_AVX2
+    if (n >= 16 && jstringHasAvx2()) {
+        i = asciiPrefix16Avx2(s, n);
+    }
+#endif
+#if JSTRING_USE_SSE2 || JSTRING_USE_NEON
+    i += asciiPrefix16Simd(s + i, n - i);
+#endif
+    while (i < n && s[i] != 0 && s[i] < 0x80) {
+        i++;
+    }
+
+    return i;
+}
+
+/* Narrows the leading run of units in 1..0x7f into d, returns its length */
+static inline size_t asciiNarrow16to8(char* d, const char16_t* s, size_t n)
+{
+    size_t i = 0;
+
+#if JSTRING_USE_AVX2
+    if (n >= 32 && jstringHasAvx2()) {
+        i = asciiNarrow16to8Avx2(d, s, n);
+    }
+#endif
+#if JSTRING_USE_SSE2 || JSTRING_USE_NEON
+    i += asciiNarrow16to8Simd(d + i, s + i, n - i);
+#endif
+    while (i < n && s[i] != 0 && s[i] < 0x80) {
+        d[i] = (char)s[i];
+        i++;
+    }
+
+    return i;
+}
+
+#endif /* __CUTILS_JSTRING_ASCII_H */
@@ -29,7 +29,7 @@ extern "C" {
 #endif
 
 int ril_socket_create(const char* name, int type);
-int ril_socket_init(void);
+int ril_socket_init(int socket_type);
 int local_get_control_socket(const char* name);
 
 #ifdef __cplusplus
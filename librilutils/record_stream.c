@@ -21,41 +21,51 @@
 #include <assert.h>
 #include <errno.h>
 #include <log/log_radio.h>
-#include <netinet/in.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <telephony/record_stream.h>
 #include <unistd.h>
 
 #define HEADER_SIZE 4
 
+/**
+ * The buffer is a ring of capacity bytes, followed by maxRecordLen bytes
+ * of slack: a record that wraps around the end of the ring gets its
+ * wrapped part copied there, so every record is returned in place.
+ */
 struct RecordStream {
     int fd;
     size_t maxRecordLen;
 
     unsigned char* buffer;
+    size_t capacity;
 
-    unsigned char* unconsumed;
-    unsigned char* read_end;
-    unsigned char* buffer_end;
+    size_t head; // offset of the first unconsumed byte
+    size_t count; // unconsumed bytes
 };
 
 extern RecordStream* record_stream_new(int fd, size_t maxRecordLen)
 {
     RecordStream* ret;
 
-    assert(maxRecordLen <= 0xffff);
+    assert(maxRecordLen <= UINT32_MAX);
 
     ret = (RecordStream*)calloc(1, sizeof(RecordStream));
+    if (ret == NULL) {
+        return NULL;
+    }
 
     ret->fd = fd;
     ret->maxRecordLen = maxRecordLen;
-    ret->buffer = (unsigned char*)malloc(maxRecordLen + HEADER_SIZE);
+    ret->capacity = maxRecordLen + HEADER_SIZE;
+    ret->buffer = (unsigned char*)malloc(ret->capacity + maxRecordLen);
 
-    ret->unconsumed = ret->buffer;
-    ret->read_end = ret->buffer;
-    ret->buffer_end = ret->buffer + maxRecordLen + HEADER_SIZE;
+    if (ret->buffer == NULL) {
+        free(ret);
+        return NULL;
+    }
 
     return ret;
 }
@@ -66,117 +76,170 @@ extern void record_stream_free(RecordStream* rs)
     free(rs);
 }
 
-/* returns NULL; if there isn't a full record in the buffer */
-static unsigned char* getEndOfRecord(unsigned char* p_begin,
-    unsigned char* p_end)
+static unsigned char ringByte(RecordStream* p_rs, size_t offset)
+{
+    return p_rs->buffer[(p_rs->head + offset) % p_rs->capacity];
+}
+
+/**
+ * Consumes the next record if it is complete
+ *
+ * Returns 1 and fills in p_record if it is, 0 if it isn't, -1 / errno =
+ * EFBIG if its header exceeds maxRecordLen
+ */
+static int getNextRecord(RecordStream* p_rs, struct iovec* p_record)
 {
     size_t len;
-    unsigned char* p_ret;
+    size_t start;
 
-    if (p_end < p_begin + HEADER_SIZE) {
-        return NULL;
+    if (p_rs->count < HEADER_SIZE) {
+        return 0;
+    }
+
+    // First four bytes are length, big endian
+    len = (size_t)ringByte(p_rs, 0) << 24 | (size_t)ringByte(p_rs, 1) << 16
+        | (size_t)ringByte(p_rs, 2) << 8 | (size_t)ringByte(p_rs, 3);
+
+    if (len > p_rs->maxRecordLen) {
+        RLOGE("max record length exceeded (%zu)\n", len);
+        errno = EFBIG;
+        return -1;
     }
 
-    // First four bytes are length
-    len = ntohl(*((uint32_t*)p_begin));
+    if (p_rs->count < HEADER_SIZE + len) {
+        return 0;
+    }
 
-    p_ret = p_begin + HEADER_SIZE + len;
+    start = (p_rs->head + HEADER_SIZE) % p_rs->capacity;
 
-    if (p_end < p_ret) {
-        return NULL;
+    if (start + len > p_rs->capacity) {
+        // only the wrapped part moves, into the slack after the ring
+        memcpy(p_rs->buffer + p_rs->capacity, p_rs->buffer,
+            start + len - p_rs->capacity);
     }
 
-    return p_ret;
+    p_record->iov_base = p_rs->buffer + start;
+    p_record->iov_len = len;
+
+    p_rs->count -= HEADER_SIZE + len;
+    p_rs->head = p_rs->count > 0 ? (start + len) % p_rs->capacity : 0;
+
+    return 1;
 }
 
-static void* getNextRecord(RecordStream* p_rs, size_t* p_outRecordLen)
+/* Reads whatever fits in the free part of the ring with one readv() */
+static ssize_t readRecords(RecordStream* p_rs)
 {
-    unsigned char *record_start, *record_end;
+    struct iovec iov[2];
+    size_t tail = (p_rs->head + p_rs->count) % p_rs->capacity;
+    size_t space = p_rs->capacity - p_rs->count;
+    int iovcnt = 1;
+    ssize_t countRead;
 
-    record_end = getEndOfRecord(p_rs->unconsumed, p_rs->read_end);
+    iov[0].iov_base = p_rs->buffer + tail;
+    iov[0].iov_len = space;
 
-    if (record_end != NULL) {
-        /* one full line in the buffer */
-        record_start = p_rs->unconsumed + HEADER_SIZE;
-        p_rs->unconsumed = record_end;
+    if (tail + space > p_rs->capacity) {
+        iov[0].iov_len = p_rs->capacity - tail;
+        iov[1].iov_base = p_rs->buffer;
+        iov[1].iov_len = space - iov[0].iov_len;
+        iovcnt = 2;
+    }
 
-        *p_outRecordLen = record_end - record_start;
+    countRead = readv(p_rs->fd, iov, iovcnt);
 
-        return record_start;
+    if (countRead > 0) {
+        p_rs->count += countRead;
     }
 
-    return NULL;
+    return countRead;
 }
 
 /**
- * Reads the next record from stream fd
- * Records are prefixed by a 16-bit big endian length value
+ * Reads the next records from stream fd, with at most one read.
+ * Records are prefixed by a 32-bit big endian length value
  * Records may not be larger than maxRecordLen
  *
  * Doesn't guard against EINTR
  *
- * p_outRecord and p_outRecordLen may not be NULL
+ * Records already buffered are returned without reading. The records
+ * point into the stream buffer and stay valid until the next call.
  *
- * Return 0 on success, -1 on fail
- * Returns 0 with *p_outRecord set to NULL on end of stream
+ * Returns the number of records, at most maxRecords, put in p_records
+ * Returns 0 on end of stream
  * Returns -1 / errno = EAGAIN if it needs to read again
  */
-int record_stream_get_next(RecordStream* p_rs, void** p_outRecord,
-    size_t* p_outRecordLen)
+int record_stream_get_batch(RecordStream* p_rs, struct iovec* p_records,
+    size_t maxRecords)
 {
-    void* ret;
-
+    size_t found = 0;
     ssize_t countRead;
+    int ret = 0;
 
-    /* is there one record already in the buffer? */
-    ret = getNextRecord(p_rs, p_outRecordLen);
-
-    if (ret != NULL) {
-        *p_outRecord = ret;
-        return 0;
+    while (found < maxRecords
+        && (ret = getNextRecord(p_rs, &p_records[found])) > 0) {
+        found++;
     }
 
-    // if the buffer is full and we don't have a full record
-    if (p_rs->unconsumed == p_rs->buffer
-        && p_rs->read_end == p_rs->buffer_end) {
-        // this should never happen
-        RLOGE("max record length exceeded\n");
-        assert(0);
-        errno = EFBIG;
-        return -1;
+    if (found > 0) {
+        return found;
     }
 
-    if (p_rs->unconsumed != p_rs->buffer) {
-        // move remainder to the beginning of the buffer
-        size_t toMove;
-
-        toMove = p_rs->read_end - p_rs->unconsumed;
-        if (toMove) {
-            memmove(p_rs->buffer, p_rs->unconsumed, toMove);
-        }
-
-        p_rs->read_end = p_rs->buffer + toMove;
-        p_rs->unconsumed = p_rs->buffer;
+    if (ret < 0) {
+        return -1;
     }
 
-    countRead = read(p_rs->fd, p_rs->read_end, p_rs->buffer_end - p_rs->read_end);
+    countRead = readRecords(p_rs);
 
     if (countRead <= 0) {
         /* note: end-of-stream drops through here too */
-        *p_outRecord = NULL;
         return countRead;
     }
 
-    p_rs->read_end += countRead;
+    while (found < maxRecords
+        && (ret = getNextRecord(p_rs, &p_records[found])) > 0) {
+        found++;
+    }
 
-    ret = getNextRecord(p_rs, p_outRecordLen);
+    if (found > 0) {
+        return found;
+    }
 
-    if (ret == NULL) {
+    if (ret == 0) {
         /* not enough of a buffer to for a whole command */
         errno = EAGAIN;
-        return -1;
     }
 
-    *p_outRecord = ret;
+    return -1;
+}
+
+/**
+ * Reads the next record from stream fd
+ * Records are prefixed by a 32-bit big endian length value
+ * Records may not be larger than maxRecordLen
+ *
+ * Doesn't guard against EINTR
+ *
+ * p_outRecord and p_outRecordLen may not be NULL
+ *
+ * Return 0 on success, -1 on fail
+ * Returns 0 with *p_outRecord set to NULL on end of stream
+ * Returns -1 / errno = EAGAIN if it needs to read again
+ */
+int record_stream_get_next(RecordStream* p_rs, void** p_outRecord,
+    size_t* p_outRecordLen)
+{
+    struct iovec record;
+    int ret;
+
+    ret = record_stream_get_batch(p_rs, &record, 1);
+
+    if (ret <= 0) {
+        *p_outRecord = NULL;
+        return ret;
+    }
+
+    *p_outRecord = record.iov_base;
+    *p_outRecordLen = record.iov_len;
     return 0;
 }
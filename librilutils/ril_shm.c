@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RIL_SHM"
+#define NDEBUG 1
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <log/log_radio.h>
+#include <telephony/ril_shm.h>
+
+#define RECORD_HEADER_SIZE 4
+/* only for lengths already checked against the ring size */
+#define RECORD_SIZE(len) (((len) + RECORD_HEADER_SIZE + 3) & ~(size_t)3)
+
+static size_t shmLength(uint32_t ringSize)
+{
+    return sizeof(RIL_ShmHeader) + 2 * (size_t)ringSize;
+}
+
+int ril_shm_create(uint32_t ringSize, RIL_ShmHeader** p_header, size_t* p_length)
+{
+    RIL_ShmHeader* header;
+    uint32_t size = RIL_SHM_MIN_RING_SIZE;
+    size_t length;
+    int fd;
+
+    while (size < ringSize && size < RIL_SHM_MAX_RING_SIZE) {
+        size *= 2;
+    }
+
+    length = shmLength(size);
+
+    fd = memfd_create("rild-shm", MFD_CLOEXEC);
+    if (fd < 0) {
+        RLOGE("memfd_create failed errno: %d", errno);
+        return -1;
+    }
+
+    if (ftruncate(fd, length) < 0) {
+        RLOGE("ftruncate of the shared ring failed errno: %d", errno);
+        close(fd);
+        return -1;
+    }
+
+    header = (RIL_ShmHeader*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        RLOGE("mmap of the shared ring failed errno: %d", errno);
+        close(fd);
+        return -1;
+    }
+
+    // ftruncate zeroed the rings
+    header->magic = RIL_SHM_MAGIC;
+    header->version = RIL_SHM_VERSION;
+    header->ringSize = size;
+
+    *p_header = header;
+    *p_length = length;
+
+    return fd;
+}
+
+int ril_shm_map(int memfd, RIL_ShmHeader** p_header, size_t* p_length)
+{
+    RIL_ShmHeader* header;
+    struct stat st;
+
+    if (fstat(memfd, &st) < 0) {
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof(RIL_ShmHeader)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    header = (RIL_ShmHeader*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+        memfd, 0);
+    if (header == MAP_FAILED) {
+        return -1;
+    }
+
+    if (header->magic != RIL_SHM_MAGIC || header->version != RIL_SHM_VERSION
+        || (header->ringSize & (header->ringSize - 1)) != 0
+        || shmLength(header->ringSize) > (size_t)st.st_size) {
+        munmap(header, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    *p_header = header;
+    *p_length = st.st_size;
+
+    return 0;
+}
+
+void ril_shm_rings(RIL_ShmHeader* header, RIL_ShmRing* toClient, RIL_ShmRing* toRil)
+{
+    uint8_t* data = (uint8_t*)(header + 1);
+
+    toClient->control = &header->toClient;
+    toClient->data = data;
+    toClient->size = header->ringSize;
+    toClient->eventFd = -1;
+
+    toRil->control = &header->toRil;
+    toRil->data = data + header->ringSize;
+    toRil->size = header->ringSize;
+    toRil->eventFd = -1;
+}
+
+int ril_shm_ring_write(RIL_ShmRing* ring, const void* data, size_t len)
+{
+    RIL_ShmRingControl* control = ring->control;
+    uint32_t tail = control->tail; // only we write it
+    uint32_t head = __atomic_load_n(&control->head, __ATOMIC_ACQUIRE);
+    uint32_t pos = tail & (ring->size - 1);
+    uint32_t toEnd = ring->size - pos;
+    size_t recordSize;
+    uint32_t header = len;
+
+    if (len > ring->size / 2 - RECORD_HEADER_SIZE) {
+        return -1;
+    }
+
+    recordSize = RECORD_SIZE(len);
+
+    // records never wrap, skip the end of the ring if it is too short
+    if (recordSize > toEnd) {
+        if ((uint32_t)(tail - head) + toEnd + recordSize > ring->size) {
+            return -1;
+        }
+
+        header = RIL_SHM_PAD;
+        memcpy(ring->data + pos, &header, sizeof(header));
+        tail += toEnd;
+        pos = 0;
+        header = len;
+    } else if ((uint32_t)(tail - head) + recordSize > ring->size) {
+        return -1;
+    }
+
+    memcpy(ring->data + pos, &header, sizeof(header));
+    memcpy(ring->data + pos + RECORD_HEADER_SIZE, data, len);
+
+    __atomic_store_n(&control->tail, tail + recordSize, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void ril_shm_ring_notify(RIL_ShmRing* ring)
+{
+    uint64_t one = 1;
+
+    // pairs with the fence of ril_shm_ring_prepare_wait()
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->control->waiting, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&ring->control->waiting, 0, __ATOMIC_RELAXED);
+        if (write(ring->eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            RLOGE("shared ring wakeup failed errno: %d", errno);
+        }
+    }
+}
+
+int ril_shm_ring_peek(RIL_ShmRing* ring, void** p_record, size_t* p_len)
+{
+    RIL_ShmRingControl* control = ring->control;
+
+    for (;;) {
+        uint32_t head = control->head; // only we write it
+        uint32_t tail = __atomic_load_n(&control->tail, __ATOMIC_ACQUIRE);
+        uint32_t pos = head & (ring->size - 1);
+        uint32_t len;
+
+        // the other side may be broken, never trust what it wrote
+        if (head == tail) {
+            return 0;
+        }
+
+        if ((uint32_t)(tail - head) > ring->size) {
+            RLOGE("corrupted shared ring (%u bytes pending)", tail - head);
+            errno = EBADMSG;
+            return -1;
+        }
+
+        memcpy(&len, ring->data + pos, sizeof(len));
+
+        if (len == RIL_SHM_PAD) {
+            __atomic_store_n(&control->head, head + (ring->size - pos), __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // pos is 4 aligned, so is the room left up to the end of the ring
+        if (len > ring->size - pos - RECORD_HEADER_SIZE
+            || RECORD_SIZE(len) > tail - head) {
+            RLOGE("corrupted shared ring record (%u)", len);
+            errno = EBADMSG;
+            return -1;
+        }
+
+        *p_record = ring->data + pos + RECORD_HEADER_SIZE;
+        *p_len = len;
+        return 1;
+    }
+}
+
+void ril_shm_ring_consume(RIL_ShmRing* ring, size_t len)
+{
+    RIL_ShmRingControl* control = ring->control;
+
+    __atomic_store_n(&control->head, control->head + (uint32_t)RECORD_SIZE(len),
+        __ATOMIC_RELEASE);
+}
+
+int ril_shm_ring_prepare_wait(RIL_ShmRing* ring)
+{
+    RIL_ShmRingControl* control = ring->control;
+
+    __atomic_store_n(&control->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&control->tail, __ATOMIC_ACQUIRE) != control->head) {
+        __atomic_store_n(&control->waiting, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return 1;
+}
@@ -29,6 +29,7 @@
 #include <telephony/ril.h>
 
 #define SOCKET_NAME_RIL "rild"
+#define SOCKET_NAME_RIL_DEBUG "rild-debug"
 
 static const char* ENV[32];
 
@@ -67,20 +68,30 @@ static void publish_socket(const char* name, int fd)
     fcntl(fd, F_SETFD, 0);
 }
 
-int ril_socket_init(void)
+/**
+ * Creates the rild sockets, socket_type is SOCK_STREAM for length
+ * prefixed records or SOCK_SEQPACKET for one request per packet
+ */
+int ril_socket_init(int socket_type)
 {
     char* name = SOCKET_NAME_RIL;
     int serverScoket;
-    int socket_type = SOCK_STREAM;
 
     serverScoket = ril_socket_create(name, socket_type);
     RLOGD("start ril_socket_create success %d\n", serverScoket);
 
-    if (serverScoket >= 0) {
-        // put it into envirment
-        publish_socket(name, serverScoket);
-        return 0;
-    } else {
+    if (serverScoket < 0) {
         return -1;
     }
+
+    // put it into envirment
+    publish_socket(name, serverScoket);
+
+    // rild runs fine without the debug socket, a text stream either way
+    serverScoket = ril_socket_create(SOCKET_NAME_RIL_DEBUG, SOCK_STREAM);
+    if (serverScoket >= 0) {
+        publish_socket(SOCKET_NAME_RIL_DEBUG, serverScoket);
+    }
+
+    return 0;
 }
\ No newline at end of file
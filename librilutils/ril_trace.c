@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RIL_TRACE"
+#define NDEBUG 1
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log_radio.h>
+#include <telephony/librilutils.h>
+#include <telephony/ril_trace.h>
+
+#if RIL_TRACE_RING_SIZE > 0
+
+/* Only its own thread writes to a ring, so writing takes no lock */
+typedef struct TraceRing {
+    uint32_t head; /* records ever written */
+    uint16_t thread; /* index in s_rings */
+    struct TraceRing* next; /* free list link, once its thread exited */
+    RIL_TraceRecord records[RIL_TRACE_RING_SIZE];
+} TraceRing;
+
+static TraceRing* s_rings[RIL_TRACE_MAX_THREADS];
+static uint32_t s_numRings = 0;
+static uint32_t s_dropped = 0;
+
+/* guards s_freeRings and the growth of s_rings */
+static pthread_mutex_t s_ringMutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing* s_freeRings = NULL;
+
+static pthread_key_t s_ringKey;
+static pthread_once_t s_ringKeyOnce = PTHREAD_ONCE_INIT;
+
+/* set for the threads that did not get a ring */
+static char s_noRing;
+
+/*
+ * Runs as a thread exits. The ring stays in s_rings, its records are still
+ * dumped until the next thread to start takes it over.
+ */
+static void releaseRing(void* ring)
+{
+    if (ring == &s_noRing) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_ringMutex);
+    ((TraceRing*)ring)->next = s_freeRings;
+    s_freeRings = (TraceRing*)ring;
+    pthread_mutex_unlock(&s_ringMutex);
+}
+
+static void createRingKey(void)
+{
+    pthread_key_create(&s_ringKey, releaseRing);
+}
+
+static TraceRing* getRing(void)
+{
+    TraceRing* ring;
+
+    pthread_once(&s_ringKeyOnce, createRingKey);
+
+    ring = (TraceRing*)pthread_getspecific(s_ringKey);
+    if (ring != NULL) {
+        return ring == (TraceRing*)&s_noRing ? NULL : ring;
+    }
+
+    pthread_mutex_lock(&s_ringMutex);
+
+    ring = s_freeRings;
+    if (ring != NULL) {
+        s_freeRings = ring->next;
+    } else if (s_numRings < RIL_TRACE_MAX_THREADS) {
+        ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+        if (ring != NULL) {
+            ring->thread = s_numRings;
+            __atomic_store_n(&s_rings[s_numRings], ring, __ATOMIC_RELEASE);
+            __atomic_store_n(&s_numRings, s_numRings + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&s_ringMutex);
+
+    if (ring == NULL) {
+        RLOGW("no trace ring for this thread");
+        pthread_setspecific(s_ringKey, &s_noRing);
+        return NULL;
+    }
+
+    pthread_setspecific(s_ringKey, ring);
+
+    return ring;
+}
+
+void ril_trace(RIL_TraceType type, int32_t token, int32_t id, int32_t error,
+    uint32_t length)
+{
+    TraceRing* ring = getRing();
+    RIL_TraceRecord* r;
+    uint32_t n;
+
+    if (ring == NULL) {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    n = ring->head;
+    __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELAXED);
+    r = &ring->records[n % RIL_TRACE_RING_SIZE];
+
+    // ril_trace_dump skips records whose seq is odd or changes under it
+    __atomic_store_n(&r->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->timeNs = ril_nano_time();
+    r->type = type;
+    r->thread = ring->thread;
+    r->token = token;
+    r->id = id;
+    r->error = error;
+    r->length = length;
+
+    __atomic_store_n(&r->seq, 2 * n + 2, __ATOMIC_RELEASE);
+}
+
+static int writeFully(int fd, const void* data, size_t len)
+{
+    size_t offset = 0;
+
+    while (offset < len) {
+        ssize_t written = write(fd, (const char*)data + offset, len - offset);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        offset += written;
+    }
+
+    return 0;
+}
+
+int ril_trace_dump(int fd)
+{
+    RIL_TraceHeader header;
+    RIL_TraceRecord* records;
+    uint32_t numRings;
+    size_t count = 0;
+    int ret;
+
+    numRings = __atomic_load_n(&s_numRings, __ATOMIC_ACQUIRE);
+
+    records = (RIL_TraceRecord*)malloc(
+        (numRings ? numRings : 1) * RIL_TRACE_RING_SIZE * sizeof(RIL_TraceRecord));
+    if (records == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < numRings; i++) {
+        TraceRing* ring = __atomic_load_n(&s_rings[i], __ATOMIC_ACQUIRE);
+        uint32_t head;
+
+        if (ring == NULL) {
+            continue;
+        }
+
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+        // oldest first
+        for (uint32_t k = 0; k < RIL_TRACE_RING_SIZE; k++) {
+            RIL_TraceRecord* r = &ring->records[(head + k) % RIL_TRACE_RING_SIZE];
+            uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+            if (seq == 0 || (seq & 1) != 0) {
+                continue;
+            }
+
+            memcpy(&records[count], r, sizeof(RIL_TraceRecord));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq) {
+                continue;
+            }
+
+            count++;
+        }
+    }
+
+    header.magic = RIL_TRACE_MAGIC;
+    header.version = RIL_TRACE_VERSION;
+    header.recordSize = sizeof(RIL_TraceRecord);
+    header.count = count;
+    header.dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+
+    ret = writeFully(fd, &header, sizeof(header));
+    if (ret == 0) {
+        ret = writeFully(fd, records, count * sizeof(RIL_TraceRecord));
+    }
+
+    free(records);
+
+    return ret;
+}
+
+#endif
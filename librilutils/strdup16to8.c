@@ -19,6 +19,7 @@
 
 #include <assert.h>
 #include <jstring.h>
+#include <jstring_ascii.h>
 #include <stdlib.h>
 
 /**
@@ -27,7 +28,7 @@
  */
 size_t strnlen16to8(const char16_t* utf16Str, size_t len)
 {
-    size_t utf8Len = 0;
+    size_t utf8Len;
 
     /* A small note on integer overflow. The result can
      * potentially be as big as 3*len, which will overflow
@@ -51,6 +52,11 @@ size_t strnlen16to8(const char16_t* utf16Str, size_t len)
      * but better be safe than sorry.
      */
 
+    /* units in 1..0x7f take a single byte each */
+    utf8Len = asciiPrefix16(utf16Str, len);
+    utf16Str += utf8Len;
+    len -= utf8Len;
+
     /* Fast path for the usual case where 3*len is < SIZE_MAX-1. */
     if (len < (SIZE_MAX - 1) / 3) {
         while (len--) {
@@ -109,8 +115,20 @@ char* strncpy16to8(char* utf8Str, const char16_t* utf16Str, size_t len)
      * strnlen16to8() properly or at a minimum checked the result of
      * its malloc(SIZE_MAX) in case of overflow.
      */
-    while (len--) {
-        unsigned int uic = *utf16Str++;
+    while (len) {
+        unsigned int uic;
+        size_t ascii;
+
+        ascii = asciiNarrow16to8(utf8cur, utf16Str, len);
+        utf8cur += ascii;
+        utf16Str += ascii;
+        len -= ascii;
+        if (len == 0) {
+            break;
+        }
+
+        uic = *utf16Str++;
+        len--;
 
         if (uic > 0x07ff) {
             *utf8cur++ = (uic >> 12) | 0xe0;
@@ -154,4 +172,4 @@ char* strndup16to8(const char16_t* s, size_t n)
     strncpy16to8(ret, s, n);
 
     return ret;
-}
\ No newline at end of file
+}
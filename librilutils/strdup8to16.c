@@ -17,8 +17,10 @@
 
 #include <assert.h>
 #include <jstring.h>
+#include <jstring_ascii.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 /* See http://www.unicode.org/reports/tr22/ for discussion
  * on invalid sequences */
 
@@ -119,10 +121,14 @@ char16_t* strdup8to16(const char* s, size_t* out_len)
  */
 size_t strlen8to16(const char* utf8Str)
 {
-    size_t len = 0;
+    size_t len;
     int ic;
     int expected = 0;
 
+    /* every 7-bit byte is one UTF-16 unit */
+    len = asciiPrefix8(utf8Str, strlen(utf8Str));
+    utf8Str += len;
+
     while ((ic = *utf8Str++) != '\0') {
         /* bytes that start 0? or 11 are lead bytes and count as characters.*/
         /* bytes that start 10 are extention bytes and are not counted */
@@ -157,9 +163,18 @@ char16_t* strcpy8to16(char16_t* utf16Str, const char* utf8Str,
     size_t* out_len)
 {
     char16_t* dest = utf16Str;
+    const char* end = utf8Str + strlen(utf8Str);
 
-    while (*utf8Str != '\0') {
+    while (utf8Str < end) {
         uint32_t ret;
+        size_t ascii;
+
+        ascii = asciiWiden8to16(dest, utf8Str, end - utf8Str);
+        dest += ascii;
+        utf8Str += ascii;
+        if (utf8Str == end) {
+            break;
+        }
 
         ret = getUtf32FromUtf8(&utf8Str);
 
@@ -196,6 +211,14 @@ char16_t* strcpylen8to16(char16_t* utf16Str, const char* utf8Str,
     const char* end = utf8Str + length; /* This line */
     while (utf8Str < end) { /* and this line changed. */
         uint32_t ret;
+        size_t ascii;
+
+        ascii = asciiWiden8to16(dest, utf8Str, end - utf8Str);
+        dest += ascii;
+        utf8Str += ascii;
+        if (utf8Str == end) {
+            break;
+        }
 
         ret = getUtf32FromUtf8(&utf8Str);
 
@@ -215,4 +238,29 @@ char16_t* strcpylen8to16(char16_t* utf16Str, const char* utf8Str,
     *out_len = dest - utf16Str;
 
     return utf16Str;
-}
\ No newline at end of file
+}
+
+/**
+ * Transcodes into a caller provided buffer of destLen units.
+ *
+ * Returns the number of UTF-16 units written, or -1 if the result does
+ * not fit (nothing useful is left in dest then).
+ */
+ssize_t strcpy8to16_buf(char16_t* dest, size_t destLen, const char* s)
+{
+    size_t len = strlen(s);
+    size_t out_len;
+
+    /* common case: plain ASCII, one pass and no length pre-pass */
+    if (len <= destLen && asciiWiden8to16(dest, s, len) == len) {
+        return len;
+    }
+
+    if (strlen8to16(s) > destLen) {
+        return -1;
+    }
+
+    strcpy8to16(dest, s, &out_len);
+
+    return out_len;
+}
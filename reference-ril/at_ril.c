@@ -38,6 +38,7 @@
 #include "misc.h"
 
 static void onRequest(int request, void* data, size_t datalen, RIL_Token t);
+static void processRequest(int request, void* data, size_t datalen, RIL_Token t);
 static RIL_RadioState currentState(void);
 static int onSupports(int requestCode);
 static void onCancel(RIL_Token t);
@@ -562,11 +563,17 @@ static int onSupports(int requestCode)
     return 1;
 }
 
+/**
+ * Called by libril once the client gave up on a request it dispatched to
+ * us, from another thread than the one handling the request.
+ * The AT commands of t fail with AT_ERROR_CANCELLED from now on, the
+ * handler still completes t.
+ */
 static void onCancel(RIL_Token t)
 {
-    (void)t;
+    RLOGI("onCancel: %p", t);
 
-    //@@@todo
+    at_cancel_request(t);
 }
 
 /*** Callback methods from the RIL library to us ***/
@@ -584,6 +591,14 @@ static void onCancel(RIL_Token t)
  * is atomic.
  */
 static void onRequest(int request, void* data, size_t datalen, RIL_Token t)
+{
+    // lets onCancel find the AT commands sent for t
+    at_set_request_token(t);
+    processRequest(request, data, datalen, t);
+    at_set_request_token(NULL);
+}
+
+static void processRequest(int request, void* data, size_t datalen, RIL_Token t)
 {
     int req_type = 0;
 
@@ -23,10 +23,13 @@
 int isConnectionClosed(void);
 const struct RIL_Env* getRilEnv(void);
 const char* requestToString(int request);
+int requestFromString(const char* name);
 
 #define RIL_onRequestComplete(t, e, response, responselen) getRilEnv()->OnRequestComplete(t, e, response, responselen)
 #define RIL_onUnsolicitedResponse(a, b, c) getRilEnv()->OnUnsolicitedResponse(a, b, c)
 #define RIL_requestTimedCallback(a, b, c) getRilEnv()->RequestTimedCallback(a, b, c)
+#define RIL_requestTimedCallbackEx(a, b, c) getRilEnv()->RequestTimedCallbackEx(a, b, c)
+#define RIL_cancelTimedCallback(h) getRilEnv()->CancelTimedCallback(h)
 
 void setRadioState(RIL_RadioState newState);
 RIL_RadioState getRadioState(void);
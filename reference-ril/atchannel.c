@@ -40,6 +40,8 @@
 #define MAX_AT_RESPONSE (8 * 1024)
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 250
+#define MAX_REQUEST_THREADS 16
+#define ABORT_DRAIN_TIMEOUT_MSEC 500
 
 static pthread_t s_tid_reader;
 static int s_fd = -1; /* fd of the AT channel */
@@ -63,14 +65,27 @@ void AT_DUMP(const char* prefix __unused, const char* buff, int len)
  * There is one reader thread |s_tid_reader| and potentially multiple writer
  * threads. |s_commandmutex| and |s_commandcond| are used to maintain the
  * condition that the writer thread will not read from |sp_response| until the
- * reader thread has signaled itself is finished, etc. |s_writeMutex| is used to
- * prevent multiple writer threads from calling at_send_command_full_nolock
- * function at the same time.
+ * reader thread has signaled itself is finished, etc. |s_commandBusy| and
+ * |s_idlecond| prevent multiple writer threads from calling
+ * at_send_command_full_nolock function at the same time, while still letting
+ * a writer whose request got cancelled give up waiting for its turn.
  */
 
 static pthread_mutex_t s_commandmutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t s_commandcond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t s_writeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_idlecond = PTHREAD_COND_INITIALIZER;
+static int s_commandBusy; /* a writer thread owns the channel */
+static void* s_commandToken; /* request of the command in flight, if known */
+static int s_commandCancelled; /* the command in flight was aborted */
+
+/* the request each writer thread is working on, see at_set_request_token */
+typedef struct {
+    pthread_t tid;
+    void* token; /* NULL for a free entry */
+    int cancelled;
+} RequestThread;
+
+static RequestThread s_requestThreads[MAX_REQUEST_THREADS];
 
 static ATCommandType s_type;
 static const char* s_responsePrefix = NULL;
@@ -84,6 +99,7 @@ static int s_readerClosed;
 static void onReaderClosed(void);
 static int writeCtrlZ(const char* s);
 static int writeline(const char* s);
+static int writeAbort(void);
 
 #define NS_PER_S 1000000000
 static void setTimespecRelative(struct timespec* p_ts, long long msec)
@@ -532,6 +548,31 @@ static int writeCtrlZ(const char* s)
     return 0;
 }
 
+/**
+ * Any character aborts an abortable command in progress (V.250 5.6.1),
+ * ESC also leaves the "> " prompt of commands like AT+CMGS
+ */
+static int writeAbort(void)
+{
+    ssize_t written;
+
+    if (s_fd < 0 || s_readerClosed > 0) {
+        return AT_ERROR_CHANNEL_CLOSED;
+    }
+
+    RLOGD("AT> <ESC>\n");
+
+    do {
+        written = write(s_fd, "\033", 1);
+    } while ((written < 0 && errno == EINTR) || (written == 0));
+
+    if (written < 0) {
+        return AT_ERROR_GENERIC;
+    }
+
+    return 0;
+}
+
 static void clearPendingCommand(void)
 {
     if (sp_response != NULL) {
@@ -666,13 +707,15 @@ static int at_send_command_full_nolock(const char* command, ATCommandType type,
     s_type = type;
     s_responsePrefix = responsePrefix;
     s_smsPDU = smspdu;
+    s_commandCancelled = 0;
     sp_response = at_response_new();
 
     if (timeoutMsec != 0) {
         setTimespecRelative(&ts, timeoutMsec);
     }
 
-    while (sp_response->finalResponse == NULL && s_readerClosed == 0) {
+    while (sp_response->finalResponse == NULL && s_readerClosed == 0
+        && s_commandCancelled == 0) {
         if (timeoutMsec != 0) {
             err = pthread_cond_timedwait(&s_commandcond, &s_commandmutex, &ts);
         } else {
@@ -685,6 +728,22 @@ static int at_send_command_full_nolock(const char* command, ATCommandType type,
         }
     }
 
+    if (sp_response->finalResponse == NULL && s_commandCancelled > 0) {
+        /* keep the channel until the modem answers the aborted command,
+         * or its final response would be taken for the next command's */
+        setTimespecRelative(&ts, ABORT_DRAIN_TIMEOUT_MSEC);
+
+        while (sp_response->finalResponse == NULL && s_readerClosed == 0) {
+            if (pthread_cond_timedwait(&s_commandcond, &s_commandmutex, &ts) == ETIMEDOUT) {
+                RLOGW("no final response to the aborted command");
+                break;
+            }
+        }
+
+        err = AT_ERROR_CANCELLED;
+        goto error;
+    }
+
     if (pp_outResponse == NULL) {
         at_response_free(sp_response);
     } else {
@@ -707,6 +766,56 @@ error:
     return err;
 }
 
+/* assumes s_commandmutex is held */
+static RequestThread* findRequestThread(pthread_t tid)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_ELEMS(s_requestThreads); i++) {
+        if (s_requestThreads[i].token != NULL
+            && pthread_equal(s_requestThreads[i].tid, tid)) {
+            return &s_requestThreads[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Waits for the writer thread in front of us to finish its command
+ * assumes s_commandmutex is held
+ *
+ * Returns AT_ERROR_CANCELLED, without taking the channel, if the request
+ * of this thread gets cancelled meanwhile
+ */
+static int acquireChannel(void)
+{
+    RequestThread* rt = findRequestThread(pthread_self());
+
+    while (s_commandBusy && (rt == NULL || rt->cancelled == 0)) {
+        pthread_cond_wait(&s_idlecond, &s_commandmutex);
+    }
+
+    if (rt != NULL && rt->cancelled > 0) {
+        return AT_ERROR_CANCELLED;
+    }
+
+    s_commandBusy = 1;
+    s_commandToken = rt != NULL ? rt->token : NULL;
+
+    return 0;
+}
+
+/* assumes s_commandmutex is held */
+static void releaseChannel(void)
+{
+    s_commandBusy = 0;
+    s_commandToken = NULL;
+
+    /* cancelled waiters leave without taking the channel, wake them all */
+    pthread_cond_broadcast(&s_idlecond);
+}
+
 /**
  * Internal send_command implementation
  *
@@ -723,15 +832,19 @@ static int at_send_command_full(const char* command, ATCommandType type,
         return AT_ERROR_INVALID_THREAD;
     }
 
-    pthread_mutex_lock(&s_writeMutex);
     pthread_mutex_lock(&s_commandmutex);
 
-    err = at_send_command_full_nolock(command, type,
-        responsePrefix, smspdu,
-        timeoutMsec, pp_outResponse);
+    err = acquireChannel();
+
+    if (err == 0) {
+        err = at_send_command_full_nolock(command, type,
+            responsePrefix, smspdu,
+            timeoutMsec, pp_outResponse);
+
+        releaseChannel();
+    }
 
     pthread_mutex_unlock(&s_commandmutex);
-    pthread_mutex_unlock(&s_writeMutex);
 
     if (err == AT_ERROR_TIMEOUT && s_onTimeout != NULL) {
         s_onTimeout();
@@ -834,6 +947,80 @@ int at_send_command_multiline(const char* command,
     return err;
 }
 
+/**
+ * Tells which request the AT commands of the calling thread belong to,
+ * NULL once it is done with it
+ */
+void at_set_request_token(void* token)
+{
+    RequestThread* rt;
+    size_t i;
+
+    pthread_mutex_lock(&s_commandmutex);
+
+    rt = findRequestThread(pthread_self());
+
+    if (rt == NULL && token != NULL) {
+        for (i = 0; i < NUM_ELEMS(s_requestThreads); i++) {
+            if (s_requestThreads[i].token == NULL) {
+                rt = &s_requestThreads[i];
+                rt->tid = pthread_self();
+                break;
+            }
+        }
+
+        if (rt == NULL) {
+            /* this request just can't be cancelled */
+            RLOGW("at_set_request_token: too many request threads");
+        }
+    }
+
+    if (rt != NULL) {
+        rt->token = token;
+        rt->cancelled = 0;
+    }
+
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
+/**
+ * Makes the AT commands of request token fail with AT_ERROR_CANCELLED:
+ * a command waiting for the channel gives up right away, the command in
+ * flight is aborted on the modem and no longer waited for.
+ * Does nothing if no thread is working on token.
+ */
+void at_cancel_request(void* token)
+{
+    int found = 0;
+    size_t i;
+
+    if (token == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_commandmutex);
+
+    for (i = 0; i < NUM_ELEMS(s_requestThreads); i++) {
+        if (s_requestThreads[i].token == token) {
+            s_requestThreads[i].cancelled = 1;
+            found = 1;
+        }
+    }
+
+    if (found && s_commandBusy && s_commandToken == token
+        && sp_response != NULL && sp_response->finalResponse == NULL) {
+        writeAbort();
+        s_commandCancelled = 1;
+        pthread_cond_broadcast(&s_commandcond);
+    }
+
+    if (found) {
+        pthread_cond_broadcast(&s_idlecond);
+    }
+
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
 /* This callback is invoked on the command thread */
 void at_set_on_timeout(void (*onTimeout)(void))
 {
@@ -866,10 +1053,14 @@ int at_handshake()
         return AT_ERROR_INVALID_THREAD;
     }
     inEmulator = isInEmulator();
+    pthread_mutex_lock(&s_commandmutex);
     if (inEmulator) {
-        pthread_mutex_lock(&s_writeMutex);
+        err = acquireChannel();
+        if (err < 0) {
+            pthread_mutex_unlock(&s_commandmutex);
+            return err;
+        }
     }
-    pthread_mutex_lock(&s_commandmutex);
 
     for (i = 0; i < HANDSHAKE_RETRY_COUNT; i++) {
         /* some stacks start with verbose off */
@@ -888,10 +1079,10 @@ int at_handshake()
         sleepMsec(HANDSHAKE_TIMEOUT_MSEC);
     }
 
-    pthread_mutex_unlock(&s_commandmutex);
     if (inEmulator) {
-        pthread_mutex_unlock(&s_writeMutex);
+        releaseChannel();
     }
+    pthread_mutex_unlock(&s_commandmutex);
 
     return err;
 }
@@ -44,6 +44,7 @@ extern void AT_DUMP(const char* prefix, const char* buff, int len);
 #define AT_ERROR_INVALID_RESPONSE (-6) /* eg an at_send_command_singleline that \
                                         * did not get back an intermediate      \
                                         * response */
+#define AT_ERROR_CANCELLED (-7) /* see at_cancel_request */
 
 #define AT_OK (1)
 #define AT_ERR (0)
@@ -91,6 +92,12 @@ void at_set_on_timeout(void (*onTimeout)(void));
  * channel is already closed */
 void at_set_on_reader_closed(void (*onClose)(void));
 
+/* Associates the AT commands of the calling thread with a request,
+ * NULL when the request is done */
+void at_set_request_token(void* token);
+/* May be called from any thread but the reader thread */
+void at_cancel_request(void* token);
+
 int at_send_command_singleline(const char* command,
     const char* responsePrefix,
     ATResponse** pp_outResponse);
@@ -146,6 +153,9 @@ static inline const char* at_io_err_str(int e)
     case AT_ERROR_INVALID_RESPONSE:
         str = "AT_ERROR_INVALID_RESPONSE";
         break;
+    case AT_ERROR_CANCELLED:
+        str = "AT_ERROR_CANCELLED";
+        break;
     default:
         str = "AT_ERROR_UNKNOWN";
         break;
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <local_socket.h>
@@ -45,18 +46,40 @@ extern void RIL_onUnsolicitedResponse(int unsolResponse, const void* data,
 extern void RIL_requestTimedCallback(RIL_TimedCallback callback,
     void* param, const struct timeval* relativeTime);
 
+extern RIL_TimedCallbackHandle RIL_requestTimedCallbackEx(RIL_TimedCallback callback,
+    void* param, const struct timeval* relativeTime);
+
+extern int RIL_cancelTimedCallback(RIL_TimedCallbackHandle handle);
+
 static struct RIL_Env s_rilEnv = {
     RIL_onRequestComplete,
     RIL_onUnsolicitedResponse,
-    RIL_requestTimedCallback
+    RIL_requestTimedCallback,
+    NULL,
+    RIL_requestTimedCallbackEx,
+    RIL_cancelTimedCallback
 };
 
+/* -p: one request per packet on a SOCK_SEQPACKET socket, no length headers */
 int main(int argc, char** argv)
 {
     const RIL_RadioFunctions* funcs;
+    int socketType = SOCK_STREAM;
+    int opt;
     int ret;
 
-    ret = ril_socket_init();
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        switch (opt) {
+        case 'p':
+            socketType = SOCK_SEQPACKET;
+            break;
+        default:
+            RLOGE("usage: %s [-p]", argv[0]);
+            return 1;
+        }
+    }
+
+    ret = ril_socket_init(socketType);
 
     if (ret < 0) {
         RLOGE("start rile_socket_init failed");
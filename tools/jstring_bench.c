@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host side throughput benchmark of the UTF-8/UTF-16 transcoders of
+ * librilutils, on strings like the ones crossing the RIL socket.
+ *
+ *   cc -O2 -Ilibrilutils -o jstring_bench tools/jstring_bench.c \
+ *       librilutils/strdup8to16.c librilutils/strdup16to8.c
+ *   ./jstring_bench [iterations]
+ *
+ * Build once more with -DJSTRING_USE_SIMD=0 to compare with the scalar
+ * loops.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <jstring.h>
+
+typedef struct {
+    const char* name;
+    const char* utf8;
+} Sample;
+
+static const Sample s_samples[] = {
+    { "apn", "internet" },
+    { "operator", "China Mobile" },
+    { "pdu", "0791448720003023240DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B" },
+    { "hex", "A0B1C2D3E4F5061728394A5B6C7D8E9FA0B1C2D3E4F5061728394A5B6C7D8E9F"
+             "A0B1C2D3E4F5061728394A5B6C7D8E9FA0B1C2D3E4F5061728394A5B6C7D8E9F" },
+    { "mixed", "Caf\xc3\xa9 \xe4\xb8\xad\xe5\x9b\xbd\xe7\xa7\xbb\xe5\x8a\xa8 Telecom" },
+};
+
+static double nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    size_t checksum = 0;
+
+    if (argc > 2 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%-10s %6s %12s %12s %12s\n", "string", "bytes", "8to16 ns", "16to8 ns", "MB/s");
+
+    for (size_t i = 0; i < sizeof(s_samples) / sizeof(s_samples[0]); i++) {
+        const char* utf8 = s_samples[i].utf8;
+        size_t len = strlen(utf8);
+        char16_t* utf16;
+        size_t utf16Len;
+        double start, widen, narrow;
+
+        // round trip once, the output must match the input
+        utf16 = strdup8to16(utf8, &utf16Len);
+        if (utf16 == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        char* back = strndup16to8(utf16, utf16Len);
+        if (back == NULL || strcmp(back, utf8) != 0) {
+            fprintf(stderr, "%s: round trip mismatch\n", s_samples[i].name);
+            return 1;
+        }
+        free(back);
+
+        start = nowNs();
+        for (long k = 0; k < iterations; k++) {
+            char16_t* p = strdup8to16(utf8, &utf16Len);
+
+            checksum += p[utf16Len - 1];
+            free(p);
+        }
+        widen = (nowNs() - start) / iterations;
+
+        start = nowNs();
+        for (long k = 0; k < iterations; k++) {
+            char* p = strndup16to8(utf16, utf16Len);
+
+            checksum += (unsigned char)p[0];
+            free(p);
+        }
+        narrow = (nowNs() - start) / iterations;
+
+        free(utf16);
+
+        printf("%-10s %6zu %12.1f %12.1f %12.1f\n", s_samples[i].name, len, widen, narrow,
+            2 * len / (widen + narrow) * 1e3);
+    }
+
+    // keeps the loops from being optimized out
+    if (checksum == 0) {
+        printf("\n");
+    }
+
+    return 0;
+}
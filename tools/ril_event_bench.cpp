@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host side benchmark of the ril_event timer heap.
+ *
+ * Arms, cancels and fires a number of timers (10000 by default) and prints
+ * the cost per operation and how late the timers fired. Build it against
+ * libril/ril_event.cpp, with log/log_radio.h on the include path, e.g.
+ *   c++ -O2 -Iinclude -Ilibril -I<dir of log/log_radio.h> -o ril_event_bench \
+ *       tools/ril_event_bench.cpp libril/ril_event.cpp -lpthread
+ *   ./ril_event_bench [timers]
+ *
+ * Add -DRIL_EVENT_USE_TIMERFD=0 or -DRIL_EVENT_USE_EPOLL=0 to compare the
+ * other backends.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <ril_event.h>
+
+// the last timers to fire are armed this far from now, at most
+#define FIRE_SPREAD_US 50000
+
+static struct ril_event* s_events;
+static struct timeval* s_due;
+static int s_remaining;
+static int64_t s_maxLateUs;
+static int64_t s_totalLateUs;
+static pthread_mutex_t s_doneMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_doneCond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void timerCallback(int fd, short flags, void* param)
+{
+    struct timeval* due = (struct timeval*)param;
+    struct timespec ts;
+    int64_t lateUs;
+
+    // ril_event keeps timers on CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    lateUs = ((int64_t)ts.tv_sec - due->tv_sec) * 1000000 + ts.tv_nsec / 1000 - due->tv_usec;
+
+    pthread_mutex_lock(&s_doneMutex);
+    if (lateUs > s_maxLateUs) {
+        s_maxLateUs = lateUs;
+    }
+    s_totalLateUs += lateUs;
+    if (--s_remaining == 0) {
+        pthread_cond_signal(&s_doneCond);
+    }
+    pthread_mutex_unlock(&s_doneMutex);
+}
+
+static void* eventLoop(void* param)
+{
+    ril_event_loop();
+    return NULL;
+}
+
+static void setDue(struct timeval* due, const struct timeval* delay)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    due->tv_sec = ts.tv_sec + delay->tv_sec;
+    due->tv_usec = ts.tv_nsec / 1000 + delay->tv_usec;
+    if (due->tv_usec >= 1000000) {
+        due->tv_sec++;
+        due->tv_usec -= 1000000;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    struct timeval delay;
+    pthread_t tid;
+    uint64_t start;
+    int fired;
+
+    if (argc > 2 || count <= 0) {
+        fprintf(stderr, "usage: %s [timers]\n", argv[0]);
+        return 2;
+    }
+
+    s_events = (struct ril_event*)calloc(count, sizeof(struct ril_event));
+    s_due = (struct timeval*)calloc(count, sizeof(struct timeval));
+    if (s_events == NULL || s_due == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    ril_event_init();
+    srand(1);
+
+    // far away, in random order, nothing fires meanwhile
+    start = nowNs();
+    for (int i = 0; i < count; i++) {
+        ril_event_set(&s_events[i], -1, false, timerCallback, &s_due[i]);
+        delay.tv_sec = 60 + rand() % 60;
+        delay.tv_usec = rand() % 1000000;
+        if (ril_timer_add(&s_events[i], &delay) < 0) {
+            fprintf(stderr, "ril_timer_add failed\n");
+            return 1;
+        }
+    }
+    printf("arm       %8d timers %8.1f ns/op\n", count, (double)(nowNs() - start) / count);
+
+    start = nowNs();
+    for (int i = 0; i < count; i += 2) {
+        ril_timer_del(&s_events[i]);
+    }
+    printf("cancel    %8d timers %8.1f ns/op\n", (count + 1) / 2,
+        (double)(nowNs() - start) / ((count + 1) / 2));
+
+    start = nowNs();
+    for (int i = 1; i < count; i += 2) {
+        delay.tv_sec = 30;
+        delay.tv_usec = rand() % 1000000;
+        ril_timer_add(&s_events[i], &delay);
+    }
+    printf("resched   %8d timers %8.1f ns/op\n", count / 2,
+        (double)(nowNs() - start) / (count / 2 > 0 ? count / 2 : 1));
+
+    // cancel the rest and rearm all of them close by, then let them fire
+    for (int i = 1; i < count; i += 2) {
+        ril_timer_del(&s_events[i]);
+    }
+
+    s_remaining = count;
+    for (int i = 0; i < count; i++) {
+        delay.tv_sec = 0;
+        delay.tv_usec = rand() % FIRE_SPREAD_US;
+        setDue(&s_due[i], &delay);
+        ril_timer_add(&s_events[i], &delay);
+    }
+
+    start = nowNs();
+    pthread_create(&tid, NULL, eventLoop, NULL);
+
+    pthread_mutex_lock(&s_doneMutex);
+    while (s_remaining > 0) {
+        pthread_cond_wait(&s_doneCond, &s_doneMutex);
+    }
+    fired = count;
+    pthread_mutex_unlock(&s_doneMutex);
+
+    printf("fire      %8d timers in %.1f ms, late by %.1f us average, %" PRId64 " us max\n",
+        fired, (nowNs() - start) / 1e6, (double)s_totalLateUs / fired, s_maxLateUs);
+
+    // the loop never returns, exit with it running
+    return 0;
+}
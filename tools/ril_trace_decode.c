@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2023 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host side decoder of the binary trace written by ril_trace_dump().
+ *
+ * Capture a trace by sending "trace" on the rild debug socket, e.g.
+ *   echo trace | socat - UNIX-CONNECT:/dev/socket/rild-debug > ril.trace
+ * then decode it on a host of the same byte order with
+ *   cc -Iinclude -o ril_trace_decode tools/ril_trace_decode.c
+ *   ./ril_trace_decode ril.trace
+ *
+ * Records of all threads are merged by time. Request and unsolicited ids
+ * are printed as numbers, see include/telephony/ril.h.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <telephony/ril_trace.h>
+
+static const char* traceTypeToString(uint16_t type)
+{
+    switch (type) {
+    case RIL_TRACE_REQUEST:
+        return "REQ";
+    case RIL_TRACE_RESPONSE:
+        return "RSP";
+    case RIL_TRACE_UNSOL:
+        return "UNSOL";
+    default:
+        return "?";
+    }
+}
+
+static int compareRecords(const void* a, const void* b)
+{
+    const RIL_TraceRecord* ra = (const RIL_TraceRecord*)a;
+    const RIL_TraceRecord* rb = (const RIL_TraceRecord*)b;
+
+    if (ra->timeNs != rb->timeNs) {
+        return ra->timeNs < rb->timeNs ? -1 : 1;
+    }
+
+    return ra->thread != rb->thread ? (int)ra->thread - (int)rb->thread
+                                    : (ra->seq < rb->seq ? -1 : ra->seq > rb->seq);
+}
+
+int main(int argc, char** argv)
+{
+    RIL_TraceHeader header;
+    RIL_TraceRecord* records;
+    FILE* in = stdin;
+    uint32_t count;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [trace file]\n", argv[0]);
+        return 2;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-") != 0) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    if (fread(&header, sizeof(header), 1, in) != 1) {
+        fprintf(stderr, "truncated header\n");
+        return 1;
+    }
+
+    if (header.magic != RIL_TRACE_MAGIC) {
+        fprintf(stderr, "not a ril trace (magic 0x%08" PRIx32 ")\n", header.magic);
+        return 1;
+    }
+
+    if (header.version != RIL_TRACE_VERSION
+        || header.recordSize != sizeof(RIL_TraceRecord)) {
+        fprintf(stderr, "unsupported trace version %u, record size %u\n",
+            header.version, header.recordSize);
+        return 1;
+    }
+
+    records = (RIL_TraceRecord*)calloc(header.count ? header.count : 1,
+        sizeof(RIL_TraceRecord));
+    if (records == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    count = fread(records, sizeof(RIL_TraceRecord), header.count, in);
+    if (count != header.count) {
+        fprintf(stderr, "truncated trace, %" PRIu32 " of %" PRIu32 " records\n",
+            count, header.count);
+    }
+
+    qsort(records, count, sizeof(RIL_TraceRecord), compareRecords);
+
+    printf("%14s %6s %-5s %10s %6s %6s %8s\n",
+        "time(us)", "thread", "type", "token", "id", "error", "length");
+
+    for (uint32_t i = 0; i < count; i++) {
+        const RIL_TraceRecord* r = &records[i];
+
+        printf("%14.3f %6u %-5s %10" PRId32 " %6" PRId32 " %6" PRId32 " %8" PRIu32 "\n",
+            (r->timeNs - records[0].timeNs) / 1000.0, r->thread,
+            traceTypeToString(r->type), r->token, r->id, r->error, r->length);
+    }
+
+    if (header.dropped > 0) {
+        printf("%" PRIu32 " records dropped by threads without a ring\n",
+            header.dropped);
+    }
+
+    free(records);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return 0;
+}